@@ -1,7 +1,9 @@
 package com.example.arslam;
 
-import android.util.Log;
-
+import java.nio.ByteBuffer;
+import java.nio.ByteOrder;
+import java.nio.DoubleBuffer;
+import java.util.ArrayList;
 import java.util.HashMap;
 import java.util.Locale;
 
@@ -9,6 +11,8 @@ public class Slam3dJni {
 
     private static String LOG_TAG = "Slam3dJni";
 
+    private static final int LOC_LEN = 6; // doubles per location in locs: found, t, x, y, z, theta
+
     public static class VioMeasurement {
         public final double t;
         public final float x;
@@ -67,11 +71,11 @@ public class Slam3dJni {
     }
 
     public static class TagLocation {
-        public final double t;
-        public final float x;
-        public final float y;
-        public final float z;
-        public final float theta;
+        public double t;
+        public float x;
+        public float y;
+        public float z;
+        public float theta;
 
         public TagLocation(double t, float x, float y, float z, float theta) {
             this.t = t;
@@ -89,6 +93,18 @@ public class Slam3dJni {
             this.theta = other.theta;
         }
 
+        // In place, so the filter's estimates are read without allocating
+        void set(DoubleBuffer locs, int i) {
+            i *= LOC_LEN;
+            if (locs.get(i) != 0.0) {
+                t = locs.get(i + 1);
+                x = (float) locs.get(i + 2);
+                y = (float) locs.get(i + 3);
+                z = (float) locs.get(i + 4);
+                theta = (float) locs.get(i + 5);
+            }
+        }
+
         @Override
         public String toString() {
             return String.format(Locale.US, "%.3f", t) + "," + x + "," + y + "," + z + "," + theta;
@@ -96,11 +112,11 @@ public class Slam3dJni {
     }
 
     public static class BcnLocation {
-        public final double t;
-        public final float x;
-        public final float y;
-        public final float z;
-        public final float theta;
+        public double t;
+        public float x;
+        public float y;
+        public float z;
+        public float theta;
 
         public BcnLocation(double t, float x, float y, float z, float theta) {
             this.t = t;
@@ -118,28 +134,45 @@ public class Slam3dJni {
             this.theta = other.theta;
         }
 
+        // In place, so the filter's estimates are read without allocating
+        void set(DoubleBuffer locs, int i) {
+            i *= LOC_LEN;
+            if (locs.get(i) != 0.0) {
+                t = locs.get(i + 1);
+                x = (float) locs.get(i + 2);
+                y = (float) locs.get(i + 3);
+                z = (float) locs.get(i + 4);
+                theta = (float) locs.get(i + 5);
+            }
+        }
+
         @Override
         public String toString() {
             return String.format(Locale.US, "%.3f", t) + "," + x + "," + y + "," + z + "," + theta;
         }
     }
 
-    public TagLocation tagLocation;
+    // Updated in place
+    public TagLocation tagLocation = new TagLocation(0.0, 0.0f, 0.0f, 0.0f, 0.0f);
     public HashMap<String, BcnLocation> bcnLocations = new HashMap<>();
 
     private long pf;
-    private HashMap<String, Long> bcnMap = new HashMap<>();
+    private HashMap<String, Integer> bcnMap = new HashMap<>();
+    private ArrayList<BcnLocation> bcnList = new ArrayList<>();
+    private ByteBuffer locBuf; // the native side writes estimates here, tag first, then beacons by index
+    private DoubleBuffer locs;
 
     private static native long particleFilterNewPf();
-    private static native long particleFilterNewBcn();
+    private static native int particleFilterNewBcn(long pf);
     private static native void particleFilterFreePf(long pf);
-    private static native void particleFilterFreeBcn(long bcn);
+    private static native int particleFilterSetLocs(long pf, ByteBuffer locs);
     private static native void particleFilterDepositTagVio(long pf, double t, float x, float y, float z, float dist);
-    private static native void particleFilterDepositBcnVio(long bcn, double t, float x, float y, float z, float dist);
-    private static native void particleFilterDepositRange(long pf, long bcn, float range, float stdRange, long[] bcnArray);
-    private static native void particleFilterDepositRssi(long pf, long bcn, int rssi, long[] bcnArray);
-    private static native TagLocation particleFilterGetTagLoc(long pf);
-    private static native BcnLocation particleFilterGetBcnLoc(long pf, long bcn);
+    private static native void particleFilterDepositBcnVio(long pf, int bcn, double t, float x, float y, float z, float dist);
+    private static native void particleFilterDepositRange(long pf, int bcn, float range, float stdRange);
+    private static native void particleFilterDepositRssi(long pf, int bcn, int rssi);
+    private static native int particleFilterGetTagLoc(long pf);
+    private static native int particleFilterGetBcnLoc(long pf, int bcn);
+    private static native int particleFilterGetLocs(long pf);
 
     static {
         System.loadLibrary("slam3d");
@@ -147,19 +180,24 @@ public class Slam3dJni {
 
     public Slam3dJni() {
         pf = particleFilterNewPf();
-        tagLocation = particleFilterGetTagLoc(pf);
+        if (pf == 0L) {
+            throw new OutOfMemoryError("Slam3d could not create a filter");
+        }
+        setLocs(1 + 8);
+        particleFilterGetTagLoc(pf);
+        tagLocation.set(locs, 0);
     }
 
     public void free() {
         if (pf == 0L) {
             throw new NullPointerException("Slam3d is not initialized");
         }
-        for (Long bcn : bcnMap.values()) {
-            particleFilterFreeBcn(bcn);
-        }
-        bcnMap.clear();
         particleFilterFreePf(pf);
         pf = 0L;
+        bcnMap.clear();
+        bcnList.clear();
+        locBuf = null;
+        locs = null;
 
         tagLocation = null;
         bcnLocations.clear();
@@ -170,55 +208,66 @@ public class Slam3dJni {
             throw new NullPointerException("Slam3d is not initialized");
         }
         particleFilterDepositTagVio(pf, t, x, y, z, 0.0f);
-        tagLocation = particleFilterGetTagLoc(pf);
+        particleFilterGetTagLoc(pf);
+        tagLocation.set(locs, 0);
     }
 
     public void depositBcnVio(String bcnName, double t, float x, float y, float z) {
         if (pf == 0L) {
             throw new NullPointerException("Slam3d is not initialized");
         }
-        if (!bcnMap.containsKey(bcnName)) {
-            bcnMap.put(bcnName, particleFilterNewBcn());
-        }
-        particleFilterDepositBcnVio(bcnMap.get(bcnName), t, x, y, z, 0.0f);
-        bcnLocations.put(bcnName, particleFilterGetBcnLoc(pf, bcnMap.get(bcnName)));
+        int bcn = bcnIndex(bcnName);
+        particleFilterDepositBcnVio(pf, bcn, t, x, y, z, 0.0f);
+        particleFilterGetBcnLoc(pf, bcn);
+        bcnList.get(bcn).set(locs, 1 + bcn);
     }
 
     public void depositRange(String bcnName, float range, float stdRange) {
         if (pf == 0L) {
             throw new NullPointerException("Slam3d is not initialized");
         }
-        if (!bcnMap.containsKey(bcnName)) {
-            bcnMap.put(bcnName, particleFilterNewBcn());
-        }
-        long[] bcnArray = new long[bcnMap.size()];
-        int i = 0;
-        for (Long bcn : bcnMap.values()) {
-            bcnArray[i++] = bcn;
-        }
-        particleFilterDepositRange(pf, bcnMap.get(bcnName), range, stdRange, bcnArray);
-        tagLocation = particleFilterGetTagLoc(pf);
-        for (String bcn : bcnMap.keySet()) {
-            bcnLocations.put(bcn, particleFilterGetBcnLoc(pf, bcnMap.get(bcn)));
-        }
+        particleFilterDepositRange(pf, bcnIndex(bcnName), range, stdRange);
+        readLocs();
     }
 
     public void depositRssi(String bcnName, int rssi) {
         if (pf == 0L) {
             throw new NullPointerException("Slam3d is not initialized");
         }
-        if (!bcnMap.containsKey(bcnName)) {
-            bcnMap.put(bcnName, particleFilterNewBcn());
-        }
-        long[] bcnArray = new long[bcnMap.size()];
-        int i = 0;
-        for (Long bcn : bcnMap.values()) {
-            bcnArray[i++] = bcn;
+        particleFilterDepositRssi(pf, bcnIndex(bcnName), rssi);
+        readLocs();
+    }
+
+    // Registers a beacon with the filter the first time it is seen
+    private int bcnIndex(String bcnName) {
+        Integer bcn = bcnMap.get(bcnName);
+        if (bcn == null) {
+            bcn = particleFilterNewBcn(pf);
+            if (bcn < 0) {
+                throw new OutOfMemoryError("Slam3d could not add beacon " + bcnName);
+            }
+            BcnLocation loc = new BcnLocation(0.0, 0.0f, 0.0f, 0.0f, 0.0f);
+            bcnMap.put(bcnName, bcn);
+            bcnList.add(loc);
+            bcnLocations.put(bcnName, loc);
+            if (locs.capacity() < (1 + bcnList.size()) * LOC_LEN) {
+                setLocs(2 * (1 + bcnList.size()));
+            }
         }
-        particleFilterDepositRssi(pf, bcnMap.get(bcnName), rssi, bcnArray);
-        tagLocation = particleFilterGetTagLoc(pf);
-        for (String bcn : bcnMap.keySet()) {
-            bcnLocations.put(bcn, particleFilterGetBcnLoc(pf, bcnMap.get(bcn)));
+        return bcn;
+    }
+
+    private void setLocs(int numLocs) {
+        locBuf = ByteBuffer.allocateDirect(numLocs * LOC_LEN * Double.BYTES).order(ByteOrder.nativeOrder());
+        locs = locBuf.asDoubleBuffer();
+        particleFilterSetLocs(pf, locBuf);
+    }
+
+    private void readLocs() {
+        int numLocs = particleFilterGetLocs(pf);
+        tagLocation.set(locs, 0);
+        for (int i = 1; i < numLocs; i++) {
+            bcnList.get(i - 1).set(locs, i);
         }
     }
 
@@ -5,79 +5,229 @@
 //  Copyright © 2019 CMU. All rights reserved.
 //
 
+#if defined(__ANDROID__)
 #include <android/log.h>
-#include <malloc.h>
+#else
+#include <stdio.h>
+#endif
 #include <jni.h>
+#include <pthread.h>
+#include <stdlib.h>
 #include <particleFilter.h>
+#include <pfAlloc.h>
 
 #define APPNAME "ArSlam"
 
+// Off the device the bridge builds against a desktop JDK and logs to stderr
+#if defined(__ANDROID__)
+#define LOG_ERROR(...)  __android_log_print(ANDROID_LOG_ERROR, APPNAME, __VA_ARGS__)
+#else
+#define LOG_ERROR(...)  (fprintf(stderr, APPNAME ": " __VA_ARGS__), fputc('\n', stderr))
+#endif
+
+#define LOC_LEN         (6)     // doubles per location in locs: found, t, x, y, z, theta
+#define MIN_BCNS        (8)
+
+// What Java holds for a filter. Beacons are registered with it once and
+// addressed by index, and locations are written into a direct buffer the
+// caller registered, so no update pins an array or creates an object
+typedef struct {
+    particleFilterSlam_t* pf;
+    bcn_t** bcns;               // every update commits the VIO of all of them
+    int numBcns;
+    int maxBcns;
+    double* locs;               // the tag's location, then each beacon's
+    int maxLocs;
+} _slam_t;
+
+static void _initArena(void);
+static void* _arenaAlloc(void* ctx, size_t size, size_t align);
+static void _arenaFree(void* ctx, void* p, size_t size);
+static void _writeLoc(double* loc, uint8_t found, double t, float x, float y, float z, float theta);
+static jint _writeBcnLoc(const _slam_t* slam, int i);
+
+// Filters come from one huge-page backed arena, so a freed beacon's 2 MB is
+// reused by the next beacon. Java may call in from any thread
+static pfArena_t _arena;
+static pfAllocator_t _arenaHooks;
+static pthread_once_t _arenaOnce = PTHREAD_ONCE_INIT;
+static pthread_mutex_t _arenaLock = PTHREAD_MUTEX_INITIALIZER;
+
 JNIEXPORT jlong JNICALL Java_com_example_arslam_Slam3dJni_particleFilterNewPf(
         JNIEnv* env, jclass clazz) {
-    particleFilterSlam_t* pf = (particleFilterSlam_t*)malloc(sizeof(particleFilterSlam_t));
-    particleFilterSlam_init(pf);
-    return (jlong)pf;
+    _slam_t* slam;
+
+    pthread_once(&_arenaOnce, _initArena);
+    slam = (_slam_t*)calloc(1, sizeof(_slam_t));
+    if (slam == NULL)
+        return 0;
+    slam->pf = particleFilterSlam_new();
+    if (slam->pf == NULL) {
+        LOG_ERROR("Out of memory for a filter");
+        free(slam);
+        return 0;
+    }
+    return (jlong)slam;
 }
 
-JNIEXPORT jlong JNICALL Java_com_example_arslam_Slam3dJni_particleFilterNewBcn(
-        JNIEnv* env, jclass clazz) {
-    bcn_t* bcn = (bcn_t*)malloc(sizeof(bcn_t));
-    particleFilterSlam_addBcn(bcn);
-    return (jlong)bcn;
+// Returns the new beacon's index, or -1
+JNIEXPORT jint JNICALL Java_com_example_arslam_Slam3dJni_particleFilterNewBcn(
+        JNIEnv* env, jclass clazz, jlong handle) {
+    _slam_t* slam = (_slam_t*)handle;
+    bcn_t** bcns;
+    bcn_t* bcn;
+    int maxBcns;
+
+    if (slam->numBcns == slam->maxBcns) {
+        maxBcns = slam->maxBcns > 0 ? 2 * slam->maxBcns : MIN_BCNS;
+        bcns = (bcn_t**)realloc(slam->bcns, maxBcns * sizeof(bcn_t*));
+        if (bcns == NULL)
+            return -1;
+        slam->bcns = bcns;
+        slam->maxBcns = maxBcns;
+    }
+    bcn = particleFilterSlam_newBcn();
+    if (bcn == NULL) {
+        LOG_ERROR("Out of memory for beacon %d", slam->numBcns);
+        return -1;
+    }
+    slam->bcns[slam->numBcns] = bcn;
+    return slam->numBcns++;
 }
 
+// Frees the beacons too
 JNIEXPORT void JNICALL Java_com_example_arslam_Slam3dJni_particleFilterFreePf(
-        JNIEnv* env, jclass clazz, jlong pf) {
-    free((particleFilterSlam_t*)pf);
+        JNIEnv* env, jclass clazz, jlong handle) {
+    _slam_t* slam = (_slam_t*)handle;
+    int i;
+
+    for (i = 0; i < slam->numBcns; ++i)
+        particleFilterSlam_deleteBcn(slam->bcns[i]);
+    particleFilterSlam_delete(slam->pf);
+    free(slam->bcns);
+    free(slam);
 }
 
-JNIEXPORT void JNICALL Java_com_example_arslam_Slam3dJni_particleFilterFreeBcn(
-        JNIEnv* env, jclass clazz, jlong bcn) {
-    free((bcn_t*)bcn);
+// locs must be a direct buffer in native byte order, and stay reachable
+// until it is replaced or the filter freed. Returns how many locations fit
+JNIEXPORT jint JNICALL Java_com_example_arslam_Slam3dJni_particleFilterSetLocs(
+        JNIEnv* env, jclass clazz, jlong handle, jobject locs) {
+    _slam_t* slam = (_slam_t*)handle;
+
+    slam->locs = (double*)(*env)->GetDirectBufferAddress(env, locs);
+    if (slam->locs == NULL)
+        slam->maxLocs = 0;
+    else
+        slam->maxLocs = (int)((*env)->GetDirectBufferCapacity(env, locs) / (LOC_LEN * sizeof(double)));
+    return slam->maxLocs;
 }
 
 JNIEXPORT void JNICALL Java_com_example_arslam_Slam3dJni_particleFilterDepositTagVio(
-        JNIEnv* env, jclass clazz, jlong pf, jdouble t, jfloat x, jfloat y, jfloat z, jfloat dist) {
-    particleFilterSlam_depositTagVio((particleFilterSlam_t*)pf, (double)t, (float)x, (float)y, (float)z, (float)dist);
+        JNIEnv* env, jclass clazz, jlong handle, jdouble t, jfloat x, jfloat y, jfloat z, jfloat dist) {
+    _slam_t* slam = (_slam_t*)handle;
+    particleFilterSlam_depositTagVio(slam->pf, (double)t, (float)x, (float)y, (float)z, (float)dist);
 }
 
 JNIEXPORT void JNICALL Java_com_example_arslam_Slam3dJni_particleFilterDepositBcnVio(
-        JNIEnv *env, jclass clazz, jlong bcn, jdouble t, jfloat x, jfloat y, jfloat z, jfloat dist) {
-    particleFilterSlam_depositBcnVio((bcn_t*)bcn, (double)t, (float)x, (float)y, (float)z, (float)dist);
+        JNIEnv *env, jclass clazz, jlong handle, jint bcn, jdouble t, jfloat x, jfloat y, jfloat z, jfloat dist) {
+    _slam_t* slam = (_slam_t*)handle;
+    if (bcn >= 0 && bcn < slam->numBcns)
+        particleFilterSlam_depositBcnVio(slam->bcns[bcn], (double)t, (float)x, (float)y, (float)z, (float)dist);
 }
 
 JNIEXPORT void JNICALL Java_com_example_arslam_Slam3dJni_particleFilterDepositRange(
-        JNIEnv* env, jclass clazz, jlong pf, jlong bcn, jfloat range, jfloat stdRange, jlongArray bcnArray) {
-    bcn_t** allBcns = (bcn_t**)(*env)->GetLongArrayElements(env, bcnArray, NULL);
-    int numBcns = (int)(*env)->GetArrayLength(env, bcnArray);
-    particleFilterSlam_depositRange((particleFilterSlam_t*)pf, (bcn_t*)bcn, (float)range, (float)stdRange, allBcns, numBcns);
-    (*env)->ReleaseLongArrayElements(env, bcnArray, (jlong*)allBcns, 0);
+        JNIEnv* env, jclass clazz, jlong handle, jint bcn, jfloat range, jfloat stdRange) {
+    _slam_t* slam = (_slam_t*)handle;
+    if (bcn >= 0 && bcn < slam->numBcns)
+        particleFilterSlam_depositRange(slam->pf, slam->bcns[bcn], (float)range, (float)stdRange, slam->bcns, slam->numBcns);
 }
 
 JNIEXPORT void JNICALL Java_com_example_arslam_Slam3dJni_particleFilterDepositRssi(
-        JNIEnv* env, jclass clazz, jlong pf, jlong bcn, jint rssi, jlongArray bcnArray) {
-    bcn_t** allBcns = (bcn_t**)(*env)->GetLongArrayElements(env, bcnArray, NULL);
-    int numBcns = (int)(*env)->GetArrayLength(env, bcnArray);
-    particleFilterSlam_depositRssi((particleFilterSlam_t*)pf, (bcn_t*)bcn, (int)rssi, allBcns, numBcns);
-    (*env)->ReleaseLongArrayElements(env, bcnArray, (jlong*)allBcns, 0);
+        JNIEnv* env, jclass clazz, jlong handle, jint bcn, jint rssi) {
+    _slam_t* slam = (_slam_t*)handle;
+    if (bcn >= 0 && bcn < slam->numBcns)
+        particleFilterSlam_depositRssi(slam->pf, slam->bcns[bcn], (int)rssi, slam->bcns, slam->numBcns);
 }
 
-JNIEXPORT jobject JNICALL Java_com_example_arslam_Slam3dJni_particleFilterGetTagLoc(
-        JNIEnv* env, jclass clazz, jlong pf) {
+// The Get functions write into the registered buffer and return the number
+// of locations written there
+JNIEXPORT jint JNICALL Java_com_example_arslam_Slam3dJni_particleFilterGetTagLoc(
+        JNIEnv* env, jclass clazz, jlong handle) {
+    _slam_t* slam = (_slam_t*)handle;
     double t;
     float x, y, z, theta;
-    jclass class = (*env)->FindClass(env, "com/example/arslam/Slam3dJni$TagLocation");
-    jmethodID cid = (*env)->GetMethodID(env, class, "<init>", "(DFFFF)V");
-    particleFilterSlam_getTagLoc((const particleFilterSlam_t*)pf, &t, &x, &y, &z, &theta);
-    return (*env)->NewObject(env, class, cid, t, x, y, z, theta);
+    uint8_t found;
+
+    if (slam->maxLocs < 1)
+        return 0;
+    found = particleFilterSlam_getTagLoc(slam->pf, &t, &x, &y, &z, &theta);
+    _writeLoc(slam->locs, found, t, x, y, z, theta);
+    return 1;
+}
+
+JNIEXPORT jint JNICALL Java_com_example_arslam_Slam3dJni_particleFilterGetBcnLoc(
+        JNIEnv* env, jclass clazz, jlong handle, jint bcn) {
+    _slam_t* slam = (_slam_t*)handle;
+
+    if (bcn < 0 || bcn >= slam->numBcns)
+        return 0;
+    return _writeBcnLoc(slam, bcn);
+}
+
+// The tag's, then every beacon's
+JNIEXPORT jint JNICALL Java_com_example_arslam_Slam3dJni_particleFilterGetLocs(
+        JNIEnv* env, jclass clazz, jlong handle) {
+    _slam_t* slam = (_slam_t*)handle;
+    jint numLocs;
+    int i;
+
+    numLocs = Java_com_example_arslam_Slam3dJni_particleFilterGetTagLoc(env, clazz, handle);
+    for (i = 0; i < slam->numBcns; ++i)
+        numLocs += _writeBcnLoc(slam, i);
+    return numLocs;
 }
 
-JNIEXPORT jobject JNICALL Java_com_example_arslam_Slam3dJni_particleFilterGetBcnLoc(
-        JNIEnv* env, jclass clazz, jlong pf, jlong bcn) {
+static void _initArena(void) {
+    pfArena_init(&_arena, PF_ARENA_HUGE_TRANSPARENT);
+    _arenaHooks.alloc = _arenaAlloc;
+    _arenaHooks.free = _arenaFree;
+    _arenaHooks.ctx = &_arena;
+    particleFilterAllocator_set(&_arenaHooks);
+}
+
+static void* _arenaAlloc(void* ctx, size_t size, size_t align) {
+    void* p;
+    pthread_mutex_lock(&_arenaLock);
+    p = pfArena_alloc((pfArena_t*)ctx, size);
+    pthread_mutex_unlock(&_arenaLock);
+    return p;
+}
+
+static void _arenaFree(void* ctx, void* p, size_t size) {
+    pthread_mutex_lock(&_arenaLock);
+    pfArena_free((pfArena_t*)ctx, p, size);
+    pthread_mutex_unlock(&_arenaLock);
+}
+
+static void _writeLoc(double* loc, uint8_t found, double t, float x, float y, float z, float theta) {
+    loc[0] = (double)found;
+    if (found) {
+        loc[1] = t;
+        loc[2] = (double)x;
+        loc[3] = (double)y;
+        loc[4] = (double)z;
+        loc[5] = (double)theta;
+    }
+}
+
+static jint _writeBcnLoc(const _slam_t* slam, int i) {
     double t;
     float x, y, z, theta;
-    jclass class = (*env)->FindClass(env, "com/example/arslam/Slam3dJni$BcnLocation");
-    jmethodID cid = (*env)->GetMethodID(env, class, "<init>", "(DFFFF)V");
-    particleFilterSlam_getBcnLoc((const particleFilterSlam_t*)pf, (const bcn_t*)bcn, &t, &x, &y, &z, &theta);
-    return (*env)->NewObject(env, class, cid, t, x, y, z, theta);
+    uint8_t found;
+
+    if (i + 1 >= slam->maxLocs)
+        return 0;
+    found = particleFilterSlam_getBcnLoc(slam->pf, slam->bcns[i], &t, &x, &y, &z, &theta);
+    _writeLoc(&slam->locs[(i + 1) * LOC_LEN], found, t, x, y, z, theta);
+    return 1;
 }
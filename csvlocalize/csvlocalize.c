@@ -12,6 +12,7 @@
 #include <string.h>
 
 #include "particleFilter.h"
+#include "pfTrace.h"
 
 //#define DATA_DIR            "../sampledata/"
 //#define TRACE_DIR           DATA_DIR "cic/0/"
@@ -56,6 +57,15 @@ int main(int argc, char** argv)
     double vioT, uwbT, outT;
     float vioX, vioY, vioZ, uwbR, outX, outY, outZ, outTheta;
     uint8_t uwbB, haveVio, haveUwb;
+    uint64_t spanT;
+
+    // With a path, spans of the replay are written there as Chrome trace
+    // events; build with -DPF_ENABLE_TRACE=1 to see inside the filter too
+    if (argc > 1)
+    {
+        pfTrace_start(0);
+        pfTrace_setThreadName("csvlocalize");
+    }
 
     printf("Starting localization\n");
     vioFile = fopen(VIO_FILE, "r");
@@ -75,17 +85,27 @@ int main(int argc, char** argv)
     {
         if (haveVio && (!haveUwb || vioT < uwbT))
         {
+            spanT = pfTrace_now();
             particleFilterLoc_depositVio(&_particleFilter, vioT, vioX, vioY, vioZ, 0.0f);
+            pfTrace_record("depositVio", spanT);
+            spanT = pfTrace_now();
             if (particleFilterLoc_getTagLoc(&_particleFilter, &outT, &outX, &outY, &outZ, &outTheta))
                 _writeTagLoc(tagOutFile, outT, outX, outY, outZ, outTheta);
+            pfTrace_record("publish", spanT);
+            spanT = pfTrace_now();
             haveVio = _getVio(vioFile, &vioT, &vioX, &vioY, &vioZ, 0);
+            pfTrace_record("parse", spanT);
         }
         else if (haveUwb)
         {
             uwbR -= UWB_BIAS;
+            spanT = pfTrace_now();
             if (uwbR > 0.0f && uwbR < 30.0f)
                 particleFilterLoc_depositRange(&_particleFilter, deployment[uwbB][0], deployment[uwbB][1], deployment[uwbB][2], uwbR, UWB_STD);
+            pfTrace_record("depositRange", spanT);
+            spanT = pfTrace_now();
             haveUwb = _getUwb(uwbFile, &uwbT, &uwbB, &uwbR, 0);
+            pfTrace_record("parse", spanT);
         }
     }
     printf("Finished localization\n");
@@ -93,6 +113,12 @@ int main(int argc, char** argv)
     fclose(vioFile);
     fclose(uwbFile);
     fclose(tagOutFile);
+    if (argc > 1)
+    {
+        pfTrace_stop();
+        if (!pfTrace_dump(argv[1]))
+            printf("Failed to write trace to %s\n", argv[1]);
+    }
 
     printf("Done\n");
     return 0;
@@ -0,0 +1,83 @@
+//
+//  mlBudget.c
+//
+//  Created by slam3d contributors on 10/19/26.
+//  Copyright © 2026 CMU. All rights reserved.
+//
+//  With n ranges pending, each update gets budget / (n + 1): if every one of
+//  them keeps to that, the last range is applied within one budget of this
+//  one, which bounds the queueing part of the update latency however deep
+//  the backlog gets
+//
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "particleFilter.h"
+
+#include "mlBudget.h"
+
+void mlBudget_init(mlBudget_t* b, double budget)
+{
+    b->budget = budget;
+    b->cost = 0.0;
+    b->shift = 0;
+    b->calm = 0;
+    b->calmSince = 0.0;
+    b->busy = 0.0;
+    b->pending = 0;
+    b->numUpdates = 0;
+    b->numDegraded = 0;
+}
+
+// Particles the next range update should run on, pending being the ranges
+// queued or held behind it, and now a monotonic time in s. Drops straight
+// to the largest level that fits but climbs back one level at a time. An
+// empty backlog is not enough to climb: the worker must also have spent
+// little enough of the last ML_BUDGET_CALM updates busy that twice the
+// particles would leave it idle part of the time, or every burst would be
+// met at the full count and the level lost and regained with each one
+int mlBudget_level(mlBudget_t* b, size_t pending, double now)
+{
+    double fit;
+
+    b->pending = pending;
+    if (b->budget <= 0.0 || b->cost <= 0.0)
+        return PF_N_TAG_LOC >> b->shift;
+    fit = b->budget / ((double)(pending + 1) * b->cost);
+    while (b->shift < ML_BUDGET_LEVELS && (PF_N_TAG_LOC >> b->shift) > fit)
+    {
+        ++b->shift;
+        b->calm = 0;
+    }
+    if (b->shift > 0 && (PF_N_TAG_LOC >> (b->shift - 1)) * ML_BUDGET_HEADROOM <= fit)
+    {
+        if (b->calm++ == 0)
+        {
+            b->calmSince = now;
+            b->busy = 0.0;
+        }
+        else if (b->calm >= ML_BUDGET_CALM)
+        {
+            if (2.0 * ML_BUDGET_HEADROOM * b->busy <= now - b->calmSince)
+                --b->shift;
+            b->calm = 0;
+        }
+    }
+    else
+        b->calm = 0;
+    return PF_N_TAG_LOC >> b->shift;
+}
+
+// elapsed is the time the update took, on numParticles particles
+void mlBudget_record(mlBudget_t* b, int numParticles, double elapsed)
+{
+    double cost;
+
+    cost = elapsed / numParticles;
+    b->cost = b->cost > 0.0 ? b->cost + ML_BUDGET_SMOOTH * (cost - b->cost) : cost;
+    b->busy += elapsed;
+    ++b->numUpdates;
+    if (numParticles < PF_N_TAG_LOC)
+        ++b->numDegraded;
+}
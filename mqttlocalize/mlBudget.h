@@ -0,0 +1,43 @@
+//
+//  mlBudget.h
+//
+//  Created by slam3d contributors on 10/19/26.
+//  Copyright © 2026 CMU. All rights reserved.
+//
+//  Anytime range updates. A worker's ranges share a time budget with the
+//  backlog behind them: when the measured cost per particle says the full
+//  particle set would not clear the backlog in time, the worker's tags run
+//  on half as many particles, and on twice as many again once the backlog
+//  and the time spent updating both leave room for it
+//
+
+#ifndef _MLBUDGET_H
+#define _MLBUDGET_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define ML_BUDGET_LEVELS    (6)     // halvings, so at worst PF_N_TAG_LOC / 64 particles
+#define ML_BUDGET_HEADROOM  (1.5)   // a level comes back once it fits this many times over
+#define ML_BUDGET_CALM      (64)    // in as many updates in a row
+#define ML_BUDGET_SMOOTH    (0.125)
+
+typedef struct
+{
+    double budget;          // s for a range and the backlog behind it, 0 never degrades
+    double cost;            // s per particle per range update, smoothed
+    int shift;              // the worker's tags run on PF_N_TAG_LOC >> shift particles
+    int calm;               // updates in a row the level above would have fit
+    double calmSince;       // when they started
+    double busy;            // s spent on range updates since
+    size_t pending;         // ranges behind the last update
+    uint64_t numUpdates;
+    uint64_t numDegraded;   // run on fewer than PF_N_TAG_LOC particles
+
+} mlBudget_t;
+
+void mlBudget_init(mlBudget_t* b, double budget);
+int mlBudget_level(mlBudget_t* b, size_t pending, double now);
+void mlBudget_record(mlBudget_t* b, int numParticles, double elapsed);
+
+#endif
@@ -0,0 +1,59 @@
+//
+//  mlCoalesce.c
+//
+//  Created by slam3d contributors on 10/19/26.
+//  Copyright © 2026 CMU. All rights reserved.
+//
+
+#include <math.h>
+#include <stdint.h>
+
+#include "mlCoalesce.h"
+
+// The record carrying range now holds the slot
+void mlCoalesce_open(mlCoalesceSlot_t* slot, double t, float range)
+{
+    slot->ranges[0] = range;
+    slot->count = 1;
+    slot->t = t;
+    slot->tLast = t;
+}
+
+// Folds range into the slot if a record holds it and took its range within
+// window s of t. Returns 0 if the range has to be applied on its own
+uint8_t mlCoalesce_merge(mlCoalesceSlot_t* slot, double t, float range, double window)
+{
+    if (slot->count == 0 || fabs(t - slot->t) > window)
+        return 0;
+    slot->ranges[slot->count % ML_COALESCE_LEN] = range;
+    ++slot->count;
+    if (t > slot->tLast)
+        slot->tLast = t;
+    return 1;
+}
+
+// Frees the slot, returning the range to apply and when the freshest of
+// the ranges folded in was taken. Freshest is the last one to arrive, which
+// with reordered input may not be the latest taken
+float mlCoalesce_take(mlCoalesceSlot_t* slot, mlCoalescePolicy_t policy, double* tLast)
+{
+    float sorted[ML_COALESCE_LEN], r;
+    uint32_t n, i, j;
+
+    *tLast = slot->tLast;
+    n = slot->count < ML_COALESCE_LEN ? slot->count : ML_COALESCE_LEN;
+    r = slot->ranges[(slot->count - 1) % ML_COALESCE_LEN];
+    slot->count = 0;
+    if (policy == ML_COALESCE_FRESHEST)
+        return r;
+
+    // Insertion sort, there are at most ML_COALESCE_LEN
+    for (i = 0; i < n; ++i)
+    {
+        r = slot->ranges[i];
+        for (j = i; j > 0 && sorted[j - 1] > r; --j)
+            sorted[j] = sorted[j - 1];
+        sorted[j] = r;
+    }
+    return n % 2 == 1 ? sorted[n / 2] : 0.5f * (sorted[n / 2 - 1] + sorted[n / 2]);
+}
@@ -0,0 +1,40 @@
+//
+//  mlCoalesce.h
+//
+//  Created by slam3d contributors on 10/19/26.
+//  Copyright © 2026 CMU. All rights reserved.
+//
+//  Range coalescing for overload. A tag keeps one slot per beacon; while a
+//  range to that beacon waits to be applied, later ranges to it within the
+//  window are folded into the slot instead of queueing behind it, and the
+//  waiting record is applied with their median or the freshest of them
+//
+
+#ifndef _MLCOALESCE_H
+#define _MLCOALESCE_H
+
+#include <stdint.h>
+
+#define ML_COALESCE_LEN     (8)     // ranges a slot keeps, the oldest go first
+
+typedef enum
+{
+    ML_COALESCE_MEDIAN = 0,
+    ML_COALESCE_FRESHEST,
+
+} mlCoalescePolicy_t;
+
+typedef struct
+{
+    float ranges[ML_COALESCE_LEN];
+    uint32_t count;         // ranges folded in, 0 when no record holds the slot
+    double t;               // of the record holding it
+    double tLast;           // of the freshest range
+
+} mlCoalesceSlot_t;
+
+void mlCoalesce_open(mlCoalesceSlot_t* slot, double t, float range);
+uint8_t mlCoalesce_merge(mlCoalesceSlot_t* slot, double t, float range, double window);
+float mlCoalesce_take(mlCoalesceSlot_t* slot, mlCoalescePolicy_t policy, double* tLast);
+
+#endif
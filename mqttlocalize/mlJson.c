@@ -0,0 +1,398 @@
+//
+//  mlJson.c
+//
+//  Created by slam3d contributors on 10/19/26.
+//  Copyright © 2026 CMU. All rights reserved.
+//
+//  Example VIO message:
+//  {"object_id":"camera_jerry_jerry","action":"update","type":"object","timestamp":"2021-07-01T18:20:21.123Z",
+//   "data":{"position":{"x":0.788,"y":1.105,"z":-0.235},"rotation":{"x":0.024,"y":0.701,"z":0.712,"w":0.026}}}
+//
+//  Keys are compared on their raw bytes; a key written with escapes will not
+//  match. If such a key was seen where the position could have been, the
+//  caller gets ML_JSON_ESCAPED instead of ML_JSON_MISSING and can fall back
+//  to cJSON; messages that just have no position are not worth a second look
+//
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mlJson.h"
+
+#define MAX_DEPTH           (32)
+#define NUM_BUF_LEN         (64)
+
+typedef enum
+{
+    CTX_OTHER = 0,
+    CTX_ROOT,
+    CTX_DATA,
+    CTX_POSITION,
+    CTX_ROTATION,
+
+} _context_t;
+
+typedef struct
+{
+    const char* p;
+    const char* end;
+    mlVio_t* vio;
+    uint8_t escaped;        // a key that might have led to the position had escapes
+
+} _cursor_t;
+
+static int8_t _parseValue(_cursor_t* c, int depth, _context_t ctx, double* number);
+static int8_t _parseObject(_cursor_t* c, int depth, _context_t ctx);
+static int8_t _parseArray(_cursor_t* c, int depth);
+static int8_t _parseString(_cursor_t* c, const char** str, size_t* len);
+static int8_t _parseNumber(_cursor_t* c, double* number);
+static int8_t _parseLiteral(_cursor_t* c, const char* literal);
+static uint8_t _parseIsoTime(const char* str, size_t len, double* t);
+static void _skipWs(_cursor_t* c);
+static uint8_t _keyIs(const char* key, size_t len, const char* name);
+
+int8_t mlJson_parseVio(const char* buf, size_t len, mlVio_t* vio)
+{
+    _cursor_t c;
+    int8_t status;
+
+    memset(vio, 0, sizeof(mlVio_t));
+    c.p = buf;
+    c.end = buf + len;
+    c.vio = vio;
+    c.escaped = 0;
+
+    _skipWs(&c);
+    if (c.p == c.end || *c.p != '{')
+        return ML_JSON_MALFORMED;
+    status = _parseObject(&c, 0, CTX_ROOT);
+    if (status != ML_JSON_OK)
+        return status;
+    _skipWs(&c);
+    if (c.p != c.end && *c.p != '\0')
+        return ML_JSON_MALFORMED;
+
+    if (vio->hasPosition == 0x7)
+        return ML_JSON_OK;
+    return c.escaped ? ML_JSON_ESCAPED : ML_JSON_MISSING;
+}
+
+static int8_t _parseValue(_cursor_t* c, int depth, _context_t ctx, double* number)
+{
+    const char* str;
+    size_t len;
+    double ignored;
+
+    _skipWs(c);
+    if (c->p == c->end)
+        return ML_JSON_MALFORMED;
+
+    switch (*c->p)
+    {
+    case '{':
+        return _parseObject(c, depth + 1, ctx);
+    case '[':
+        return _parseArray(c, depth + 1);
+    case '"':
+        if (_parseString(c, &str, &len) != ML_JSON_OK)
+            return ML_JSON_MALFORMED;
+        // ARENA stamps messages with ISO 8601 strings
+        if (number == &c->vio->timestamp && _parseIsoTime(str, len, number))
+            c->vio->hasTimestamp = 1;
+        return ML_JSON_OK;
+    case 't':
+        return _parseLiteral(c, "true");
+    case 'f':
+        return _parseLiteral(c, "false");
+    case 'n':
+        return _parseLiteral(c, "null");
+    default:
+        if (number == NULL)
+            return _parseNumber(c, &ignored);
+        if (_parseNumber(c, number) != ML_JSON_OK)
+            return ML_JSON_MALFORMED;
+        if (number == &c->vio->timestamp)
+        {
+            // Numeric client timestamps are accepted in seconds or milliseconds
+            if (*number > 1e11)
+                *number /= 1000.0;
+            c->vio->hasTimestamp = 1;
+        }
+        return ML_JSON_OK;
+    }
+}
+
+static int8_t _parseObject(_cursor_t* c, int depth, _context_t ctx)
+{
+    const char* key;
+    size_t keyLen;
+    _context_t childCtx;
+    double* number;
+    uint8_t bit, *mask;
+    int8_t status;
+
+    if (depth > MAX_DEPTH)
+        return ML_JSON_MALFORMED;
+    ++c->p; // '{'
+    _skipWs(c);
+    if (c->p != c->end && *c->p == '}')
+    {
+        ++c->p;
+        return ML_JSON_OK;
+    }
+
+    for (;;)
+    {
+        _skipWs(c);
+        if (_parseString(c, &key, &keyLen) != ML_JSON_OK)
+            return ML_JSON_MALFORMED;
+        _skipWs(c);
+        if (c->p == c->end || *c->p != ':')
+            return ML_JSON_MALFORMED;
+        ++c->p;
+        if (ctx != CTX_OTHER && memchr(key, '\\', keyLen) != NULL)
+            c->escaped = 1;
+
+        childCtx = CTX_OTHER;
+        number = NULL;
+        mask = NULL;
+        bit = 0;
+        switch (ctx)
+        {
+        case CTX_ROOT:
+            if (_keyIs(key, keyLen, "data"))
+                childCtx = CTX_DATA;
+            else if (_keyIs(key, keyLen, "timestamp"))
+                number = &c->vio->timestamp;
+            break;
+        case CTX_DATA:
+            if (_keyIs(key, keyLen, "position"))
+                childCtx = CTX_POSITION;
+            else if (_keyIs(key, keyLen, "rotation"))
+                childCtx = CTX_ROTATION;
+            break;
+        case CTX_POSITION:
+            mask = &c->vio->hasPosition;
+            if (_keyIs(key, keyLen, "x"))
+            {
+                number = &c->vio->px;
+                bit = 0x1;
+            }
+            else if (_keyIs(key, keyLen, "y"))
+            {
+                number = &c->vio->py;
+                bit = 0x2;
+            }
+            else if (_keyIs(key, keyLen, "z"))
+            {
+                number = &c->vio->pz;
+                bit = 0x4;
+            }
+            break;
+        case CTX_ROTATION:
+            mask = &c->vio->hasRotation;
+            if (_keyIs(key, keyLen, "x"))
+            {
+                number = &c->vio->rx;
+                bit = 0x1;
+            }
+            else if (_keyIs(key, keyLen, "y"))
+            {
+                number = &c->vio->ry;
+                bit = 0x2;
+            }
+            else if (_keyIs(key, keyLen, "z"))
+            {
+                number = &c->vio->rz;
+                bit = 0x4;
+            }
+            else if (_keyIs(key, keyLen, "w"))
+            {
+                number = &c->vio->rw;
+                bit = 0x8;
+            }
+            break;
+        default:
+            break;
+        }
+
+        _skipWs(c);
+        if (bit && (c->p == c->end || (*c->p != '-' && (*c->p < '0' || *c->p > '9'))))
+        {
+            // Not a number, treat the field as missing
+            number = NULL;
+            bit = 0;
+        }
+        status = _parseValue(c, depth, childCtx, number);
+        if (status != ML_JSON_OK)
+            return status;
+        if (bit)
+            *mask |= bit;
+
+        _skipWs(c);
+        if (c->p == c->end)
+            return ML_JSON_MALFORMED;
+        if (*c->p == ',')
+        {
+            ++c->p;
+            continue;
+        }
+        if (*c->p == '}')
+        {
+            ++c->p;
+            return ML_JSON_OK;
+        }
+        return ML_JSON_MALFORMED;
+    }
+}
+
+static int8_t _parseArray(_cursor_t* c, int depth)
+{
+    int8_t status;
+
+    if (depth > MAX_DEPTH)
+        return ML_JSON_MALFORMED;
+    ++c->p; // '['
+    _skipWs(c);
+    if (c->p != c->end && *c->p == ']')
+    {
+        ++c->p;
+        return ML_JSON_OK;
+    }
+
+    for (;;)
+    {
+        status = _parseValue(c, depth, CTX_OTHER, NULL);
+        if (status != ML_JSON_OK)
+            return status;
+        _skipWs(c);
+        if (c->p == c->end)
+            return ML_JSON_MALFORMED;
+        if (*c->p == ',')
+        {
+            ++c->p;
+            continue;
+        }
+        if (*c->p == ']')
+        {
+            ++c->p;
+            return ML_JSON_OK;
+        }
+        return ML_JSON_MALFORMED;
+    }
+}
+
+static int8_t _parseString(_cursor_t* c, const char** str, size_t* len)
+{
+    const char* start;
+
+    if (c->p == c->end || *c->p != '"')
+        return ML_JSON_MALFORMED;
+    start = ++c->p;
+    while (c->p != c->end && *c->p != '"')
+    {
+        if ((unsigned char)*c->p < 0x20)
+            return ML_JSON_MALFORMED;
+        if (*c->p == '\\' && ++c->p == c->end)
+            return ML_JSON_MALFORMED;
+        ++c->p;
+    }
+    if (c->p == c->end)
+        return ML_JSON_MALFORMED;
+    *str = start;
+    *len = (size_t)(c->p - start);
+    ++c->p; // '"'
+    return ML_JSON_OK;
+}
+
+static int8_t _parseNumber(_cursor_t* c, double* number)
+{
+    char numBuf[NUM_BUF_LEN];
+    char* numEnd;
+    size_t len;
+
+    len = 0;
+    while (c->p + len != c->end && len < NUM_BUF_LEN - 1 && strchr("+-0123456789.eE", c->p[len]) != NULL && c->p[len] != '\0')
+    {
+        numBuf[len] = c->p[len];
+        ++len;
+    }
+    if (len == 0 || len == NUM_BUF_LEN - 1)
+        return ML_JSON_MALFORMED;
+    numBuf[len] = '\0';
+
+    *number = strtod(numBuf, &numEnd);
+    if (numEnd != numBuf + len)
+        return ML_JSON_MALFORMED;
+    c->p += len;
+    return ML_JSON_OK;
+}
+
+static int8_t _parseLiteral(_cursor_t* c, const char* literal)
+{
+    size_t len;
+
+    len = strlen(literal);
+    if ((size_t)(c->end - c->p) < len || memcmp(c->p, literal, len) != 0)
+        return ML_JSON_MALFORMED;
+    c->p += len;
+    return ML_JSON_OK;
+}
+
+// "YYYY-MM-DDTHH:MM:SS[.fff]Z", UTC only
+static uint8_t _parseIsoTime(const char* str, size_t len, double* t)
+{
+    int field[6], i, j, width;
+    long y, m, era, yoe, doy, doe, days;
+    double frac, scale;
+    const char seps[] = "--T::";
+
+    if (len < 19)
+        return 0;
+    for (i = 0, j = 0; i < 6; ++i)
+    {
+        width = (i == 0) ? 4 : 2;
+        field[i] = 0;
+        for (; width > 0; --width, ++j)
+        {
+            if (str[j] < '0' || str[j] > '9')
+                return 0;
+            field[i] = field[i] * 10 + (str[j] - '0');
+        }
+        if (i < 5 && str[j++] != seps[i])
+            return 0;
+    }
+    frac = 0.0;
+    if (j < (int)len && str[j] == '.')
+    {
+        for (++j, scale = 0.1; j < (int)len && str[j] >= '0' && str[j] <= '9'; ++j, scale *= 0.1)
+            frac += (str[j] - '0') * scale;
+    }
+    if (j != (int)len - 1 || str[j] != 'Z')
+        return 0;
+
+    // Days from civil, H. Hinnant
+    y = field[0];
+    m = field[1];
+    y -= m <= 2;
+    era = (y >= 0 ? y : y - 399) / 400;
+    yoe = y - era * 400;
+    doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + field[2] - 1;
+    doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    days = era * 146097 + doe - 719468;
+
+    *t = (double)days * 86400.0 + field[3] * 3600.0 + field[4] * 60.0 + field[5] + frac;
+    return 1;
+}
+
+static void _skipWs(_cursor_t* c)
+{
+    while (c->p != c->end && (*c->p == ' ' || *c->p == '\t' || *c->p == '\n' || *c->p == '\r'))
+        ++c->p;
+}
+
+static uint8_t _keyIs(const char* key, size_t len, const char* name)
+{
+    return strlen(name) == len && memcmp(key, name, len) == 0;
+}
@@ -0,0 +1,41 @@
+//
+//  mlJson.h
+//
+//  Created by slam3d contributors on 10/19/26.
+//  Copyright © 2026 CMU. All rights reserved.
+//
+//  Single-pass, allocation-free extraction of the few fields mqttlocalize
+//  needs from an ARENA object message, straight from the payload bytes
+//  (no NUL terminator required)
+//
+
+#ifndef _MLJSON_H
+#define _MLJSON_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define ML_JSON_OK          (0)
+#define ML_JSON_MISSING     (-1)    // valid JSON, but data.position.{x,y,z} not found
+#define ML_JSON_MALFORMED   (-2)
+#define ML_JSON_ESCAPED     (-3)    // not found, but a key on the way was escaped
+
+typedef struct
+{
+    double px;
+    double py;
+    double pz;
+    double rx;
+    double ry;
+    double rz;
+    double rw;
+    double timestamp;       // seconds since the epoch
+    uint8_t hasPosition;    // bit per axis: x = 1, y = 2, z = 4
+    uint8_t hasRotation;    // bit per component: x = 1, y = 2, z = 4, w = 8
+    uint8_t hasTimestamp;
+
+} mlVio_t;
+
+int8_t mlJson_parseVio(const char* buf, size_t len, mlVio_t* vio);
+
+#endif
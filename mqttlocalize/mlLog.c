@@ -0,0 +1,349 @@
+//
+//  mlLog.c
+//
+//  Created by slam3d contributors on 10/19/26.
+//  Copyright © 2026 CMU. All rights reserved.
+//
+//  Events are only formatted on the drainer thread, so the cost on the
+//  MQTT callback and filter workers is a level check and a ~100 byte copy
+//
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "mlLog.h"
+#include "mlQueue.h"
+
+#define ML_LOG_RING_LEN     (2048)  // events per thread, must be a power of two
+#define ML_LOG_MAX_THREADS  (80)
+#define ML_LOG_DRAIN_ms     (10)
+
+typedef struct
+{
+    double t;
+    float v[4];
+    int32_t n[2];
+    uint8_t type;
+    char str[ML_LOG_STR_LEN];
+
+} _event_t;
+
+// Single producer (the owning thread), single consumer (the drainer)
+typedef struct
+{
+    _event_t events[ML_LOG_RING_LEN];
+    _Alignas(ML_CACHE_LINE) atomic_size_t head;
+    _Alignas(ML_CACHE_LINE) atomic_size_t tail;
+
+} _ring_t;
+
+static const uint8_t _typeLevel[ML_LOG_NUM_TYPES] =
+{
+    ML_LOG_DEBUG,   // ML_LOG_VIO
+    ML_LOG_DEBUG,   // ML_LOG_UWB
+    ML_LOG_INFO,    // ML_LOG_PUBLISH
+    ML_LOG_DEBUG,   // ML_LOG_IGNORED
+    ML_LOG_ERROR,   // ML_LOG_BAD_VIO
+    ML_LOG_ERROR,   // ML_LOG_BAD_UWB
+    ML_LOG_ERROR,   // ML_LOG_BAD_ID
+    ML_LOG_ERROR,   // ML_LOG_QUEUE_FULL
+    ML_LOG_ERROR,   // ML_LOG_NO_MEMORY
+    ML_LOG_INFO,    // ML_LOG_TAG_NEW
+    ML_LOG_INFO,    // ML_LOG_TAG_EVICT
+    ML_LOG_DEBUG,   // ML_LOG_LATE
+    ML_LOG_INFO,    // ML_LOG_CHECKPOINT
+    ML_LOG_ERROR,   // ML_LOG_CHECKPOINT_FAILED
+    ML_LOG_INFO,    // ML_LOG_RESTORED
+    ML_LOG_INFO,    // ML_LOG_BUDGET
+    ML_LOG_INFO,    // ML_LOG_SHED
+};
+
+static _ring_t* _Atomic _rings[ML_LOG_MAX_THREADS];
+static atomic_int _numRings;
+static atomic_uint_fast64_t _dropped;
+static _Thread_local _ring_t* _ring;
+static _Thread_local uint8_t _ringFailed;
+static int _level = ML_LOG_INFO;
+static FILE* _out;
+static pthread_mutex_t _drainLock = PTHREAD_MUTEX_INITIALIZER;
+
+static _event_t* _claim(mlLogType_t type);
+static void _commit(void);
+static _ring_t* _register(void);
+static void* _drainer(void* arg);
+static void _drain(void);
+static void _format(const _event_t* e);
+
+// path NULL logs to stdout. Must be called before the first event
+uint8_t mlLog_start(const char* path, mlLogLevel_t level)
+{
+    pthread_t drainer;
+
+    _out = path != NULL ? fopen(path, "a") : stdout;
+    if (_out == NULL)
+        return 0;
+    _level = level;
+    if (pthread_create(&drainer, NULL, _drainer, NULL) != 0)
+        return 0;
+    pthread_detach(drainer);
+    return 1;
+}
+
+void mlLog_vio(const char* tag, double t, float x, float y, float z)
+{
+    _event_t* e;
+
+    if ((e = _claim(ML_LOG_VIO)) == NULL)
+        return;
+    snprintf(e->str, ML_LOG_STR_LEN, "%s", tag);
+    e->t = t;
+    e->v[0] = x;
+    e->v[1] = y;
+    e->v[2] = z;
+    _commit();
+}
+
+void mlLog_uwb(const char* tag, double t, int bcn, float range)
+{
+    _event_t* e;
+
+    if ((e = _claim(ML_LOG_UWB)) == NULL)
+        return;
+    snprintf(e->str, ML_LOG_STR_LEN, "%s", tag);
+    e->t = t;
+    e->n[0] = bcn;
+    e->v[0] = range;
+    _commit();
+}
+
+void mlLog_publish(const char* topic, double t, float x, float y, float z, float theta)
+{
+    _event_t* e;
+
+    if ((e = _claim(ML_LOG_PUBLISH)) == NULL)
+        return;
+    snprintf(e->str, ML_LOG_STR_LEN, "%s", topic);
+    e->t = t;
+    e->v[0] = x;
+    e->v[1] = y;
+    e->v[2] = z;
+    e->v[3] = theta;
+    _commit();
+}
+
+// A worker's tags now run on numParticles particles, with pending ranges
+// behind the update and depth records still in its queue
+void mlLog_budget(int worker, int numParticles, size_t pending, size_t depth)
+{
+    _event_t* e;
+
+    if ((e = _claim(ML_LOG_BUDGET)) == NULL)
+        return;
+    e->n[0] = worker;
+    e->n[1] = numParticles;
+    e->v[0] = (float)pending;
+    e->v[1] = (float)depth;
+    e->str[0] = '\0';
+    _commit();
+}
+
+// Ranges a worker folded into others or dropped as stale since its last
+// report
+void mlLog_shed(int worker, uint64_t numCoalesced, uint64_t numStale)
+{
+    _event_t* e;
+
+    if ((e = _claim(ML_LOG_SHED)) == NULL)
+        return;
+    e->n[0] = worker;
+    e->v[0] = (float)numCoalesced;
+    e->v[1] = (float)numStale;
+    e->str[0] = '\0';
+    _commit();
+}
+
+void mlLog_event(mlLogType_t type, const char* str, int32_t n0, int32_t n1)
+{
+    _event_t* e;
+
+    if ((e = _claim(type)) == NULL)
+        return;
+    snprintf(e->str, ML_LOG_STR_LEN, "%s", str != NULL ? str : "");
+    e->n[0] = n0;
+    e->n[1] = n1;
+    _commit();
+}
+
+// Writes out everything recorded so far, from the calling thread
+void mlLog_flush(void)
+{
+    if (_out == NULL)
+        return;
+    pthread_mutex_lock(&_drainLock);
+    _drain();
+    pthread_mutex_unlock(&_drainLock);
+}
+
+// Returns the calling thread's next free slot, or NULL if the event is
+// filtered out or has to be dropped
+static _event_t* _claim(mlLogType_t type)
+{
+    _event_t* e;
+    size_t head;
+
+    if (_typeLevel[type] > _level || _out == NULL)
+        return NULL;
+    if (_ring == NULL && (_ringFailed || (_ring = _register()) == NULL))
+    {
+        atomic_fetch_add_explicit(&_dropped, 1, memory_order_relaxed);
+        return NULL;
+    }
+    head = atomic_load_explicit(&_ring->head, memory_order_relaxed);
+    if (head - atomic_load_explicit(&_ring->tail, memory_order_acquire) >= ML_LOG_RING_LEN)
+    {
+        atomic_fetch_add_explicit(&_dropped, 1, memory_order_relaxed);
+        return NULL;
+    }
+    e = &_ring->events[head & (ML_LOG_RING_LEN - 1)];
+    memset(e, 0, offsetof(_event_t, str));
+    e->type = (uint8_t)type;
+    return e;
+}
+
+static void _commit(void)
+{
+    atomic_store_explicit(&_ring->head, atomic_load_explicit(&_ring->head, memory_order_relaxed) + 1, memory_order_release);
+}
+
+static _ring_t* _register(void)
+{
+    _ring_t* ring;
+    int idx;
+
+    ring = (_ring_t*)aligned_alloc(ML_CACHE_LINE, sizeof(_ring_t));
+    idx = ring != NULL ? atomic_fetch_add(&_numRings, 1) : ML_LOG_MAX_THREADS;
+    if (idx >= ML_LOG_MAX_THREADS)
+    {
+        free(ring);
+        _ringFailed = 1;
+        return NULL;
+    }
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    atomic_store_explicit(&_rings[idx], ring, memory_order_release);
+    return ring;
+}
+
+static void* _drainer(void* arg)
+{
+    struct timespec pause;
+
+    (void)arg;
+    pause.tv_sec = 0;
+    pause.tv_nsec = ML_LOG_DRAIN_ms * 1000000L;
+    for (;;)
+    {
+        pthread_mutex_lock(&_drainLock);
+        _drain();
+        pthread_mutex_unlock(&_drainLock);
+        nanosleep(&pause, NULL);
+    }
+    return NULL;
+}
+
+static void _drain(void)
+{
+    static uint64_t reportedDropped = 0;
+    _ring_t* ring;
+    size_t tail, head;
+    uint64_t dropped;
+    int i, numRings;
+
+    numRings = atomic_load(&_numRings);
+    numRings = numRings < ML_LOG_MAX_THREADS ? numRings : ML_LOG_MAX_THREADS;
+    for (i = 0; i < numRings; ++i)
+    {
+        ring = atomic_load_explicit(&_rings[i], memory_order_acquire);
+        if (ring == NULL)
+            continue;
+        tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+        head = atomic_load_explicit(&ring->head, memory_order_acquire);
+        for (; tail != head; ++tail)
+            _format(&ring->events[tail & (ML_LOG_RING_LEN - 1)]);
+        atomic_store_explicit(&ring->tail, tail, memory_order_release);
+    }
+
+    dropped = atomic_load_explicit(&_dropped, memory_order_relaxed);
+    if (dropped != reportedDropped)
+    {
+        fprintf(_out, "Log rings full, dropped %llu events\n", (unsigned long long)(dropped - reportedDropped));
+        reportedDropped = dropped;
+    }
+    fflush(_out);
+}
+
+static void _format(const _event_t* e)
+{
+    switch (e->type)
+    {
+    case ML_LOG_VIO:
+        fprintf(_out, "VIO  :%lf,%f,%f,%f [%s]\n", e->t, e->v[0], e->v[1], e->v[2], e->str);
+        break;
+    case ML_LOG_UWB:
+        fprintf(_out, "UWB  :%lf,%d,%f [%s]\n", e->t, e->n[0], e->v[0], e->str);
+        break;
+    case ML_LOG_PUBLISH:
+        fprintf(_out, "UPDT : [%s] %lf,%f,%f,%f,%f\n", e->str, e->t, e->v[0], e->v[1], e->v[2], e->v[3]);
+        break;
+    case ML_LOG_IGNORED:
+        fprintf(_out, "#topic: %s ignored\n", e->str);
+        break;
+    case ML_LOG_BAD_VIO:
+        fprintf(_out, "Error parsing VIO JSON: Could not get coordinates [%s]\n", e->str);
+        break;
+    case ML_LOG_BAD_UWB:
+        fprintf(_out, "UWB  : malformed payload, dropped [%s]\n", e->str);
+        break;
+    case ML_LOG_BAD_ID:
+        fprintf(_out, "#topic: %s bad client ID, dropped\n", e->str);
+        break;
+    case ML_LOG_QUEUE_FULL:
+        fprintf(_out, "Measurement queue full, dropped %s [%s]\n", e->n[0] == ML_MEAS_VIO ? "VIO" : "UWB", e->str);
+        break;
+    case ML_LOG_NO_MEMORY:
+        fprintf(_out, "Failed to allocate a filter for tag '%s'\n", e->str);
+        break;
+    case ML_LOG_TAG_NEW:
+        fprintf(_out, "New tag '%s' on worker %d (%d tags)\n", e->str, e->n[0], e->n[1]);
+        break;
+    case ML_LOG_TAG_EVICT:
+        fprintf(_out, "Evicted %d idle tags on worker %d\n", e->n[1], e->n[0]);
+        break;
+    case ML_LOG_LATE:
+        fprintf(_out, "Late %s, %d ms behind [%s]\n", e->n[0] == ML_MEAS_VIO ? "VIO" : "UWB", e->n[1], e->str);
+        break;
+    case ML_LOG_CHECKPOINT:
+        fprintf(_out, "Checkpointed %d tags on worker %d\n", e->n[1], e->n[0]);
+        break;
+    case ML_LOG_CHECKPOINT_FAILED:
+        fprintf(_out, "Failed to checkpoint tag '%s'\n", e->str);
+        break;
+    case ML_LOG_RESTORED:
+        fprintf(_out, "Restored tag '%s' from a %d ms old checkpoint\n", e->str, e->n[0]);
+        break;
+    case ML_LOG_BUDGET:
+        fprintf(_out, "Worker %d runs tags on %d particles, %.0f ranges pending, queue depth %.0f\n", e->n[0], e->n[1], e->v[0], e->v[1]);
+        break;
+    case ML_LOG_SHED:
+        fprintf(_out, "Worker %d shed %.0f coalesced and %.0f stale ranges\n", e->n[0], e->v[0], e->v[1]);
+        break;
+    default:
+        break;
+    }
+}
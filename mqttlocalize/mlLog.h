@@ -0,0 +1,61 @@
+//
+//  mlLog.h
+//
+//  Created by slam3d contributors on 10/19/26.
+//  Copyright © 2026 CMU. All rights reserved.
+//
+//  Hot-path logging. Each thread records fixed-size binary events into its
+//  own single-producer ring; a background thread formats and writes them.
+//  Recording never blocks: when a ring is full the event is counted and
+//  dropped
+//
+
+#ifndef _MLLOG_H
+#define _MLLOG_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define ML_LOG_STR_LEN      (64)
+
+typedef enum
+{
+    ML_LOG_ERROR = 0,
+    ML_LOG_INFO,
+    ML_LOG_DEBUG,
+
+} mlLogLevel_t;
+
+typedef enum
+{
+    ML_LOG_VIO = 0,
+    ML_LOG_UWB,
+    ML_LOG_PUBLISH,
+    ML_LOG_IGNORED,         // str: topic
+    ML_LOG_BAD_VIO,         // str: tag
+    ML_LOG_BAD_UWB,         // str: tag
+    ML_LOG_BAD_ID,          // str: topic
+    ML_LOG_QUEUE_FULL,      // str: tag, n0: measurement type
+    ML_LOG_NO_MEMORY,       // str: tag
+    ML_LOG_TAG_NEW,         // str: tag, n0: worker, n1: tags on the worker
+    ML_LOG_TAG_EVICT,       // n0: worker, n1: tags evicted
+    ML_LOG_LATE,            // str: tag, n0: measurement type, n1: ms behind
+    ML_LOG_CHECKPOINT,      // n0: worker, n1: tags saved
+    ML_LOG_CHECKPOINT_FAILED,   // str: tag
+    ML_LOG_RESTORED,        // str: tag, n0: snapshot age in ms
+    ML_LOG_BUDGET,          // see mlLog_budget()
+    ML_LOG_SHED,            // see mlLog_shed()
+    ML_LOG_NUM_TYPES,
+
+} mlLogType_t;
+
+uint8_t mlLog_start(const char* path, mlLogLevel_t level);
+void mlLog_vio(const char* tag, double t, float x, float y, float z);
+void mlLog_uwb(const char* tag, double t, int bcn, float range);
+void mlLog_publish(const char* topic, double t, float x, float y, float z, float theta);
+void mlLog_budget(int worker, int numParticles, size_t pending, size_t depth);
+void mlLog_shed(int worker, uint64_t numCoalesced, uint64_t numStale);
+void mlLog_event(mlLogType_t type, const char* str, int32_t n0, int32_t n1);
+void mlLog_flush(void);
+
+#endif
@@ -0,0 +1,327 @@
+//
+//  mlMetrics.c
+//
+//  Created by slam3d contributors on 10/19/26.
+//  Copyright © 2026 CMU. All rights reserved.
+//
+//  One scrape at a time, on the server thread. The hot path only ever
+//  touches its own counters and buckets; all the formatting, and summing
+//  the workers' histograms, is done here
+//
+
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "mlMetrics.h"
+
+#define ML_METRICS_REQ_LEN  (4096)
+#define ML_METRICS_TIMEOUT_s (1)    // for a client to send its request
+#define ML_METRICS_MIN_LEN  (65536)
+
+static const char* const _countName[ML_COUNT_NUM] =
+{
+    "vio_messages_total",
+    "uwb_messages_total",
+    "updates_total",
+    "late_total",
+    "publishes_total",
+    "resamples_total",
+    "spawns_total",
+};
+
+static const char* const _countHelp[ML_COUNT_NUM] =
+{
+    "VIO messages taken by a worker",
+    "UWB messages taken by a worker",
+    "Ranges applied to the filter",
+    "Measurements that arrived after a newer one was applied",
+    "Rig transforms published",
+    "Resamples triggered, with -DPF_ENABLE_STATS=1",
+    "Particle spawn events, with -DPF_ENABLE_STATS=1",
+};
+
+static int _fd = -1;
+static mlMetricsRender_t _render;
+static mlMetricsOut_t _out;
+
+static int _listen(const char* addr);
+static void* _server(void* arg);
+static void _serve(int fd);
+static void _send(int fd, const char* buf, size_t len);
+static uint64_t _bucketMax(int i);
+
+// addr is a TCP port, served on the loopback interface only, or the path
+// of a Unix socket. render is called on the server thread for each scrape
+uint8_t mlMetrics_start(const char* addr, mlMetricsRender_t render)
+{
+    pthread_t server;
+
+    _render = render;
+    if ((_fd = _listen(addr)) < 0)
+        return 0;
+    if (pthread_create(&server, NULL, _server, NULL) != 0)
+    {
+        close(_fd);
+        return 0;
+    }
+    pthread_detach(server);
+    return 1;
+}
+
+// Without the prefix, which tells the per-tag series from the totals
+const char* mlMetrics_countName(mlCount_t count)
+{
+    return _countName[count];
+}
+
+const char* mlMetrics_countHelp(mlCount_t count)
+{
+    return _countHelp[count];
+}
+
+void mlHist_init(mlHist_t* h)
+{
+    int i;
+
+    for (i = 0; i < ML_HIST_BUCKETS; ++i)
+        atomic_init(&h->buckets[i], 0);
+    atomic_init(&h->sumUs, 0);
+}
+
+// s >= 0. Only the histogram's owner may record into it
+void mlHist_record(mlHist_t* h, double s)
+{
+    uint64_t us;
+    int e, i;
+
+    us = s < 4294967295e-6 ? (uint64_t)(s * 1e6 + 0.5) : 4294967295u;
+    if (us < (1u << ML_HIST_SUB_BITS))
+        i = (int)us;
+    else
+    {
+        e = 63 - __builtin_clzll(us);
+        i = ((e - ML_HIST_SUB_BITS + 1) << ML_HIST_SUB_BITS) + (int)((us >> (e - ML_HIST_SUB_BITS)) & ((1u << ML_HIST_SUB_BITS) - 1));
+    }
+    ML_COUNT(h->buckets[i], 1);
+    ML_COUNT(h->sumUs, us);
+}
+
+// Adds h into buckets and sumUs, for summing the histograms of all workers
+void mlHist_merge(const mlHist_t* h, uint64_t* buckets, uint64_t* sumUs)
+{
+    int i;
+
+    for (i = 0; i < ML_HIST_BUCKETS; ++i)
+        buckets[i] += ML_COUNTED(h->buckets[i]);
+    *sumUs += ML_COUNTED(h->sumUs);
+}
+
+void mlMetrics_printf(mlMetricsOut_t* out, const char* format, ...)
+{
+    va_list args;
+    size_t cap;
+    char* buf;
+    int n;
+
+    if (out->failed)
+        return;
+    va_start(args, format);
+    n = vsnprintf(out->buf + out->len, out->cap - out->len, format, args);
+    va_end(args);
+    if (n < 0)
+    {
+        out->failed = 1;
+        return;
+    }
+    if (out->len + (size_t)n >= out->cap)
+    {
+        cap = out->cap > 0 ? 2 * out->cap : ML_METRICS_MIN_LEN;
+        while (cap <= out->len + (size_t)n)
+            cap *= 2;
+        if ((buf = (char*)realloc(out->buf, cap)) == NULL)
+        {
+            out->failed = 1;
+            return;
+        }
+        out->buf = buf;
+        out->cap = cap;
+        va_start(args, format);
+        vsnprintf(out->buf + out->len, out->cap - out->len, format, args);
+        va_end(args);
+    }
+    out->len += (size_t)n;
+}
+
+// Starts a family; all its samples must follow before the next one
+void mlMetrics_family(mlMetricsOut_t* out, const char* name, const char* type, const char* help)
+{
+    mlMetrics_printf(out, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+// A label value, escaped, without the quotes
+void mlMetrics_label(mlMetricsOut_t* out, const char* value)
+{
+    for (; *value != '\0'; ++value)
+    {
+        if (*value == '\\' || *value == '"')
+            mlMetrics_printf(out, "\\%c", *value);
+        else if (*value == '\n')
+            mlMetrics_printf(out, "\\n");
+        else
+            mlMetrics_printf(out, "%c", *value);
+    }
+}
+
+// Cumulative buckets up to the highest one in use, in s. The bucket
+// boundaries are fixed, so a series once exported is always exported again
+void mlMetrics_hist(mlMetricsOut_t* out, const char* name, const uint64_t* buckets, uint64_t sumUs)
+{
+    uint64_t count;
+    int i, last;
+
+    for (last = ML_HIST_BUCKETS - 1; last > 0 && buckets[last] == 0; --last)
+        ;
+    count = 0;
+    for (i = 0; i <= last; ++i)
+    {
+        count += buckets[i];
+        mlMetrics_printf(out, "%s_bucket{le=\"%.9g\"} %llu\n", name, _bucketMax(i) / 1e6, (unsigned long long)count);
+    }
+    for (; i < ML_HIST_BUCKETS; ++i)
+        count += buckets[i];
+    mlMetrics_printf(out, "%s_bucket{le=\"+Inf\"} %llu\n", name, (unsigned long long)count);
+    mlMetrics_printf(out, "%s_sum %.6f\n", name, sumUs / 1e6);
+    mlMetrics_printf(out, "%s_count %llu\n", name, (unsigned long long)count);
+}
+
+static int _listen(const char* addr)
+{
+    struct sockaddr_un un;
+    struct sockaddr_in in;
+    int fd, one;
+
+    if (strchr(addr, '/') != NULL)
+    {
+        if (strlen(addr) >= sizeof(un.sun_path) || (fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+            return -1;
+        memset(&un, 0, sizeof(un));
+        un.sun_family = AF_UNIX;
+        strcpy(un.sun_path, addr);
+        unlink(addr);
+        if (bind(fd, (struct sockaddr*)&un, sizeof(un)) != 0 || listen(fd, 8) != 0)
+        {
+            close(fd);
+            return -1;
+        }
+        return fd;
+    }
+
+    if (atoi(addr) <= 0 || atoi(addr) > 65535 || (fd = socket(AF_INET, SOCK_STREAM, 0)) < 0)
+        return -1;
+    one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    memset(&in, 0, sizeof(in));
+    in.sin_family = AF_INET;
+    in.sin_port = htons((uint16_t)atoi(addr));
+    in.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(fd, (struct sockaddr*)&in, sizeof(in)) != 0 || listen(fd, 8) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static void* _server(void* arg)
+{
+    struct timeval timeout;
+    int fd;
+
+    (void)arg;
+    timeout.tv_sec = ML_METRICS_TIMEOUT_s;
+    timeout.tv_usec = 0;
+    for (;;)
+    {
+        if ((fd = accept(_fd, NULL, NULL)) < 0)
+            continue;
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        _serve(fd);
+        close(fd);
+    }
+    return NULL;
+}
+
+// HTTP/1.0, one request per connection: GET /metrics or GET /
+static void _serve(int fd)
+{
+    char req[ML_METRICS_REQ_LEN], head[256];
+    size_t len;
+    ssize_t n;
+    int headLen;
+
+    len = 0;
+    while (len < sizeof(req) - 1 && (n = recv(fd, req + len, sizeof(req) - 1 - len, 0)) > 0)
+    {
+        len += (size_t)n;
+        req[len] = '\0';
+        if (strstr(req, "\r\n\r\n") != NULL || strstr(req, "\n\n") != NULL)
+            break;
+    }
+    req[len] = '\0';
+    if (strncmp(req, "GET /metrics ", 13) != 0 && strncmp(req, "GET / ", 6) != 0)
+    {
+        headLen = snprintf(head, sizeof(head), "HTTP/1.0 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+        _send(fd, head, (size_t)headLen);
+        return;
+    }
+
+    _out.len = 0;
+    _out.failed = 0;
+    _render(&_out);
+    if (_out.failed)
+    {
+        headLen = snprintf(head, sizeof(head), "HTTP/1.0 500 Internal Server Error\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+        _send(fd, head, (size_t)headLen);
+        return;
+    }
+    headLen = snprintf(head, sizeof(head), "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: %zu\r\nConnection: close\r\n\r\n", _out.len);
+    _send(fd, head, (size_t)headLen);
+    _send(fd, _out.buf, _out.len);
+}
+
+// A client that went away must not raise SIGPIPE
+static void _send(int fd, const char* buf, size_t len)
+{
+    ssize_t n;
+
+    while (len > 0 && (n = send(fd, buf, len, MSG_NOSIGNAL)) > 0)
+    {
+        buf += n;
+        len -= (size_t)n;
+    }
+}
+
+// The largest us value in bucket i
+static uint64_t _bucketMax(int i)
+{
+    int shift, sub;
+
+    if (i < (1 << ML_HIST_SUB_BITS))
+        return (uint64_t)i;
+    shift = (i >> ML_HIST_SUB_BITS) - 1;
+    sub = i & ((1 << ML_HIST_SUB_BITS) - 1);
+    return ((uint64_t)((1 << ML_HIST_SUB_BITS) + sub + 1) << shift) - 1;
+}
@@ -0,0 +1,75 @@
+//
+//  mlMetrics.h
+//
+//  Created by slam3d contributors on 10/19/26.
+//  Copyright © 2026 CMU. All rights reserved.
+//
+//  Prometheus metrics. Counters and histograms are written by the one
+//  thread that owns them, without locked instructions, and read by a
+//  server thread that renders the text format for each scrape over HTTP
+//  on a loopback port or a Unix socket
+//
+
+#ifndef _MLMETRICS_H
+#define _MLMETRICS_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define ML_HIST_SUB_BITS    (3)     // 8 buckets per power of two, so within 12.5%
+#define ML_HIST_BUCKETS     ((32 - ML_HIST_SUB_BITS + 1) << ML_HIST_SUB_BITS)  // us, up to 71 min
+
+typedef atomic_uint_fast64_t mlCounter_t;
+
+// For counters with a single writer: a relaxed load and store, which the
+// reader sees whole but which costs no more than a plain increment
+#define ML_COUNT(c, n)      atomic_store_explicit(&(c), atomic_load_explicit(&(c), memory_order_relaxed) + (n), memory_order_relaxed)
+#define ML_COUNTED(c)       ((uint64_t)atomic_load_explicit(&(c), memory_order_relaxed))
+
+// Counted per tag, and per worker for every tag it has had
+typedef enum
+{
+    ML_COUNT_VIO = 0,
+    ML_COUNT_UWB,
+    ML_COUNT_UPDATES,       // ranges applied to the filter
+    ML_COUNT_LATE,
+    ML_COUNT_PUBLISHES,
+    ML_COUNT_RESAMPLES,     // these two need -DPF_ENABLE_STATS=1
+    ML_COUNT_SPAWNS,
+    ML_COUNT_NUM,
+
+} mlCount_t;
+
+// HDR-style: exact below 2^ML_HIST_SUB_BITS us, then ML_HIST_SUB_BITS
+// significant bits
+typedef struct
+{
+    mlCounter_t buckets[ML_HIST_BUCKETS];
+    mlCounter_t sumUs;
+
+} mlHist_t;
+
+typedef struct
+{
+    char* buf;
+    size_t len;
+    size_t cap;
+    uint8_t failed;
+
+} mlMetricsOut_t;
+
+typedef void (*mlMetricsRender_t)(mlMetricsOut_t* out);
+
+uint8_t mlMetrics_start(const char* addr, mlMetricsRender_t render);
+const char* mlMetrics_countName(mlCount_t count);
+const char* mlMetrics_countHelp(mlCount_t count);
+void mlHist_init(mlHist_t* h);
+void mlHist_record(mlHist_t* h, double s);
+void mlHist_merge(const mlHist_t* h, uint64_t* buckets, uint64_t* sumUs);
+void mlMetrics_printf(mlMetricsOut_t* out, const char* format, ...);
+void mlMetrics_family(mlMetricsOut_t* out, const char* name, const char* type, const char* help);
+void mlMetrics_label(mlMetricsOut_t* out, const char* value);
+void mlMetrics_hist(mlMetricsOut_t* out, const char* name, const uint64_t* buckets, uint64_t sumUs);
+
+#endif
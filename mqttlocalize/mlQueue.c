@@ -0,0 +1,129 @@
+//
+//  mlQueue.c
+//
+//  Created by slam3d contributors on 10/19/26.
+//  Copyright © 2026 CMU. All rights reserved.
+//
+//  Bounded MPMC ring after D. Vyukov, used here with a single consumer.
+//  Every cell carries a sequence number: seq == pos means the cell is free
+//  for the producer claiming pos, seq == pos + 1 means it holds pos
+//
+
+#include <stdint.h>
+#include <string.h>
+
+#include "mlQueue.h"
+
+#define ML_QUEUE_MASK       (ML_QUEUE_LEN - 1)
+
+static uint8_t _isEmpty(mlQueue_t* q);
+
+void mlQueue_init(mlQueue_t* q)
+{
+    size_t i;
+    pthread_condattr_t condAttr;
+
+    for (i = 0; i < ML_QUEUE_LEN; ++i)
+        atomic_init(&q->cells[i].seq, i);
+    atomic_init(&q->head, 0);
+    atomic_init(&q->tail, 0);
+    atomic_init(&q->sleeping, 0);
+    atomic_init(&q->dropped, 0);
+    pthread_mutex_init(&q->lock, NULL);
+    pthread_condattr_init(&condAttr);
+    pthread_condattr_setclock(&condAttr, CLOCK_MONOTONIC);
+    pthread_cond_init(&q->cond, &condAttr);
+    pthread_condattr_destroy(&condAttr);
+}
+
+uint8_t mlQueue_push(mlQueue_t* q, const mlMeas_t* meas)
+{
+    mlQueueCell_t* cell;
+    size_t pos, seq;
+    intptr_t diff;
+
+    pos = atomic_load_explicit(&q->head, memory_order_relaxed);
+    for (;;)
+    {
+        cell = &q->cells[pos & ML_QUEUE_MASK];
+        seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+        diff = (intptr_t)seq - (intptr_t)pos;
+        if (diff == 0)
+        {
+            if (atomic_compare_exchange_weak_explicit(&q->head, &pos, pos + 1, memory_order_relaxed, memory_order_relaxed))
+                break;
+        }
+        else if (diff < 0)
+        {
+            // Full, the worker is behind: drop rather than block the MQTT client
+            atomic_fetch_add_explicit(&q->dropped, 1, memory_order_relaxed);
+            return 0;
+        }
+        else
+        {
+            pos = atomic_load_explicit(&q->head, memory_order_relaxed);
+        }
+    }
+    memcpy(&cell->meas, meas, sizeof(mlMeas_t));
+    atomic_store_explicit(&cell->seq, pos + 1, memory_order_release);
+
+    // Pairs with the fence in mlQueue_wait(): either the consumer sees the
+    // new cell or we see it sleeping. Only then is the mutex touched
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&q->sleeping, memory_order_relaxed))
+    {
+        pthread_mutex_lock(&q->lock);
+        pthread_cond_signal(&q->cond);
+        pthread_mutex_unlock(&q->lock);
+    }
+    return 1;
+}
+
+uint8_t mlQueue_pop(mlQueue_t* q, mlMeas_t* meas)
+{
+    mlQueueCell_t* cell;
+    size_t pos, seq;
+
+    pos = atomic_load_explicit(&q->tail, memory_order_relaxed);
+    cell = &q->cells[pos & ML_QUEUE_MASK];
+    seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+    if ((intptr_t)seq - (intptr_t)(pos + 1) < 0)
+        return 0;
+    memcpy(meas, &cell->meas, sizeof(mlMeas_t));
+    atomic_store_explicit(&q->tail, pos + 1, memory_order_relaxed);
+    atomic_store_explicit(&cell->seq, pos + ML_QUEUE_LEN, memory_order_release);
+    return 1;
+}
+
+void mlQueue_wait(mlQueue_t* q, const struct timespec* deadline)
+{
+    pthread_mutex_lock(&q->lock);
+    atomic_store_explicit(&q->sleeping, 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    if (_isEmpty(q))
+    {
+        if (deadline != NULL)
+            pthread_cond_timedwait(&q->cond, &q->lock, deadline);
+        else
+            pthread_cond_wait(&q->cond, &q->lock);
+    }
+    atomic_store_explicit(&q->sleeping, 0, memory_order_relaxed);
+    pthread_mutex_unlock(&q->lock);
+}
+
+size_t mlQueue_depth(mlQueue_t* q)
+{
+    size_t head, tail;
+
+    tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+    head = atomic_load_explicit(&q->head, memory_order_relaxed);
+    return head > tail ? head - tail : 0;
+}
+
+static uint8_t _isEmpty(mlQueue_t* q)
+{
+    size_t pos;
+
+    pos = atomic_load_explicit(&q->tail, memory_order_relaxed);
+    return atomic_load_explicit(&q->cells[pos & ML_QUEUE_MASK].seq, memory_order_acquire) != pos + 1;
+}
@@ -0,0 +1,75 @@
+//
+//  mlQueue.h
+//
+//  Created by slam3d contributors on 10/19/26.
+//  Copyright © 2026 CMU. All rights reserved.
+//
+//  Bounded lock-free MPSC ring of fixed-size measurement records. MQTT
+//  callbacks only parse and push; each filter worker drains its own ring
+//
+
+#ifndef _MLQUEUE_H
+#define _MLQUEUE_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "mlTag.h"
+
+#define ML_QUEUE_LEN        (1024)  // must be a power of two
+#define ML_CACHE_LINE       (64)
+
+typedef enum
+{
+    ML_MEAS_VIO = 0,
+    ML_MEAS_UWB,
+    ML_MEAS_STOP,           // shutdown request for the worker, carries no data
+
+} mlMeasType_t;
+
+typedef struct
+{
+    uint8_t type;
+    uint8_t bcn;
+    uint8_t slot;       // holds the tag's coalescing slot for bcn, see mlCoalesce.h
+    uint32_t tagHash;
+    char tag[ML_TAG_ID_LEN];
+    double t;           // arrival time
+    double tClient;     // client timestamp, 0 if the message had none
+    double tArrival;    // t before _stampMeas() in mqttlocalize.c puts it on the client's clock
+    float x;
+    float y;
+    float z;
+    float range;
+
+} mlMeas_t;
+
+typedef struct
+{
+    atomic_size_t seq;
+    mlMeas_t meas;
+
+} mlQueueCell_t;
+
+typedef struct
+{
+    mlQueueCell_t cells[ML_QUEUE_LEN];
+    _Alignas(ML_CACHE_LINE) atomic_size_t head;
+    _Alignas(ML_CACHE_LINE) atomic_size_t tail;
+    _Alignas(ML_CACHE_LINE) atomic_int sleeping;
+    atomic_uint_fast64_t dropped;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+
+} mlQueue_t;
+
+void mlQueue_init(mlQueue_t* q);
+uint8_t mlQueue_push(mlQueue_t* q, const mlMeas_t* meas);
+uint8_t mlQueue_pop(mlQueue_t* q, mlMeas_t* meas);
+void mlQueue_wait(mlQueue_t* q, const struct timespec* deadline);
+size_t mlQueue_depth(mlQueue_t* q);
+
+#endif
@@ -0,0 +1,135 @@
+//
+//  mlRecord.c
+//
+//  Created by slam3d contributors on 10/19/26.
+//  Copyright © 2026 CMU. All rights reserved.
+//
+//  Written only on the MQTT callback thread, through stdio's buffer, so
+//  recording costs the service a copy per message and a write per 64 KB
+//
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "mlRecord.h"
+
+#define ML_RECORD_BUF_LEN   (65536)
+
+static mlRecordClock_t* _Atomic _clock;
+
+// Truncates path. Returns 0 if it cannot be written
+uint8_t mlRecord_create(mlRecord_t* rec, const char* path)
+{
+    rec->count = 0;
+    rec->failed = 0;
+    if ((rec->file = fopen(path, "wb")) == NULL)
+        return 0;
+    setvbuf(rec->file, NULL, _IOFBF, ML_RECORD_BUF_LEN);
+    if (fwrite(ML_RECORD_MAGIC, ML_RECORD_MAGIC_LEN, 1, rec->file) != 1)
+    {
+        fclose(rec->file);
+        return 0;
+    }
+    return 1;
+}
+
+// For reading. Returns 0 if path cannot be read or is not a log
+uint8_t mlRecord_open(mlRecord_t* rec, const char* path)
+{
+    char magic[ML_RECORD_MAGIC_LEN];
+
+    rec->count = 0;
+    rec->failed = 0;
+    if ((rec->file = fopen(path, "rb")) == NULL)
+        return 0;
+    if (fread(magic, ML_RECORD_MAGIC_LEN, 1, rec->file) != 1 || memcmp(magic, ML_RECORD_MAGIC, ML_RECORD_MAGIC_LEN) != 0)
+    {
+        fclose(rec->file);
+        return 0;
+    }
+    return 1;
+}
+
+// Nothing more is written after a failure, so the log stays readable up
+// to the last whole message
+void mlRecord_write(mlRecord_t* rec, double t, const char* topic, const void* payload, uint32_t payloadLen)
+{
+    mlRecordHead_t head;
+
+    if (rec->failed)
+        return;
+    head.t = t;
+    head.topicLen = (uint32_t)strlen(topic);
+    head.payloadLen = payloadLen;
+    if (fwrite(&head, sizeof(head), 1, rec->file) != 1
+        || fwrite(topic, 1, head.topicLen, rec->file) != head.topicLen
+        || fwrite(payload, 1, payloadLen, rec->file) != payloadLen)
+    {
+        rec->failed = 1;
+        return;
+    }
+    ++rec->count;
+}
+
+// The next message, with topic NUL-terminated. topic and payload are
+// malloc()ed and belong to the caller. Returns 0 at the end of the log,
+// including a message cut short
+uint8_t mlRecord_read(mlRecord_t* rec, double* t, char** topic, void** payload, uint32_t* payloadLen)
+{
+    mlRecordHead_t head;
+
+    if (fread(&head, sizeof(head), 1, rec->file) != 1 || head.topicLen > ML_RECORD_MAX_LEN || head.payloadLen > ML_RECORD_MAX_LEN)
+        return 0;
+    *topic = (char*)malloc(head.topicLen + 1);
+    *payload = malloc(head.payloadLen > 0 ? head.payloadLen : 1);
+    if (*topic == NULL || *payload == NULL
+        || fread(*topic, 1, head.topicLen, rec->file) != head.topicLen
+        || fread(*payload, 1, head.payloadLen, rec->file) != head.payloadLen)
+    {
+        free(*topic);
+        free(*payload);
+        return 0;
+    }
+    (*topic)[head.topicLen] = '\0';
+    *t = head.t;
+    *payloadLen = head.payloadLen;
+    ++rec->count;
+    return 1;
+}
+
+// Returns 0 if any message failed to be written
+uint8_t mlRecord_close(mlRecord_t* rec)
+{
+    if (fclose(rec->file) != 0)
+        rec->failed = 1;
+    return !rec->failed;
+}
+
+// Set by a replay before it hands over the first message, so that messages
+// are stamped with the arrival times they were recorded with
+void mlRecord_setClock(mlRecordClock_t* clock)
+{
+    atomic_store(&_clock, clock);
+}
+
+uint8_t mlRecord_replaying(void)
+{
+    return atomic_load_explicit(&_clock, memory_order_relaxed) != NULL;
+}
+
+// Wall clock s, unless replaying
+double mlRecord_now(void)
+{
+    mlRecordClock_t* clock;
+    struct timeval tv;
+
+    clock = atomic_load_explicit(&_clock, memory_order_relaxed);
+    if (clock != NULL)
+        return clock();
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
@@ -0,0 +1,51 @@
+//
+//  mlRecord.h
+//
+//  Created by slam3d contributors on 10/19/26.
+//  Copyright © 2026 CMU. All rights reserved.
+//
+//  Binary log of inbound MQTT messages, for replaying a session offline
+//  through mlReplay.c. After an 8 byte magic, each message is a 16 byte
+//  header (arrival time as wall clock s, topic length, payload length) in
+//  the recording machine's byte order, then the topic and payload bytes
+//
+
+#ifndef _MLRECORD_H
+#define _MLRECORD_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#define ML_RECORD_MAGIC     "mlrec\0\0\1"
+#define ML_RECORD_MAGIC_LEN (8)
+#define ML_RECORD_MAX_LEN   (1u << 24)  // topic or payload, larger is taken as corruption
+
+typedef struct
+{
+    double t;
+    uint32_t topicLen;
+    uint32_t payloadLen;
+
+} mlRecordHead_t;
+
+typedef struct
+{
+    FILE* file;
+    uint64_t count;
+    uint8_t failed;     // a write failed, the log ends before it
+
+} mlRecord_t;
+
+// Returns the arrival time to stamp the message being handed over with
+typedef double mlRecordClock_t(void);
+
+uint8_t mlRecord_create(mlRecord_t* rec, const char* path);
+uint8_t mlRecord_open(mlRecord_t* rec, const char* path);
+void mlRecord_write(mlRecord_t* rec, double t, const char* topic, const void* payload, uint32_t payloadLen);
+uint8_t mlRecord_read(mlRecord_t* rec, double* t, char** topic, void** payload, uint32_t* payloadLen);
+uint8_t mlRecord_close(mlRecord_t* rec);
+void mlRecord_setClock(mlRecordClock_t* clock);
+uint8_t mlRecord_replaying(void);
+double mlRecord_now(void);
+
+#endif
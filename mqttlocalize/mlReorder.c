@@ -0,0 +1,94 @@
+//
+//  mlReorder.c
+//
+//  Created by slam3d contributors on 10/19/26.
+//  Copyright © 2026 CMU. All rights reserved.
+//
+
+#include <stdint.h>
+#include <string.h>
+
+#include "mlReorder.h"
+
+static uint8_t _before(const mlReorderEntry_t* a, const mlReorderEntry_t* b);
+static void _swap(mlReorderEntry_t* a, mlReorderEntry_t* b);
+
+void mlReorder_init(mlReorder_t* r)
+{
+    r->count = 0;
+    r->seq = 0;
+}
+
+// Returns 0 when full, the caller releases the earliest record first
+uint8_t mlReorder_push(mlReorder_t* r, const mlMeas_t* meas, mlTag_t* tag)
+{
+    size_t i, parent;
+
+    if (r->count == ML_REORDER_LEN)
+        return 0;
+    i = r->count++;
+    memcpy(&r->entries[i].meas, meas, sizeof(mlMeas_t));
+    r->entries[i].tag = tag;
+    r->entries[i].seq = r->seq++;
+    while (i > 0)
+    {
+        parent = (i - 1) / 2;
+        if (!_before(&r->entries[i], &r->entries[parent]))
+            break;
+        _swap(&r->entries[i], &r->entries[parent]);
+        i = parent;
+    }
+    return 1;
+}
+
+uint8_t mlReorder_peek(const mlReorder_t* r, double* t)
+{
+    if (r->count == 0)
+        return 0;
+    *t = r->entries[0].meas.t;
+    return 1;
+}
+
+uint8_t mlReorder_pop(mlReorder_t* r, mlMeas_t* meas, mlTag_t** tag)
+{
+    size_t i, child;
+
+    if (r->count == 0)
+        return 0;
+    memcpy(meas, &r->entries[0].meas, sizeof(mlMeas_t));
+    *tag = r->entries[0].tag;
+    if (--r->count == 0)
+        return 1;
+    memcpy(&r->entries[0], &r->entries[r->count], sizeof(mlReorderEntry_t));
+
+    i = 0;
+    for (;;)
+    {
+        child = 2 * i + 1;
+        if (child >= r->count)
+            break;
+        if (child + 1 < r->count && _before(&r->entries[child + 1], &r->entries[child]))
+            ++child;
+        if (!_before(&r->entries[child], &r->entries[i]))
+            break;
+        _swap(&r->entries[i], &r->entries[child]);
+        i = child;
+    }
+    return 1;
+}
+
+static uint8_t _before(const mlReorderEntry_t* a, const mlReorderEntry_t* b)
+{
+    if (a->meas.t != b->meas.t)
+        return a->meas.t < b->meas.t;
+    return a->seq < b->seq;
+}
+
+static void _swap(mlReorderEntry_t* a, mlReorderEntry_t* b)
+{
+    mlReorderEntry_t tmp;
+
+    memcpy(&tmp, a, sizeof(mlReorderEntry_t));
+    memcpy(a, b, sizeof(mlReorderEntry_t));
+    memcpy(b, &tmp, sizeof(mlReorderEntry_t));
+}
@@ -0,0 +1,52 @@
+//
+//  mlReorder.h
+//
+//  Created by slam3d contributors on 10/19/26.
+//  Copyright © 2026 CMU. All rights reserved.
+//
+//  Min-heap of measurements ordered by timestamp. A filter worker holds
+//  records here for a bounded time so VIO and UWB that crossed on the
+//  network are fused in the order they were taken
+//
+
+#ifndef _MLREORDER_H
+#define _MLREORDER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "mlQueue.h"
+#include "mlTag.h"
+
+#define ML_REORDER_LEN      (1024)
+
+typedef enum
+{
+    ML_LATE_DROP = 0,       // drop anything older than what was already applied
+    ML_LATE_RANGES,         // apply late ranges, drop late VIO (a newer pose supersedes it)
+    ML_LATE_ALL,            // apply everything, late VIO is stamped with the last applied time
+
+} mlLatePolicy_t;
+
+typedef struct
+{
+    mlMeas_t meas;
+    mlTag_t* tag;
+    uint64_t seq;           // keeps records with equal timestamps in arrival order
+
+} mlReorderEntry_t;
+
+typedef struct
+{
+    mlReorderEntry_t entries[ML_REORDER_LEN];
+    size_t count;
+    uint64_t seq;
+
+} mlReorder_t;
+
+void mlReorder_init(mlReorder_t* r);
+uint8_t mlReorder_push(mlReorder_t* r, const mlMeas_t* meas, mlTag_t* tag);
+uint8_t mlReorder_peek(const mlReorder_t* r, double* t);
+uint8_t mlReorder_pop(mlReorder_t* r, mlMeas_t* meas, mlTag_t** tag);
+
+#endif
@@ -0,0 +1,196 @@
+//
+//  mlReplay.c
+//
+//  Created by slam3d contributors on 10/19/26.
+//  Copyright © 2026 CMU. All rights reserved.
+//
+//  Stand-in for the Paho MQTT client, linked into mqttreplay instead of
+//  paho-mqtt3c. Connecting starts a thread that reads the log named by
+//  MQTTLOCALIZE_REPLAY (see mlRecord.h) and hands every message to the
+//  arrival callback, as Paho's receive thread would, paced as recorded
+//  times MQTTLOCALIZE_REPLAY_SPEED (1 by default, 0 for as fast as
+//  possible). Each message arrives stamped with its recorded arrival time,
+//  not the wall clock, so that at speed 0 and with MQTTLOCALIZE_SEED set
+//  a replay is repeatable. Subscriptions are not checked: the log only
+//  holds what the recording session subscribed to. Publishes are counted
+//  and dropped.
+//  At the end of the log the process gets SIGINT, so the service shuts
+//  down as it would on Ctrl+C, and the totals are printed at destroy
+//
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "MQTTClient.h"
+#include "mlRecord.h"
+
+static void* _replay(void* arg);
+static double _recordedNow(void);
+static double _timespecDiff(const struct timespec* a, const struct timespec* b);
+
+static mlRecord_t _log;
+static double _speed = 1.0;
+static MQTTClient_messageArrived* _arrived;
+static void* _context;
+static pthread_t _thread;
+static uint8_t _running;
+static atomic_int _stop;
+static atomic_uint_fast64_t _numPublished;
+static struct timespec _start, _fed;
+static double _arrivalT;    // of the message being handed over, only read on the replay thread
+
+int MQTTClient_create(MQTTClient* handle, const char* serverURI, const char* clientId, int persistence_type, void* persistence_context)
+{
+    *handle = (MQTTClient)&_log;
+    return MQTTCLIENT_SUCCESS;
+}
+
+int MQTTClient_setCallbacks(MQTTClient handle, void* context, MQTTClient_connectionLost* cl, MQTTClient_messageArrived* ma, MQTTClient_deliveryComplete* dc)
+{
+    _context = context;
+    _arrived = ma;
+    return MQTTCLIENT_SUCCESS;
+}
+
+int MQTTClient_connect(MQTTClient handle, MQTTClient_connectOptions* options)
+{
+    const char* path;
+
+    path = getenv("MQTTLOCALIZE_REPLAY");
+    if (path == NULL || !mlRecord_open(&_log, path))
+    {
+        printf("Set MQTTLOCALIZE_REPLAY to a log recorded with MQTTLOCALIZE_RECORD\n");
+        return MQTTCLIENT_FAILURE;
+    }
+    if (getenv("MQTTLOCALIZE_REPLAY_SPEED") != NULL)
+        _speed = atof(getenv("MQTTLOCALIZE_REPLAY_SPEED"));
+    atomic_init(&_stop, 0);
+    atomic_init(&_numPublished, 0);
+    clock_gettime(CLOCK_MONOTONIC, &_start);
+    _fed = _start;
+    mlRecord_setClock(_recordedNow);
+    if (pthread_create(&_thread, NULL, _replay, NULL) != 0)
+    {
+        mlRecord_close(&_log);
+        return MQTTCLIENT_FAILURE;
+    }
+    _running = 1;
+    printf("Replaying %s at %s\n", path, _speed > 0.0 ? "recorded pace" : "full speed");
+    return MQTTCLIENT_SUCCESS;
+}
+
+int MQTTClient_subscribe(MQTTClient handle, const char* topic, int qos)
+{
+    return MQTTCLIENT_SUCCESS;
+}
+
+int MQTTClient_publishMessage(MQTTClient handle, const char* topicName, MQTTClient_message* msg, MQTTClient_deliveryToken* dt)
+{
+    atomic_fetch_add_explicit(&_numPublished, 1, memory_order_relaxed);
+    if (dt != NULL)
+        *dt = 0;
+    return MQTTCLIENT_SUCCESS;
+}
+
+// Stops the replay if it is still running; nothing arrives after
+int MQTTClient_disconnect(MQTTClient handle, int timeout)
+{
+    if (!_running)
+        return MQTTCLIENT_SUCCESS;
+    atomic_store(&_stop, 1);
+    pthread_join(_thread, NULL);
+    mlRecord_close(&_log);
+    _running = 0;
+    return MQTTCLIENT_SUCCESS;
+}
+
+// By now the workers have applied everything, so this is end to end
+void MQTTClient_destroy(MQTTClient* handle)
+{
+    struct timespec now;
+    double fed, done;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    fed = _timespecDiff(&_fed, &_start);
+    done = _timespecDiff(&now, &_start);
+    printf("Replayed %llu messages in %.3f s (%.0f/s), all applied in %.3f s (%.0f/s), %llu published\n",
+        (unsigned long long)_log.count, fed, fed > 0.0 ? _log.count / fed : 0.0, done, done > 0.0 ? _log.count / done : 0.0,
+        (unsigned long long)atomic_load(&_numPublished));
+    *handle = NULL;
+}
+
+void MQTTClient_freeMessage(MQTTClient_message** msg)
+{
+    free((*msg)->payload);
+    free(*msg);
+    *msg = NULL;
+}
+
+void MQTTClient_free(void* ptr)
+{
+    free(ptr);
+}
+
+static void* _replay(void* arg)
+{
+    const MQTTClient_message init = MQTTClient_message_initializer;
+    MQTTClient_message* msg;
+    struct timespec due;
+    double t, t0, offset;
+    char* topic;
+    void* payload;
+    uint32_t payloadLen;
+
+    t0 = 0.0;
+    while (!atomic_load(&_stop) && mlRecord_read(&_log, &t, &topic, &payload, &payloadLen))
+    {
+        if (_log.count == 1)
+            t0 = t;
+        if (_speed > 0.0)
+        {
+            offset = (t - t0) / _speed;
+            due = _start;
+            due.tv_sec += (time_t)offset;
+            due.tv_nsec += (long)((offset - (time_t)offset) * 1e9);
+            if (due.tv_nsec >= 1000000000L)
+            {
+                due.tv_nsec -= 1000000000L;
+                ++due.tv_sec;
+            }
+            while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &due, NULL) != 0 && !atomic_load(&_stop))
+                ;
+        }
+        if ((msg = (MQTTClient_message*)malloc(sizeof(MQTTClient_message))) == NULL)
+        {
+            free(topic);
+            free(payload);
+            break;
+        }
+        *msg = init;
+        msg->payload = payload;
+        msg->payloadlen = (int)payloadLen;
+        _arrivalT = t;
+        _arrived(_context, topic, (int)strlen(topic), msg);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &_fed);
+    if (!atomic_load(&_stop))
+        kill(getpid(), SIGINT);
+    return NULL;
+}
+
+static double _recordedNow(void)
+{
+    return _arrivalT;
+}
+
+static double _timespecDiff(const struct timespec* a, const struct timespec* b)
+{
+    return (double)(a->tv_sec - b->tv_sec) + (a->tv_nsec - b->tv_nsec) / 1e9;
+}
@@ -0,0 +1,198 @@
+//
+//  mlTag.c
+//
+//  Created by slam3d contributors on 10/19/26.
+//  Copyright © 2026 CMU. All rights reserved.
+//
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "mlTag.h"
+
+static double _timespecDiff(const struct timespec* a, const struct timespec* b);
+
+// FNV-1a with the MurmurHash3 finalizer, also used to pick the worker a tag
+// is sharded onto. Without the finalizer IDs differing only in their last
+// character ("tag1", "tag2", ...) share their high bits
+uint32_t mlTag_hash(const char* id)
+{
+    uint32_t h;
+
+    h = 2166136261u;
+    for (; *id != '\0'; ++id)
+    {
+        h ^= (uint8_t)*id;
+        h *= 16777619u;
+    }
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35u;
+    h ^= h >> 16;
+    return h;
+}
+
+// MQTT topic filter match. The topic level under the first '+' (or the
+// remainder under '#') is copied to id as the client ID; a filter without
+// wildcards matches one topic and yields the empty ID
+uint8_t mlTag_matchTopic(const char* filter, const char* topic, char* id, size_t idLen)
+{
+    const char* level;
+    size_t len;
+    uint8_t captured;
+
+    captured = 0;
+    id[0] = '\0';
+    for (;;)
+    {
+        if (filter[0] == '#' && filter[1] == '\0')
+        {
+            len = strlen(topic);
+            break;
+        }
+        level = topic;
+        while (*topic != '\0' && *topic != '/')
+            ++topic;
+        if (filter[0] == '+' && (filter[1] == '/' || filter[1] == '\0'))
+        {
+            if (!captured)
+            {
+                len = (size_t)(topic - level);
+                if (len >= idLen)
+                    return 0;
+                memcpy(id, level, len);
+                id[len] = '\0';
+                captured = 1;
+            }
+            ++filter;
+        }
+        else
+        {
+            for (; level != topic; ++level, ++filter)
+                if (*filter != *level)
+                    return 0;
+            if (*filter != '\0' && *filter != '/')
+                return 0;
+        }
+
+        if (*filter == '\0' || *topic == '\0')
+            return *filter == '\0' && *topic == '\0';
+        ++filter;
+        ++topic;
+    }
+
+    // '#'
+    if (!captured)
+    {
+        if (len >= idLen)
+            return 0;
+        memcpy(id, topic, len + 1);
+    }
+    return 1;
+}
+
+// Substitutes the first "%s" in pattern with id; the pattern is never used
+// as a printf format since it comes from the command line
+void mlTag_format(char* out, size_t outLen, const char* pattern, const char* id)
+{
+    const char* sub;
+    size_t n;
+
+    sub = strstr(pattern, "%s");
+    if (sub == NULL)
+    {
+        snprintf(out, outLen, "%s", pattern);
+        return;
+    }
+    n = (size_t)(sub - pattern);
+    snprintf(out, outLen, "%.*s%s%s", (int)n, pattern, id, sub + 2);
+}
+
+void mlTagTable_init(mlTagTable_t* table)
+{
+    memset(table->buckets, 0, sizeof(table->buckets));
+    table->count = 0;
+    pfArena_init(&table->arena, PF_ARENA_HUGE_TRANSPARENT);
+}
+
+mlTag_t* mlTagTable_find(mlTagTable_t* table, const char* id, uint32_t hash)
+{
+    mlTag_t* tag;
+
+    for (tag = table->buckets[hash & (ML_TAG_BUCKETS - 1)]; tag != NULL; tag = tag->next)
+        if (tag->hash == hash && strcmp(tag->id, id) == 0)
+            return tag;
+    return NULL;
+}
+
+mlTag_t* mlTagTable_add(mlTagTable_t* table, const char* id, uint32_t hash)
+{
+    mlTag_t* tag;
+    mlTag_t** bucket;
+    int i;
+
+    tag = (mlTag_t*)pfArena_alloc(&table->arena, sizeof(mlTag_t));
+    if (tag == NULL)
+        return NULL;
+    snprintf(tag->id, ML_TAG_ID_LEN, "%s", id);
+    tag->hash = hash;
+    tag->clockOffset = 0.0;
+    tag->clockT = 0.0;
+    tag->lastT = 0.0;
+    tag->dirty = 0;
+    tag->unsaved = 0;
+    tag->next = NULL;
+    tag->nextDirty = NULL;
+    memset(&tag->lastSeen, 0, sizeof(tag->lastSeen));
+    memset(&tag->lastPublish, 0, sizeof(tag->lastPublish));
+    for (i = 0; i < ML_TAG_MAX_BCNS; ++i)
+        tag->ranges[i].count = 0;
+    for (i = 0; i < ML_COUNT_NUM; ++i)
+        atomic_init(&tag->counts[i], 0);
+    tag->dirtySince = 0.0;
+    particleFilterLoc_init(&tag->pf);
+
+    bucket = &table->buckets[hash & (ML_TAG_BUCKETS - 1)];
+    tag->next = *bucket;
+    *bucket = tag;
+    ++table->count;
+    return tag;
+}
+
+// Frees tags not seen for idleS seconds. Tags with an unpublished estimate
+// are kept until the owning worker has published them
+size_t mlTagTable_evict(mlTagTable_t* table, const struct timespec* now, double idleS)
+{
+    size_t i, numEvicted;
+    mlTag_t* tag;
+    mlTag_t** link;
+
+    numEvicted = 0;
+    for (i = 0; i < ML_TAG_BUCKETS; ++i)
+    {
+        link = &table->buckets[i];
+        while ((tag = *link) != NULL)
+        {
+            if (!tag->dirty && _timespecDiff(now, &tag->lastSeen) > idleS)
+            {
+                *link = tag->next;
+                pfArena_free(&table->arena, tag, sizeof(mlTag_t));
+                ++numEvicted;
+            }
+            else
+            {
+                link = &tag->next;
+            }
+        }
+    }
+    table->count -= numEvicted;
+    return numEvicted;
+}
+
+static double _timespecDiff(const struct timespec* a, const struct timespec* b)
+{
+    return (double)(a->tv_sec - b->tv_sec) + (a->tv_nsec - b->tv_nsec) / 1e9;
+}
@@ -0,0 +1,70 @@
+//
+//  mlTag.h
+//
+//  Created by slam3d contributors on 10/19/26.
+//  Copyright © 2026 CMU. All rights reserved.
+//
+//  Per-client filter state for the multi-tag service. Each filter worker
+//  owns one mlTagTable_t; tags are created on the first measurement that
+//  names them and evicted once they have been idle for a while
+//
+
+#ifndef _MLTAG_H
+#define _MLTAG_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "particleFilter.h"
+#include "pfAlloc.h"
+
+#include "mlCoalesce.h"
+#include "mlMetrics.h"
+
+#define ML_TAG_ID_LEN       (64)
+#define ML_TAG_OUT_LEN      (256)
+#define ML_TAG_BUCKETS      (256)   // per worker, must be a power of two
+#define ML_TAG_MAX_BCNS     (16)
+
+typedef struct mlTag_s
+{
+    char id[ML_TAG_ID_LEN];
+    char rigTopic[ML_TAG_OUT_LEN];
+    char rigObjId[ML_TAG_OUT_LEN];
+    uint32_t hash;
+    particleFilterLoc_t pf;
+    double clockOffset;         // arrival minus client time, see _stampMeas() in mqttlocalize.c
+    double clockT;
+    double lastT;               // time of the latest measurement applied
+    struct timespec lastSeen;
+    struct timespec lastPublish;
+    mlCoalesceSlot_t ranges[ML_TAG_MAX_BCNS];
+    mlCounter_t counts[ML_COUNT_NUM];
+    double dirtySince;          // arrival of the first range in the unpublished estimate
+    uint8_t dirty;
+    uint8_t unsaved;            // changed since the last checkpoint
+    struct mlTag_s* next;       // hash chain
+    struct mlTag_s* nextDirty;  // owning worker's list of unpublished estimates
+
+} mlTag_t;
+
+// Tags are carved from the table's own arena: a worker's filters share
+// huge pages, and an evicted tag's memory goes to the next new one
+typedef struct
+{
+    mlTag_t* buckets[ML_TAG_BUCKETS];
+    size_t count;
+    pfArena_t arena;
+
+} mlTagTable_t;
+
+uint32_t mlTag_hash(const char* id);
+uint8_t mlTag_matchTopic(const char* filter, const char* topic, char* id, size_t idLen);
+void mlTag_format(char* out, size_t outLen, const char* pattern, const char* id);
+void mlTagTable_init(mlTagTable_t* table);
+mlTag_t* mlTagTable_find(mlTagTable_t* table, const char* id, uint32_t hash);
+mlTag_t* mlTagTable_add(mlTagTable_t* table, const char* id, uint32_t hash);
+size_t mlTagTable_evict(mlTagTable_t* table, const struct timespec* now, double idleS);
+
+#endif
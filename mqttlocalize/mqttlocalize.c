@@ -11,29 +11,59 @@
 //     _publishLoc() 
 //  have to transform to/from this coordinate system
 //
+//  Topics may carry MQTT wildcards: the level matched by '+' (or '#') is
+//  the client ID, and every client gets its own filter. "%s" in the rig
+//  topic and object ID is replaced with the client ID
+//
 
+#define _GNU_SOURCE     // pthread_setaffinity_np()
 #include <assert.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <signal.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <sys/time.h>
 #include <unistd.h>
 #include <time.h> 
 
 #include "particleFilter.h"
+#include "pfTrace.h"
 
 #include "MQTTClient.h"
 #include "cJSON.h"
 
+#include "mlBudget.h"
+#include "mlCoalesce.h"
+#include "mlJson.h"
+#include "mlLog.h"
+#include "mlMetrics.h"
+#include "mlQueue.h"
+#include "mlRecord.h"
+#include "mlReorder.h"
+#include "mlTag.h"
+
 #define DATA_DIR            "../sampledata/"
 #define TRACE_DIR           DATA_DIR "arena/"
 #define NUM_BCNS            (12)
 #define UWB_STD             (0.1f)
 #define UWB_BIAS            (0.2f)
 #define SKIP_TO_WAYPOINT    (1)
-#define UPDATE_INTERVAL_us  500000
+#define PUBLISH_RATE_Hz     (30.0)  // upper bound on rig updates, estimates are published on range epochs
+#define MAX_WORKERS         (64)
+#define TAG_IDLE_s          (60.0)  // filters of clients silent this long are freed
+#define EVICT_PERIOD_s      (5.0)
+#define REORDER_HOLD_ms     (30.0)  // how long records wait for earlier ones still in flight
+#define CLOCK_RELAX         (1e-3)  // s/s the client clock offset estimate may rise, to follow drift
+#define CHECKPOINT_PERIOD_s (10.0)
+#define CHECKPOINT_MAX_AGE_s (120.0) // older snapshots likely predate a restart of the client's VIO session
+#define COALESCE_BATCH      (256)   // records pulled off a backlog before any is applied, when coalescing
 
 #define DEPLOY_FILE         TRACE_DIR "deploy.csv"
 #define LINE_LEN            (1024)
@@ -46,36 +76,225 @@
 #define FRMT_TAG_LOC_MSG "%f,%f,%f,%f,%f,%f,%f"
 #define FRMT_TAG_LOC_JSON "{\"object_id\" : \"%s\",  \"action\": \"update\", \"type\": \"rig\", \"data\": {\"position\": {\"x\": %f, \"y\": %f, \"z\": %f}, \"rotation\": {\"x\": %f, \"y\": %f, \"z\": %f, \"w\": %f}}}"
 
+typedef struct
+{
+    mlQueue_t queue;
+    mlTagTable_t tags;
+    mlTag_t* dirty;     // tags with an estimate not yet published
+    mlReorder_t reorder;
+    mlBudget_t budget;
+    size_t heldRanges;          // in the reorder buffer
+    atomic_size_t queuedRanges; // pushed and not yet popped
+    mlCounter_t numCoalesced;
+    mlCounter_t numStale;
+    uint64_t reportedShed;      // numCoalesced + numStale at the last report
+    mlCounter_t counts[ML_COUNT_NUM];   // over every tag the worker has had
+    mlHist_t publishLatency;    // arrival of a range to the publish it went into
+    mlHist_t updateTime;        // of a range update
+    pthread_mutex_t tagsLock;   // taken to add or evict tags, and by scrapes walking them
+    uint8_t* checkpointBuf;
+    double now;                 // latest arrival popped, the clock a replay runs on
+    pthread_t thread;
+    int index;
+
+} _worker_t;
+
 static void _getDeployment(FILE* deployFile, float deployment[NUM_BCNS][3]);
 static void _publishLoc(MQTTClient client, char *topic, char *objid, double t, float x, float y, float z, float theta);
+static void* _filterWorker(void* arg);
+static void _pinWorker(int index);
+static void _runTimers(_worker_t* worker, struct timespec* nextEvict, struct timespec* nextCheckpoint);
+static double _workerNow(const _worker_t* worker);
+static void _workerTime(const _worker_t* worker, struct timespec* now);
+static mlTag_t* _getTag(_worker_t* worker, const mlMeas_t* meas);
+static void _stampMeas(mlTag_t* tag, mlMeas_t* meas);
+static uint8_t _releaseMeas(_worker_t* worker, uint8_t force);
+static uint8_t _reorderDeadline(_worker_t* worker, struct timespec* deadline);
+static void _applyMeas(_worker_t* worker, mlTag_t* tag, mlMeas_t* meas);
+static uint8_t _coalesceMeas(_worker_t* worker, mlTag_t* tag, mlMeas_t* meas);
+static void _budgetTag(_worker_t* worker, mlTag_t* tag, const struct timespec* now);
+static void _checkpointTags(_worker_t* worker);
+static uint8_t _saveTag(_worker_t* worker, mlTag_t* tag);
+static void _restoreTag(mlTag_t* tag, double now);
+static uint8_t _checkpointPath(char* path, size_t len, const char* id, const char* suffix);
+static void _stopWorkers(void);
+static uint8_t _publishRig(mlTag_t* tag);
+static uint8_t _publishDirty(_worker_t* worker, struct timespec* deadline);
+static void _pushMeas(mlMeas_t* meas);
+static mlLogLevel_t _logLevel(const char* name);
+static void _timespecAdd(struct timespec* ts, double s);
+static double _timespecDiff(const struct timespec* a, const struct timespec* b);
+static void _count(_worker_t* worker, mlTag_t* tag, mlCount_t count, uint64_t n);
+static void _renderMetrics(mlMetricsOut_t* out);
 
 void delivered(void *context, MQTTClient_deliveryToken dt);
 int msgarrvd(void *context, char *topicName, int topicLen, MQTTClient_message *message);
 void connlost(void *context, char *cause);
 
-static particleFilterLoc_t _particleFilter;
+// Each client is sharded onto one worker by the hash of its ID, so its
+// filter is only ever touched by that worker's thread; the MQTT callback
+// only parses messages into the worker queues
+static _worker_t* _workers;
+static int _numWorkers;
 static float deployment[NUM_BCNS][3];
+static double _publishInterval = 1.0 / PUBLISH_RATE_Hz;
+static double _reorderHold = REORDER_HOLD_ms / 1000.0;
+static mlLatePolicy_t _latePolicy = ML_LATE_RANGES;
+static const char* _checkpointDir;
+static double _updateBudget;
+static double _coalesceWindow;
+static mlCoalescePolicy_t _coalescePolicy = ML_COALESCE_MEDIAN;
+static double _staleAfter;
+static const char* _metricsAddr;
+static const char* _tracePath;
+static mlRecord_t _record;
+static uint8_t _recording;
+static uint8_t _waitOnFull;
+static mlCounter_t _numBadVio;     // counted on the MQTT callback thread
+static mlCounter_t _numBadUwb;
+static mlCounter_t _numBadId;
+static mlCounter_t _numIgnored;
+
+_Static_assert(NUM_BCNS <= ML_TAG_MAX_BCNS, "tags keep a coalescing slot per beacon");
 
 static char *topicName_VIO;
 static char *topicName_UWB;
+static char *topicName_RigOut;
+static char *cameraObjId;
 
 static MQTTClient client;
 
-static int8_t _getVio(char *_lineBuf, double* t, float* x, float* y, float* z);
+static int8_t _getVio(const char* payload, int payloadLen, double* t, double* tClient, float* x, float* y, float* z);
+static int8_t _getVioCJson(const char* payload, int payloadLen, mlVio_t* vio);
 
 int main(int argc, char* argv[])
 {
     FILE* deployFile;
-    double outT;
-    float outX, outY, outZ, outTheta, dx, dy, dz, c, s, rigX, rigY, rigZ;
     char clientid[LINE_LEN];
     MQTTClient_connectOptions conn_opts = MQTTClient_connectOptions_initializer;
-    int rc;
-    int ch=0;
-    char *topicName_RigOut;
-    char *cameraObjId;    
+    sigset_t signals;
+    int rc, i, k, sig;
+
+    if (argc <5)
+    {
+        printf("Usage: %s <Subscribe_VIO_Topic> <Subscribe_UWB_Topic> <Publish_Rig_Topic> <Rig_Obj_id> [Max_Publish_Hz] [Num_Workers] [Reorder_Hold_ms] [drop|ranges|all] [Checkpoint_Dir] [Update_Budget_ms] [Coalesce_ms] [median|freshest] [Stale_ms] [Metrics_Port|Metrics_Socket] [Trace_File]\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    if (argc > 5 && atof(argv[5]) > 0.0)
+        _publishInterval = 1.0 / atof(argv[5]);
+    _numWorkers = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (argc > 6 && atoi(argv[6]) > 0)
+        _numWorkers = atoi(argv[6]);
+    _numWorkers = _numWorkers < 1 ? 1 : (_numWorkers > MAX_WORKERS ? MAX_WORKERS : _numWorkers);
+    if (argc > 7 && atof(argv[7]) >= 0.0)
+        _reorderHold = atof(argv[7]) / 1000.0;
+    if (argc > 8)
+        _latePolicy = strcmp(argv[8], "drop") == 0 ? ML_LATE_DROP : (strcmp(argv[8], "all") == 0 ? ML_LATE_ALL : ML_LATE_RANGES);
+    if (argc > 9 && argv[9][0] != '\0' && strcmp(argv[9], "-") != 0)
+        _checkpointDir = argv[9];
+    if (argc > 10 && atof(argv[10]) > 0.0)
+        _updateBudget = atof(argv[10]) / 1000.0;
+    if (argc > 11 && atof(argv[11]) > 0.0)
+        _coalesceWindow = atof(argv[11]) / 1000.0;
+    if (argc > 12 && strcmp(argv[12], "freshest") == 0)
+        _coalescePolicy = ML_COALESCE_FRESHEST;
+    if (argc > 13 && atof(argv[13]) > 0.0)
+        _staleAfter = atof(argv[13]) / 1000.0;
+    if (argc > 14 && argv[14][0] != '\0' && strcmp(argv[14], "-") != 0)
+        _metricsAddr = argv[14];
+    if (argc > 15 && argv[15][0] != '\0' && strcmp(argv[15], "-") != 0)
+        _tracePath = argv[15];
 
-    if (argc <5) printf("Usage: %s <Subscribe_VIO_Topic> <Subscribe_UWB_Topic> <Publish_Rig_Topic> <Rig_Obj_id>\n", argv[0]);
+    // SIGINT and SIGTERM are taken by sigwait() below. Blocking them before
+    // any thread is created keeps them off the workers and the MQTT threads
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+
+    if (!mlLog_start(getenv("MQTTLOCALIZE_LOG_FILE"), _logLevel(getenv("MQTTLOCALIZE_LOG"))))
+    {
+        printf("Failed to start logging\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // MQTTLOCALIZE_RECORD=file keeps every inbound message for mqttreplay
+    if (getenv("MQTTLOCALIZE_RECORD") != NULL)
+    {
+        if (!mlRecord_create(&_record, getenv("MQTTLOCALIZE_RECORD")))
+        {
+            printf("Failed to record to %s\n", getenv("MQTTLOCALIZE_RECORD"));
+            exit(EXIT_FAILURE);
+        }
+        _recording = 1;
+        printf("Recording inbound messages to %s\n", getenv("MQTTLOCALIZE_RECORD"));
+    }
+
+    // MQTTLOCALIZE_SEED=n starts every filter from the same seed, so that
+    // two replays of a log (mlReplay.c) can be compared
+    if (getenv("MQTTLOCALIZE_SEED") != NULL)
+        particleFilterSeed_set((unsigned int)strtoul(getenv("MQTTLOCALIZE_SEED"), NULL, 10));
+
+    // A log replayed as fast as possible has no live input to
+    // keep up with, so a full queue holds the replay back instead of dropping
+    _waitOnFull = getenv("MQTTLOCALIZE_REPLAY") != NULL && getenv("MQTTLOCALIZE_REPLAY_SPEED") != NULL && atof(getenv("MQTTLOCALIZE_REPLAY_SPEED")) <= 0.0;
+
+    topicName_VIO = argv[1];
+    topicName_UWB = argv[2];
+    topicName_RigOut = argv[3];
+    cameraObjId = argv[4];
+
+    // The workers and queues must be ready before the first message can
+    // arrive; filters are created as clients show up
+    printf("Starting localization\n");
+    deployFile = fopen(DEPLOY_FILE, "r");
+    _getDeployment(deployFile, deployment);
+    fclose(deployFile);
+    _workers = (_worker_t*)aligned_alloc(ML_CACHE_LINE, _numWorkers * sizeof(_worker_t));
+    if (_workers == NULL)
+    {
+        printf("Failed to allocate %d filter workers\n", _numWorkers);
+        exit(EXIT_FAILURE);
+    }
+    for (i = 0; i < _numWorkers; ++i)
+    {
+        mlQueue_init(&_workers[i].queue);
+        mlTagTable_init(&_workers[i].tags);
+        _workers[i].dirty = NULL;
+        mlReorder_init(&_workers[i].reorder);
+        mlBudget_init(&_workers[i].budget, _updateBudget);
+        _workers[i].heldRanges = 0;
+        atomic_init(&_workers[i].queuedRanges, 0);
+        atomic_init(&_workers[i].numCoalesced, 0);
+        atomic_init(&_workers[i].numStale, 0);
+        _workers[i].reportedShed = 0;
+        for (k = 0; k < ML_COUNT_NUM; ++k)
+            atomic_init(&_workers[i].counts[k], 0);
+        mlHist_init(&_workers[i].publishLatency);
+        mlHist_init(&_workers[i].updateTime);
+        pthread_mutex_init(&_workers[i].tagsLock, NULL);
+        _workers[i].checkpointBuf = NULL;
+        if (_checkpointDir != NULL && (_workers[i].checkpointBuf = (uint8_t*)malloc(particleFilterLoc_checkpointSize())) == NULL)
+        {
+            printf("Failed to allocate checkpoint buffers\n");
+            exit(EXIT_FAILURE);
+        }
+        _workers[i].now = 0.0;
+        _workers[i].index = i;
+        pthread_create(&_workers[i].thread, NULL, _filterWorker, &_workers[i]);
+    }
+    printf("Initialized %d filter workers\n", _numWorkers);
+    if (_tracePath != NULL)
+        pfTrace_start(0);
+    if (_metricsAddr != NULL)
+    {
+        if (!mlMetrics_start(_metricsAddr, _renderMetrics))
+        {
+            printf("Failed to serve metrics on %s\n", _metricsAddr);
+            exit(EXIT_FAILURE);
+        }
+        printf("Serving metrics on %s\n", _metricsAddr);
+    }
 
     snprintf(clientid, LINE_LEN, "%s%ld", CLIENTID, time(NULL) % 1000);
     printf("Client ID:%s\n", clientid);
@@ -92,130 +311,824 @@ int main(int argc, char* argv[])
         exit(EXIT_FAILURE);
     }
 
-    topicName_VIO = argv[1];
-    topicName_UWB = argv[2];
-    topicName_RigOut = argv[3];
-    cameraObjId = argv[4];
-
     printf("\nSubscribing to topic %s\nfor client %s using QoS%d\n\n", topicName_VIO, clientid, QOS);
     MQTTClient_subscribe(client, argv[1], QOS);
     printf("Subscribing to topic %s\nfor client %s using QoS%d\n\n", topicName_UWB, clientid, QOS);    
     MQTTClient_subscribe(client, topicName_UWB, QOS);
 
-    printf("Starting localization\n");
-    particleFilterLoc_init(&_particleFilter);
-    deployFile = fopen(DEPLOY_FILE, "r");
-    _getDeployment(deployFile, deployment);
-    fclose(deployFile);
-    printf("Initialized\n");
-
     printf("'Ctrl+c' to quit.\n");
+    sigwait(&signals, &sig);
 
-    do
+    // No more input, then let every worker apply what it holds and write
+    // its final checkpoints
+    printf("\nShutting down\n");
+    MQTTClient_disconnect(client, 10000);
+    if (_recording)
+    {
+        if (mlRecord_close(&_record))
+            printf("Recorded %llu messages\n", (unsigned long long)_record.count);
+        else
+            printf("Failed to record after %llu messages\n", (unsigned long long)_record.count);
+    }
+    _stopWorkers();
+    if (_tracePath != NULL)
     {
-        if (particleFilterLoc_getTagLoc(&_particleFilter, &outT, &outX, &outY, &outZ, &outTheta))
+        pfTrace_stop();
+        if (pfTrace_dump(_tracePath))
+            printf("Wrote trace to %s\n", _tracePath);
+        else
+            printf("Failed to write trace to %s\n", _tracePath);
+    }
+    mlLog_flush();
+    MQTTClient_destroy(&client);
+    return rc;
+}
+
+static void _stopWorkers(void)
+{
+    mlMeas_t meas;
+    int i;
+
+    memset(&meas, 0, sizeof(meas));
+    meas.type = ML_MEAS_STOP;
+    for (i = 0; i < _numWorkers; ++i)
+        while (!mlQueue_push(&_workers[i].queue, &meas))
+            usleep(1000);
+    for (i = 0; i < _numWorkers; ++i)
+        pthread_join(_workers[i].thread, NULL);
+}
+
+static void* _filterWorker(void* arg)
+{
+    _worker_t* worker;
+    mlMeas_t meas;
+    mlTag_t* tag;
+    struct timespec nextEvict, nextCheckpoint, deadline, reorderDeadline;
+    char name[PF_TRACE_NAME_LEN];
+    uint8_t hasDeadline, replaying;
+
+    worker = (_worker_t*)arg;
+    _pinWorker(worker->index);
+    snprintf(name, sizeof(name), "worker %d", worker->index);
+    pfTrace_setThreadName(name);
+    clock_gettime(CLOCK_MONOTONIC, &nextEvict);
+    _timespecAdd(&nextEvict, EVICT_PERIOD_s);
+    nextCheckpoint = nextEvict;
+    _timespecAdd(&nextCheckpoint, CHECKPOINT_PERIOD_s - EVICT_PERIOD_s);
+    for (;;)
+    {
+        // Everything queued since the last wakeup goes through the reorder
+        // buffer as one batch. Range epochs arriving before a tag's rate
+        // limit expires are coalesced into a single publish; checking
+        // mid-batch keeps a sustained backlog from starving the output
+        while (mlQueue_pop(&worker->queue, &meas))
+        {
+            if (meas.type == ML_MEAS_STOP)
+            {
+                while (_releaseMeas(worker, 1))
+                    ;
+                if (_checkpointDir != NULL)
+                    _checkpointTags(worker);
+                return NULL;
+            }
+            replaying = mlRecord_replaying();
+            if (meas.t > worker->now)
+                worker->now = meas.t;
+            if (meas.type == ML_MEAS_UWB)
+                atomic_fetch_sub_explicit(&worker->queuedRanges, 1, memory_order_relaxed);
+            if ((tag = _getTag(worker, &meas)) == NULL)
+                continue;
+            _count(worker, tag, meas.type == ML_MEAS_VIO ? ML_COUNT_VIO : ML_COUNT_UWB, 1);
+            _stampMeas(tag, &meas);
+            if (meas.type == ML_MEAS_UWB && _coalesceWindow > 0.0 && _coalesceMeas(worker, tag, &meas))
+                continue;
+            while (!mlReorder_push(&worker->reorder, &meas, tag))
+                _releaseMeas(worker, 1);
+            worker->heldRanges += meas.type == ML_MEAS_UWB;
+
+            // Behind, keep pulling the backlog in so that the ranges
+            // waiting in it are coalesced before any of them is applied. Not
+            // on a replay, where the backlog depends on the machine
+            if (!replaying && _coalesceWindow > 0.0 && worker->reorder.count < COALESCE_BATCH && mlQueue_depth(&worker->queue) > 0)
+                continue;
+            while (_releaseMeas(worker, 0))
+                ;
+            if (worker->dirty != NULL)
+                _publishDirty(worker, NULL);
+
+            // A replay's clock only moves here, one message at a time
+            if (replaying)
+                _runTimers(worker, &nextEvict, &nextCheckpoint);
+        }
+        while (_releaseMeas(worker, 0))
+            ;
+        hasDeadline = _publishDirty(worker, &deadline);
+        if (_reorderDeadline(worker, &reorderDeadline) && (!hasDeadline || _timespecDiff(&reorderDeadline, &deadline) < 0.0))
         {
-            // To get ARKit objects to align with world coordinates, we have to 
-            // figure out the orientation and position of the ARKit origin 
-            // w.r.t the global origin
-            // a rig transform (used by A frame) is the location of the global 
-            // origin in the ARKit coordinate frame
-
-
-            // dx, dy, dz: are VIO estimates of phone position
-            // theta: is angle we must rotate VIO X axis to get global X axis
-            // outX, outY, outZ: are particle filter's estimates of phone
-            // position
-            dx = _particleFilter.lastX;
-            dy = _particleFilter.lastY;
-            dz = _particleFilter.lastZ;
-            c = cosf(outTheta);
-            s = sinf(outTheta);
-
-            rigX = outX - (dx * c - dy * s);
-            rigY = outY - (dx * s + dy * c);
-            rigZ = outZ - dz;
-
-            // additional pi/2 added to theta for axis alignment - Adwait
-            _publishLoc(client, topicName_RigOut, cameraObjId, outT, rigX, rigY, rigZ, outTheta);
+            deadline = reorderDeadline;
+            hasDeadline = 1;
         }
-        usleep(UPDATE_INTERVAL_us);
-    } while(1);
+        _runTimers(worker, &nextEvict, &nextCheckpoint);
+        if (worker->tags.count > 0 && (!hasDeadline || _timespecDiff(&nextEvict, &deadline) < 0.0))
+        {
+            deadline = nextEvict;
+            hasDeadline = 1;
+        }
+        if (_checkpointDir != NULL && worker->tags.count > 0 && _timespecDiff(&nextCheckpoint, &deadline) < 0.0)
+            deadline = nextCheckpoint;
 
-    MQTTClient_disconnect(client, 10000);
-    MQTTClient_destroy(&client);
-    return rc;
+        // Nothing falls due on a replay until the next message arrives
+        mlQueue_wait(&worker->queue, hasDeadline && !mlRecord_replaying() ? &deadline : NULL);
+    }
+    return NULL;
+}
+
+// Evicts idle tags and writes checkpoints when they are due
+static void _runTimers(_worker_t* worker, struct timespec* nextEvict, struct timespec* nextCheckpoint)
+{
+    struct timespec now;
+    size_t numEvicted;
+
+    _workerTime(worker, &now);
+    if (_timespecDiff(&now, nextEvict) >= 0.0)
+    {
+        numEvicted = 0;
+        if (worker->tags.count > 0)
+        {
+            pthread_mutex_lock(&worker->tagsLock);
+            numEvicted = mlTagTable_evict(&worker->tags, &now, TAG_IDLE_s);
+            pthread_mutex_unlock(&worker->tagsLock);
+        }
+        if (numEvicted > 0)
+            mlLog_event(ML_LOG_TAG_EVICT, NULL, worker->index, (int32_t)numEvicted);
+        if (ML_COUNTED(worker->numCoalesced) + ML_COUNTED(worker->numStale) != worker->reportedShed)
+        {
+            mlLog_shed(worker->index, ML_COUNTED(worker->numCoalesced), ML_COUNTED(worker->numStale));
+            worker->reportedShed = ML_COUNTED(worker->numCoalesced) + ML_COUNTED(worker->numStale);
+        }
+        *nextEvict = now;
+        _timespecAdd(nextEvict, EVICT_PERIOD_s);
+    }
+    if (_checkpointDir != NULL && _timespecDiff(&now, nextCheckpoint) >= 0.0)
+    {
+        _checkpointTags(worker);
+        *nextCheckpoint = now;
+        _timespecAdd(nextCheckpoint, CHECKPOINT_PERIOD_s);
+    }
 }
 
-static int8_t _getVio(char *_lineBuf, double* t, float* x, float* y, float* z) 
+// A replay runs each worker on the arrival times it has popped instead of
+// the machine's clocks, so what it sheds, evicts and publishes, and when,
+// follows from the log alone
+static double _workerNow(const _worker_t* worker)
 {
-    struct timeval tv;
-    gettimeofday(&tv, NULL); 
-    int8_t status = 0; // return 0 on success
-    cJSON *data = NULL, *position = NULL, *pos_x = NULL, *pos_y = NULL, *pos_z = NULL;
+    return mlRecord_replaying() ? worker->now : mlRecord_now();
+}
 
-    // we add a timestamp based on reception; TODO: add timestamp on the client side 
-    *t = tv.tv_sec + tv.tv_usec / 1000000.0;    
+// The same for the monotonic clock the timers and rate limits run on
+static void _workerTime(const _worker_t* worker, struct timespec* now)
+{
+    if (!mlRecord_replaying())
+    {
+        clock_gettime(CLOCK_MONOTONIC, now);
+        return;
+    }
+    now->tv_sec = (time_t)worker->now;
+    now->tv_nsec = (long)((worker->now - (double)now->tv_sec) * 1e9);
+}
 
-    // parse VIO message
-    // Example:
-    // {"object_id":"camera_jerry_jerry","action":"update","type":"object","data":{"position":{"x":0.788,"y":1.105,"z":-0.235},"rotation":{"x":0.024,"y":0.701,"z":0.712,"w":0.026}}}
+static void _pinWorker(int index)
+{
+#if defined(__linux__)
+    cpu_set_t cpus;
 
-    cJSON *vio_json = cJSON_Parse(_lineBuf);
-    if (vio_json == NULL)
+    // Best effort, fails harmlessly when the CPU is not in our set
+    CPU_ZERO(&cpus);
+    CPU_SET(index % CPU_SETSIZE, &cpus);
+    pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+#else
+    (void)index;
+#endif
+}
+
+// Publishes every dirty tag whose rate limit has expired. Returns 1 and the
+// earliest deadline of the tags that still have to wait, if any
+static uint8_t _publishDirty(_worker_t* worker, struct timespec* deadline)
+{
+    struct timespec now, due;
+    mlTag_t* tag;
+    mlTag_t** link;
+    uint64_t spanT;
+    double t;
+    uint8_t pending, published;
+
+    _workerTime(worker, &now);
+    t = 0.0;
+    pending = 0;
+    link = &worker->dirty;
+    while ((tag = *link) != NULL)
     {
-        const char *error_ptr = cJSON_GetErrorPtr();
-        if (error_ptr != NULL)
+        due = tag->lastPublish;
+        _timespecAdd(&due, _publishInterval);
+        if (_timespecDiff(&now, &due) >= 0.0)
         {
-            fprintf(stderr, "Error parsing VIO JSON before: %s\n", error_ptr);
+            pfTrace_setArg(tag->id);
+            spanT = pfTrace_now();
+            published = _publishRig(tag);
+            pfTrace_record("publish", spanT);
+            if (published)
+            {
+                if (t == 0.0)
+                    t = _workerNow(worker);
+                _count(worker, tag, ML_COUNT_PUBLISHES, 1);
+                mlHist_record(&worker->publishLatency, fmax(t - tag->dirtySince, 0.0));
+            }
+            tag->lastPublish = now;
+            tag->dirty = 0;
+            *link = tag->nextDirty;
+            tag->nextDirty = NULL;
+            continue;
         }
-        status = -1;
-        goto end;
-    }    
+        if (deadline != NULL && (!pending || _timespecDiff(&due, deadline) < 0.0))
+            *deadline = due;
+        pending = 1;
+        link = &tag->nextDirty;
+    }
+    return pending;
+}
 
-    data = cJSON_GetObjectItemCaseSensitive(vio_json, "data");
-    if (data == NULL) {
-        printf("Error parsing VIO JSON: Could not get data obj\n");
-        status = -1;
-        goto end;
+static mlTag_t* _getTag(_worker_t* worker, const mlMeas_t* meas)
+{
+    mlTag_t* tag;
+
+    tag = mlTagTable_find(&worker->tags, meas->tag, meas->tagHash);
+    if (tag == NULL)
+    {
+        pthread_mutex_lock(&worker->tagsLock);
+        tag = mlTagTable_add(&worker->tags, meas->tag, meas->tagHash);
+        pthread_mutex_unlock(&worker->tagsLock);
+        if (tag == NULL)
+        {
+            mlLog_event(ML_LOG_NO_MEMORY, meas->tag, 0, 0);
+            return NULL;
+        }
+        mlTag_format(tag->rigTopic, ML_TAG_OUT_LEN, topicName_RigOut, tag->id);
+        mlTag_format(tag->rigObjId, ML_TAG_OUT_LEN, cameraObjId, tag->id);
+        mlLog_event(ML_LOG_TAG_NEW, tag->id, worker->index, (int32_t)worker->tags.count);
+        if (_checkpointDir != NULL)
+            _restoreTag(tag, _workerNow(worker));
     }
+    _workerTime(worker, &tag->lastSeen);
+    return tag;
+}
 
-    position = cJSON_GetObjectItemCaseSensitive(data, "position");
-    if (position == NULL) {
-        printf("Error parsing VIO JSON: Could not get position obj\n");
-        status = -1;
-        goto end;
+// Puts meas->t on our clock. A client timestamp is shifted by the smallest
+// arrival delay seen from that client, which absorbs the clock offset and
+// the fixed part of the network latency but none of the jitter. The
+// estimate may rise slowly so that clock drift is followed. Records without
+// a client timestamp keep their arrival time
+static void _stampMeas(mlTag_t* tag, mlMeas_t* meas)
+{
+    double offset;
+
+    meas->tArrival = meas->t;
+    if (meas->tClient == 0.0)
+        return;
+    offset = meas->t - meas->tClient;
+    if (tag->clockT == 0.0 || offset < tag->clockOffset + CLOCK_RELAX * (meas->t - tag->clockT))
+        tag->clockOffset = offset;
+    else
+        tag->clockOffset += CLOCK_RELAX * (meas->t - tag->clockT);
+    tag->clockT = meas->t;
+    meas->t = meas->tClient + tag->clockOffset;
+}
+
+// Applies the earliest buffered record once it has been held for
+// _reorderHold, or right away if force is set. Returns 0 if nothing was due
+static uint8_t _releaseMeas(_worker_t* worker, uint8_t force)
+{
+    mlMeas_t meas;
+    mlTag_t* tag;
+    double t, now, tLast;
+
+    if (!mlReorder_peek(&worker->reorder, &t))
+        return 0;
+    now = _workerNow(worker);
+    if (!force && t + _reorderHold > now)
+        return 0;
+    mlReorder_pop(&worker->reorder, &meas, &tag);
+    worker->heldRanges -= meas.type == ML_MEAS_UWB;
+
+    // A range that has waited too long is shed rather than applied, unless
+    // one folded into it is fresh enough
+    if (meas.type == ML_MEAS_UWB)
+    {
+        tLast = meas.t;
+        if (meas.slot)
+            meas.range = mlCoalesce_take(&tag->ranges[meas.bcn], _coalescePolicy, &tLast);
+        if (_staleAfter > 0.0 && now - tLast > _staleAfter)
+        {
+            ML_COUNT(worker->numStale, 1);
+            return 1;
+        }
     }
 
-    pos_x = cJSON_GetObjectItemCaseSensitive(position, "x");
-    pos_y = cJSON_GetObjectItemCaseSensitive(position, "y");
-    pos_z = cJSON_GetObjectItemCaseSensitive(position, "z");
+    // Arrived after something newer from the same tag was already applied
+    if (meas.t < tag->lastT)
+    {
+        mlLog_event(ML_LOG_LATE, tag->id, meas.type, (int32_t)((tag->lastT - meas.t) * 1000.0));
+        _count(worker, tag, ML_COUNT_LATE, 1);
+        if (_latePolicy == ML_LATE_DROP || (_latePolicy == ML_LATE_RANGES && meas.type == ML_MEAS_VIO))
+            return 1;
+        meas.t = tag->lastT;
+    }
+    tag->lastT = meas.t;
+    _applyMeas(worker, tag, &meas);
+    return 1;
+}
 
-    if (!cJSON_IsNumber(pos_x) || !cJSON_IsNumber(pos_y) || !cJSON_IsNumber(pos_z)) {
-        printf("Error parsing VIO JSON: Could not get coordinates\n");
-        status = -1;
-        goto end;
+static uint8_t _reorderDeadline(_worker_t* worker, struct timespec* deadline)
+{
+    double t;
+
+    if (!mlReorder_peek(&worker->reorder, &t))
+        return 0;
+    _workerTime(worker, deadline);
+    t += _reorderHold - _workerNow(worker);
+    _timespecAdd(deadline, t > 0.0 ? t : 0.0);
+    return 1;
+}
+
+static void _applyMeas(_worker_t* worker, mlTag_t* tag, mlMeas_t* meas)
+{
+    struct timespec start, end;
+    double elapsed;
+    uint64_t spanT;
+    float uwbR;
+
+    tag->unsaved = 1;
+    pfTrace_setArg(tag->id);
+    if (meas->type == ML_MEAS_VIO)
+    {
+        spanT = pfTrace_now();
+        particleFilterLoc_depositVio(&tag->pf, meas->t, meas->x, meas->y, meas->z, 0.0f);
+        pfTrace_record("depositVio", spanT);
+        return;
+    }
+
+    uwbR = meas->range - UWB_BIAS;
+    if (uwbR > 0.0f && uwbR < 30.0f)
+    {
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        if (_updateBudget > 0.0)
+            _budgetTag(worker, tag, &start);
+        spanT = pfTrace_now();
+        particleFilterLoc_depositRange(&tag->pf, deployment[meas->bcn][0], deployment[meas->bcn][1], deployment[meas->bcn][2], uwbR, UWB_STD);
+        pfTrace_record("depositRange", spanT);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        elapsed = _timespecDiff(&end, &start);
+        if (_updateBudget > 0.0)
+            mlBudget_record(&worker->budget, tag->pf.numParticles, elapsed);
+        mlHist_record(&worker->updateTime, elapsed);
+        _count(worker, tag, ML_COUNT_UPDATES, 1);
+
+        // Both stay 0 unless the library was built with -DPF_ENABLE_STATS=1
+        _count(worker, tag, ML_COUNT_RESAMPLES, tag->pf.stats.numResampleTriggered - ML_COUNTED(tag->counts[ML_COUNT_RESAMPLES]));
+        _count(worker, tag, ML_COUNT_SPAWNS, tag->pf.stats.numSpawnEvents - ML_COUNTED(tag->counts[ML_COUNT_SPAWNS]));
+        if (!tag->dirty)
+        {
+            tag->dirtySince = meas->tArrival;
+            tag->dirty = 1;
+            tag->nextDirty = worker->dirty;
+            worker->dirty = tag;
+        }
+    }
+}
+
+// Folds a range into the one to the same beacon already waiting, if it is
+// within the window. Returns 0 if it has to be queued; it then holds the
+// beacon's slot if that was free
+static uint8_t _coalesceMeas(_worker_t* worker, mlTag_t* tag, mlMeas_t* meas)
+{
+    mlCoalesceSlot_t* slot;
+
+    slot = &tag->ranges[meas->bcn];
+    if (mlCoalesce_merge(slot, meas->t, meas->range, _coalesceWindow))
+    {
+        ML_COUNT(worker->numCoalesced, 1);
+        return 1;
     }
+    if (slot->count == 0)
+    {
+        mlCoalesce_open(slot, meas->t, meas->range);
+        meas->slot = 1;
+    }
+    return 0;
+}
+
+// Runs the tag on as many particles as the worker's backlog leaves time
+// for. Ranges still queued count as well as those held for reordering
+static void _budgetTag(_worker_t* worker, mlTag_t* tag, const struct timespec* now)
+{
+    int level, prev;
+    size_t pending;
+
+    prev = PF_N_TAG_LOC >> worker->budget.shift;
+    pending = worker->heldRanges + atomic_load_explicit(&worker->queuedRanges, memory_order_relaxed);
+    level = mlBudget_level(&worker->budget, pending, now->tv_sec + now->tv_nsec / 1e9);
+    if (level != prev)
+        mlLog_budget(worker->index, level, worker->budget.pending, mlQueue_depth(&worker->queue));
+    particleFilterLoc_setNumParticles(&tag->pf, level);
+}
+
+// Saves every tag that changed since its last checkpoint
+static void _checkpointTags(_worker_t* worker)
+{
+    mlTag_t* tag;
+    size_t i;
+    int32_t numSaved;
+
+    numSaved = 0;
+    for (i = 0; i < ML_TAG_BUCKETS; ++i)
+    {
+        for (tag = worker->tags.buckets[i]; tag != NULL; tag = tag->next)
+        {
+            if (tag->unsaved && _saveTag(worker, tag))
+            {
+                tag->unsaved = 0;
+                ++numSaved;
+            }
+        }
+    }
+    if (numSaved > 0)
+        mlLog_event(ML_LOG_CHECKPOINT, NULL, worker->index, numSaved);
+}
+
+static uint8_t _saveTag(_worker_t* worker, mlTag_t* tag)
+{
+    char path[LINE_LEN], tmpPath[LINE_LEN];
+    size_t len;
+    FILE* f;
+    uint8_t ok;
+
+    if (!_checkpointPath(path, LINE_LEN, tag->id, "") || !_checkpointPath(tmpPath, LINE_LEN, tag->id, ".tmp"))
+    {
+        mlLog_event(ML_LOG_CHECKPOINT_FAILED, tag->id, 0, 0);
+        return 0;
+    }
+    len = particleFilterLoc_checkpoint(&tag->pf, worker->checkpointBuf, particleFilterLoc_checkpointSize());
+
+    // Written aside and renamed, so a crash mid-write never leaves a torn
+    // snapshot behind
+    f = fopen(tmpPath, "wb");
+    ok = f != NULL && fwrite(worker->checkpointBuf, 1, len, f) == len;
+    if (f != NULL && fclose(f) != 0)
+        ok = 0;
+    if (ok && rename(tmpPath, path) != 0)
+        ok = 0;
+    if (!ok)
+    {
+        remove(tmpPath);
+        mlLog_event(ML_LOG_CHECKPOINT_FAILED, tag->id, 0, 0);
+    }
+    return ok;
+}
+
+// Restores a new tag from its snapshot, read in place from the mapped file,
+// unless it is older than CHECKPOINT_MAX_AGE_s at now
+static void _restoreTag(mlTag_t* tag, double now)
+{
+    char path[LINE_LEN];
+    struct stat st;
+    const pfCheckpoint_t* ck;
+    void* map;
+    double age;
+    int fd;
+
+    if (!_checkpointPath(path, LINE_LEN, tag->id, ""))
+    {
+        mlLog_event(ML_LOG_CHECKPOINT_FAILED, tag->id, 0, 0);
+        return;
+    }
+    fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return;
+    if (fstat(fd, &st) == 0 && st.st_size >= (off_t)sizeof(pfCheckpoint_t))
+    {
+        map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED)
+        {
+            // The header is only read once it is known to be a snapshot
+            if (particleFilterLoc_checkpointValid(map, (size_t)st.st_size))
+            {
+                ck = (const pfCheckpoint_t*)map;
+                age = now - ck->lastT;
+                if (age >= 0.0 && age < CHECKPOINT_MAX_AGE_s && particleFilterLoc_restore(&tag->pf, map, (size_t)st.st_size))
+                    mlLog_event(ML_LOG_RESTORED, tag->id, (int32_t)(age * 1000.0), 0);
+            }
+            munmap(map, (size_t)st.st_size);
+        }
+    }
+    close(fd);
+}
+
+// <dir>/tag_<id>.pfck, anything in the ID but [A-Za-z0-9._-] is escaped as %XX.
+// Returns 0 if the whole path does not fit in len; a shortened one could
+// name another tag's snapshot
+static uint8_t _checkpointPath(char* path, size_t len, const char* id, const char* suffix)
+{
+    size_t n;
+    int w;
+
+    w = snprintf(path, len, "%s/tag_", _checkpointDir);
+    if (w < 0 || (size_t)w >= len)
+        return 0;
+    for (n = (size_t)w; *id != '\0'; ++id)
+    {
+        if (isalnum((unsigned char)*id) || *id == '.' || *id == '_' || *id == '-')
+        {
+            if (n + 1 >= len)
+                return 0;
+            path[n++] = *id;
+        }
+        else
+        {
+            w = snprintf(path + n, len - n, "%%%02X", (unsigned char)*id);
+            if (w < 0 || (size_t)w >= len - n)
+                return 0;
+            n += (size_t)w;
+        }
+    }
+    w = snprintf(path + n, len - n, ".pfck%s", suffix);
+    return w >= 0 && (size_t)w < len - n;
+}
+
+// Returns 0 if the tag has no estimate yet
+static uint8_t _publishRig(mlTag_t* tag)
+{
+    double outT;
+    float outX, outY, outZ, outTheta, dx, dy, dz, c, s, rigX, rigY, rigZ;
+
+    if (!particleFilterLoc_getTagLoc(&tag->pf, &outT, &outX, &outY, &outZ, &outTheta))
+        return 0;
+
+    // To get ARKit objects to align with world coordinates, we have to 
+    // figure out the orientation and position of the ARKit origin 
+    // w.r.t the global origin
+    // a rig transform (used by A frame) is the location of the global 
+    // origin in the ARKit coordinate frame
+
+
+    // dx, dy, dz: are VIO estimates of phone position
+    // theta: is angle we must rotate VIO X axis to get global X axis
+    // outX, outY, outZ: are particle filter's estimates of phone
+    // position
+    dx = tag->pf.lastX;
+    dy = tag->pf.lastY;
+    dz = tag->pf.lastZ;
+    c = cosf(outTheta);
+    s = sinf(outTheta);
+
+    rigX = outX - (dx * c - dy * s);
+    rigY = outY - (dx * s + dy * c);
+    rigZ = outZ - dz;
+
+    // additional pi/2 added to theta for axis alignment - Adwait
+    // (Paho's synchronous client is safe to publish from every worker)
+    _publishLoc(client, tag->rigTopic, tag->rigObjId, outT, rigX, rigY, rigZ, outTheta);
+    return 1;
+}
+
+static void _pushMeas(mlMeas_t* meas)
+{
+    _worker_t* worker;
+
+    // Shard on the high bits, the tag tables bucket on the low ones
+    meas->tagHash = mlTag_hash(meas->tag);
+    worker = &_workers[(meas->tagHash >> 16) % (uint32_t)_numWorkers];
+
+    // Only this thread pushes, so once there is room the push succeeds.
+    // One cell short of full, as the worker frees a cell just after it
+    // moves the tail
+    if (_waitOnFull)
+        while (mlQueue_depth(&worker->queue) >= ML_QUEUE_LEN - 1)
+            usleep(100);
+
+    // Counted before the push, so the worker never pops one it has not seen
+    if (meas->type == ML_MEAS_UWB)
+        atomic_fetch_add_explicit(&worker->queuedRanges, 1, memory_order_relaxed);
+    if (!mlQueue_push(&worker->queue, meas))
+    {
+        if (meas->type == ML_MEAS_UWB)
+            atomic_fetch_sub_explicit(&worker->queuedRanges, 1, memory_order_relaxed);
+        mlLog_event(ML_LOG_QUEUE_FULL, meas->tag, meas->type, 0);
+    }
+}
+
+// MQTTLOCALIZE_LOG=error|info|debug, info when unset
+static mlLogLevel_t _logLevel(const char* name)
+{
+    if (name != NULL && strcmp(name, "error") == 0)
+        return ML_LOG_ERROR;
+    if (name != NULL && strcmp(name, "debug") == 0)
+        return ML_LOG_DEBUG;
+    return ML_LOG_INFO;
+}
+
+static void _timespecAdd(struct timespec* ts, double s)
+{
+    long ns;
+
+    ns = ts->tv_nsec + (long)(s * 1e9);
+    ts->tv_sec += ns / 1000000000L;
+    ts->tv_nsec = ns % 1000000000L;
+}
+
+static double _timespecDiff(const struct timespec* a, const struct timespec* b)
+{
+    return (double)(a->tv_sec - b->tv_sec) + (a->tv_nsec - b->tv_nsec) / 1e9;
+}
+
+// On the tag and the worker's totals, which outlive the tag
+static void _count(_worker_t* worker, mlTag_t* tag, mlCount_t count, uint64_t n)
+{
+    ML_COUNT(tag->counts[count], n);
+    ML_COUNT(worker->counts[count], n);
+}
+
+// Runs on the metrics server thread. Workers only write their own counters
+// and histograms, so nothing but the tag tables needs a lock; a worker is
+// held up by a scrape only if it adds or evicts a tag meanwhile
+static void _renderMetrics(mlMetricsOut_t* out)
+{
+    static uint64_t buckets[ML_HIST_BUCKETS];
+    char name[LINE_LEN];
+    uint64_t sumUs;
+    _worker_t* worker;
+    mlTag_t* tag;
+    size_t j;
+    int i, k;
+
+    for (k = 0; k < ML_COUNT_NUM; ++k)
+    {
+        snprintf(name, LINE_LEN, "mqttlocalize_%s", mlMetrics_countName((mlCount_t)k));
+        mlMetrics_family(out, name, "counter", mlMetrics_countHelp((mlCount_t)k));
+        for (i = 0; i < _numWorkers; ++i)
+            mlMetrics_printf(out, "%s{worker=\"%d\"} %llu\n", name, i, (unsigned long long)ML_COUNTED(_workers[i].counts[k]));
+    }
+    for (k = 0; k < ML_COUNT_NUM; ++k)
+    {
+        snprintf(name, LINE_LEN, "mqttlocalize_tag_%s", mlMetrics_countName((mlCount_t)k));
+        mlMetrics_family(out, name, "counter", mlMetrics_countHelp((mlCount_t)k));
+        for (i = 0; i < _numWorkers; ++i)
+        {
+            worker = &_workers[i];
+            pthread_mutex_lock(&worker->tagsLock);
+            for (j = 0; j < ML_TAG_BUCKETS; ++j)
+            {
+                for (tag = worker->tags.buckets[j]; tag != NULL; tag = tag->next)
+                {
+                    mlMetrics_printf(out, "%s{tag=\"", name);
+                    mlMetrics_label(out, tag->id);
+                    mlMetrics_printf(out, "\"} %llu\n", (unsigned long long)ML_COUNTED(tag->counts[k]));
+                }
+            }
+            pthread_mutex_unlock(&worker->tagsLock);
+        }
+    }
+
+    mlMetrics_family(out, "mqttlocalize_parse_failures_total", "counter", "Messages that could not be parsed, or named a bad client ID");
+    mlMetrics_printf(out, "mqttlocalize_parse_failures_total{type=\"vio\"} %llu\n", (unsigned long long)ML_COUNTED(_numBadVio));
+    mlMetrics_printf(out, "mqttlocalize_parse_failures_total{type=\"uwb\"} %llu\n", (unsigned long long)ML_COUNTED(_numBadUwb));
+    mlMetrics_printf(out, "mqttlocalize_parse_failures_total{type=\"id\"} %llu\n", (unsigned long long)ML_COUNTED(_numBadId));
+    mlMetrics_family(out, "mqttlocalize_ignored_total", "counter", "Messages on topics matching neither subscription");
+    mlMetrics_printf(out, "mqttlocalize_ignored_total %llu\n", (unsigned long long)ML_COUNTED(_numIgnored));
+    mlMetrics_family(out, "mqttlocalize_queue_dropped_total", "counter", "Messages dropped on a full worker queue");
+    for (i = 0; i < _numWorkers; ++i)
+        mlMetrics_printf(out, "mqttlocalize_queue_dropped_total{worker=\"%d\"} %llu\n", i, (unsigned long long)atomic_load_explicit(&_workers[i].queue.dropped, memory_order_relaxed));
+    mlMetrics_family(out, "mqttlocalize_coalesced_total", "counter", "Ranges folded into one to the same beacon");
+    for (i = 0; i < _numWorkers; ++i)
+        mlMetrics_printf(out, "mqttlocalize_coalesced_total{worker=\"%d\"} %llu\n", i, (unsigned long long)ML_COUNTED(_workers[i].numCoalesced));
+    mlMetrics_family(out, "mqttlocalize_stale_total", "counter", "Ranges dropped as stale");
+    for (i = 0; i < _numWorkers; ++i)
+        mlMetrics_printf(out, "mqttlocalize_stale_total{worker=\"%d\"} %llu\n", i, (unsigned long long)ML_COUNTED(_workers[i].numStale));
+    mlMetrics_family(out, "mqttlocalize_queue_depth", "gauge", "Messages waiting in the worker queue");
+    for (i = 0; i < _numWorkers; ++i)
+        mlMetrics_printf(out, "mqttlocalize_queue_depth{worker=\"%d\"} %zu\n", i, mlQueue_depth(&_workers[i].queue));
+    mlMetrics_family(out, "mqttlocalize_tags", "gauge", "Clients with a filter on the worker");
+    for (i = 0; i < _numWorkers; ++i)
+    {
+        pthread_mutex_lock(&_workers[i].tagsLock);
+        mlMetrics_printf(out, "mqttlocalize_tags{worker=\"%d\"} %zu\n", i, _workers[i].tags.count);
+        pthread_mutex_unlock(&_workers[i].tagsLock);
+    }
+
+    mlMetrics_family(out, "mqttlocalize_publish_latency_seconds", "histogram", "From the arrival of the first range in an estimate to its publish");
+    memset(buckets, 0, sizeof(buckets));
+    sumUs = 0;
+    for (i = 0; i < _numWorkers; ++i)
+        mlHist_merge(&_workers[i].publishLatency, buckets, &sumUs);
+    mlMetrics_hist(out, "mqttlocalize_publish_latency_seconds", buckets, sumUs);
+    mlMetrics_family(out, "mqttlocalize_update_seconds", "histogram", "Time to apply a range to a filter");
+    memset(buckets, 0, sizeof(buckets));
+    sumUs = 0;
+    for (i = 0; i < _numWorkers; ++i)
+        mlHist_merge(&_workers[i].updateTime, buckets, &sumUs);
+    mlMetrics_hist(out, "mqttlocalize_update_seconds", buckets, sumUs);
+}
+
+static int8_t _getVio(const char* payload, int payloadLen, double* t, double* tClient, float* x, float* y, float* z) 
+{
+    int8_t status; // return 0 on success
+    mlVio_t vio;
+
+    // we add a timestamp based on reception (the recorded one on a replay),
+    // the client's own timestamp is carried along when the message has one
+    *t = mlRecord_now();
+
+    // parse VIO message straight from the payload, see mlJson.c
+    status = mlJson_parseVio(payload, (size_t)payloadLen, &vio);
+    if (status == ML_JSON_ESCAPED)
+        status = _getVioCJson(payload, payloadLen, &vio);
+    if (status != ML_JSON_OK)
+        return -1;
 
     // note the coordinate system transform
-    *y = (float)pos_x->valuedouble;
-    *z = (float)pos_y->valuedouble;
-    *x = (float)pos_z->valuedouble;
+    *y = (float)vio.px;
+    *z = (float)vio.py;
+    *x = (float)vio.pz;
+    *tClient = vio.hasTimestamp ? vio.timestamp : 0.0;
+
+    return 0;
+}
+
+// Slow path for valid JSON whose keys the extractor cannot compare because
+// they are escaped; builds a full cJSON DOM
+static int8_t _getVioCJson(const char* payload, int payloadLen, mlVio_t* vio)
+{
+    int8_t status = ML_JSON_OK;
+    char lineBuf[LINE_LEN];
+    cJSON *vio_json = NULL, *data = NULL, *position = NULL, *pos_x = NULL, *pos_y = NULL, *pos_z = NULL;
+
+    if (payloadLen >= LINE_LEN)
+        return ML_JSON_MALFORMED;
+    memcpy(lineBuf, payload, payloadLen);
+    lineBuf[payloadLen] = '\0';
+
+    vio_json = cJSON_Parse(lineBuf);
+    if (vio_json == NULL)
+        return ML_JSON_MALFORMED;
+
+    data = cJSON_GetObjectItemCaseSensitive(vio_json, "data");
+    if (data != NULL)
+        position = cJSON_GetObjectItemCaseSensitive(data, "position");
+    if (position != NULL)
+    {
+        pos_x = cJSON_GetObjectItemCaseSensitive(position, "x");
+        pos_y = cJSON_GetObjectItemCaseSensitive(position, "y");
+        pos_z = cJSON_GetObjectItemCaseSensitive(position, "z");
+    }
+
+    if (cJSON_IsNumber(pos_x) && cJSON_IsNumber(pos_y) && cJSON_IsNumber(pos_z))
+    {
+        vio->px = pos_x->valuedouble;
+        vio->py = pos_y->valuedouble;
+        vio->pz = pos_z->valuedouble;
+        vio->hasPosition = 0x7;
+    }
+    else
+    {
+        status = ML_JSON_MISSING;
+    }
 
-end: 
     cJSON_Delete(vio_json);
-    return status;    
+    return status;
 }
 
-static uint8_t _getUwb(char *_lineBuf, double* t, uint8_t* b, float* r)
+// "beacon,range[,client timestamp]". Returns 0 unless the beacon is one of
+// the NUM_BCNS deployed
+static uint8_t _getUwb(char *_lineBuf, double* t, double* tClient, uint8_t* b, float* r)
 {
-    struct timeval tv;
-    gettimeofday(&tv, NULL); 
-    
-    *t = tv.tv_sec + tv.tv_usec / 1000000.0;
-    *b = atoi(strtok(_lineBuf, ","));
+    char *bTok, *rTok, *tTok, *bEnd;
+    long bcn;
+
+    *t = mlRecord_now();
+    bTok = strtok(_lineBuf, ",");
+    rTok = strtok(NULL, ",");
+    if (bTok == NULL || rTok == NULL)
+        return 0;
+    bcn = strtol(bTok, &bEnd, 10);
+    if (bEnd == bTok || bcn < 0 || bcn >= NUM_BCNS)
+        return 0;
+    *b = (uint8_t)bcn;
     // adding 0.3 to range to deal with bias observed on the UWB nodes
-    *r = (float)atof(strtok(NULL, ","));//+0.3;
+    *r = (float)atof(rTok);//+0.3;
+
+    // seconds or milliseconds, as for VIO
+    tTok = strtok(NULL, ",");
+    *tClient = tTok != NULL ? atof(tTok) : 0.0;
+    if (*tClient > 1e11)
+        *tClient /= 1000.0;
 
     return 1;
 }
@@ -264,7 +1177,7 @@ static void _publishLoc(MQTTClient client, char *topic, char *objid, double t, f
     pubmsg.payloadlen = strlen(str_msg);
     pubmsg.qos = QOS;
     pubmsg.retained = 0;
-    printf("UPDT : [%s] %s\n", topic, str_msg);
+    mlLog_publish(topic, t, x, y, z, theta);
     MQTTClient_publishMessage(client, topic, &pubmsg, &token);
 }
 
@@ -276,30 +1189,65 @@ void delivered(void *context, MQTTClient_deliveryToken dt)
 
 int msgarrvd(void *context, char *topicName, int topicLen, MQTTClient_message *message)
 {
-    double vioT, uwbT, outT;
-    float vioX, vioY, vioZ, uwbR, outX, outY, outZ, outTheta;
-    uint8_t uwbB;
+    static uint8_t named = 0;
+    mlMeas_t meas;
     char payload_str[LINE_LEN];
+    uint64_t spanT;
+
+    if (_recording)
+        mlRecord_write(&_record, mlRecord_now(), topicName, message->payload, (uint32_t)message->payloadlen);
 
-    assert(message->payloadlen < LINE_LEN-1);
-    memcpy(payload_str, message->payload, message->payloadlen);
-    payload_str[message->payloadlen] = '\0';
-
-    //printf("#topic: %s; message:%s", topicName, payload_str);  
-    printf("#topic: %s ", topicName);  
-
-    if (strncmp(topicName, topicName_VIO, strlen(topicName_VIO)) == 0) {
-        _getVio(payload_str, &vioT, &vioX, &vioY, &vioZ);
-        printf("VIO  :%lf,%f,%f,%f\n", vioT, vioX, vioY, vioZ);
-        particleFilterLoc_depositVio(&_particleFilter, vioT, vioX, vioY, vioZ, 0.0f);
-    } else if (strncmp(topicName, topicName_UWB, strlen(topicName_UWB)) == 0) {
-        _getUwb(payload_str, &uwbT, &uwbB, &uwbR);
-        printf("UWB  :%lf,%d,%f\n", uwbT, uwbB, uwbR);
-        assert(uwbB<NUM_BCNS);
-        uwbR -= UWB_BIAS;
-        if (uwbR > 0.0f && uwbR < 30.0f)
-            particleFilterLoc_depositRange(&_particleFilter, deployment[uwbB][0], deployment[uwbB][1], deployment[uwbB][2], uwbR, UWB_STD);
+    // Parse only, the filter is updated on the tag's worker thread
+    if (!named)
+    {
+        pfTrace_setThreadName("mqtt");
+        named = 1;
+    }
+    spanT = pfTrace_now();
+    memset(&meas, 0, sizeof(meas));
+    if (mlTag_matchTopic(topicName_VIO, topicName, meas.tag, ML_TAG_ID_LEN)) {
+        meas.type = ML_MEAS_VIO;
+    } else if (mlTag_matchTopic(topicName_UWB, topicName, meas.tag, ML_TAG_ID_LEN)) {
+        meas.type = ML_MEAS_UWB;
+    } else {
+        mlLog_event(ML_LOG_IGNORED, topicName, 0, 0);
+        ML_COUNT(_numIgnored, 1);
+        goto end;
+    }
+    // the client ID ends up in the published JSON
+    if (strpbrk(meas.tag, "\"\\") != NULL) {
+        mlLog_event(ML_LOG_BAD_ID, topicName, 0, 0);
+        ML_COUNT(_numBadId, 1);
+        goto end;
+    }
+
+    if (meas.type == ML_MEAS_VIO) {
+        if (_getVio((const char*)message->payload, message->payloadlen, &meas.t, &meas.tClient, &meas.x, &meas.y, &meas.z) == 0) {
+            mlLog_vio(meas.tag, meas.t, meas.x, meas.y, meas.z);
+            _pushMeas(&meas);
+        } else {
+            mlLog_event(ML_LOG_BAD_VIO, meas.tag, 0, 0);
+            ML_COUNT(_numBadVio, 1);
+        }
+    } else {
+        if (message->payloadlen >= LINE_LEN) {
+            mlLog_event(ML_LOG_BAD_UWB, meas.tag, 0, 0);
+            ML_COUNT(_numBadUwb, 1);
+            goto end;
+        }
+        memcpy(payload_str, message->payload, message->payloadlen);
+        payload_str[message->payloadlen] = '\0';
+        if (!_getUwb(payload_str, &meas.t, &meas.tClient, &meas.bcn, &meas.range)) {
+            mlLog_event(ML_LOG_BAD_UWB, meas.tag, 0, 0);
+            ML_COUNT(_numBadUwb, 1);
+            goto end;
+        }
+        mlLog_uwb(meas.tag, meas.t, meas.bcn, meas.range);
+        _pushMeas(&meas);
     }
+end:
+    pfTrace_setArg(meas.tag);
+    pfTrace_record("parse", spanT);
     MQTTClient_freeMessage(&message);
     MQTTClient_free(topicName);
     return 1;
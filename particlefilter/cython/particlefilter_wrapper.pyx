@@ -10,40 +10,269 @@ This source code is licensed under the BSD-3-Clause license found in the
 LICENSE file in the root directory of this source tree.
 """
 
-from libc.stdint cimport uint8_t
+from libc.stdint cimport uint8_t, uint32_t, uint64_t
+from libc.stdlib cimport malloc, free
 import numpy as np
 cimport numpy as np
 
+np.import_array()
+
 cdef extern from "../include/particleFilter.h":
+    ctypedef struct tagParticle_t:
+        float w
+        float x
+        float y
+        float z
+        float theta
     ctypedef struct particleFilterLoc_t:
+        tagParticle_t* pTag
+        int numParticles
+    ctypedef struct particleFilterSlam_t:
+        pass
+    ctypedef struct bcn_t:
+        pass
+    ctypedef struct pfAllocator_t:
+        pass
+    ctypedef struct pfRssiModel_t:
         pass
     void particleFilterSeed_set(unsigned int seed)
+    void particleFilterAllocator_set(const pfAllocator_t* allocator)
+    particleFilterLoc_t* particleFilterLoc_new()
+    void particleFilterLoc_delete(particleFilterLoc_t* pf)
     void particleFilterLoc_init(particleFilterLoc_t* pf)
-    void particleFilterLoc_depositVio(particleFilterLoc_t* pf, double t, float x, float y, float z, float dist)
-    void particleFilterLoc_depositRange(particleFilterLoc_t* pf, float bx, float by, float bz, float range, float stdRange)
-    void particleFilterLoc_depositRssi(particleFilterLoc_t* pf, float bx, float by, float bz, int rssi)
-    uint8_t particleFilterLoc_getTagLoc(const particleFilterLoc_t* pf, double* t, float* x, float* y, float* z, float* theta)
+    void particleFilterLoc_depositVio(particleFilterLoc_t* pf, double t, float x, float y, float z, float dist) nogil
+    void particleFilterLoc_depositRange(particleFilterLoc_t* pf, float bx, float by, float bz, float range, float stdRange) nogil
+    void particleFilterLoc_depositRssi(particleFilterLoc_t* pf, float bx, float by, float bz, int rssi) nogil
+    void particleFilterLoc_depositCalibratedRssi(particleFilterLoc_t* pf, float bx, float by, float bz, int rssi, const pfRssiModel_t* model) nogil
+    void particleFilterRssiModel_init(pfRssiModel_t* model, float txPower, float exponent, float stdRssi)
+    uint8_t particleFilterLoc_getTagLoc(const particleFilterLoc_t* pf, double* t, float* x, float* y, float* z, float* theta) nogil
+    particleFilterSlam_t* particleFilterSlam_new()
+    bcn_t* particleFilterSlam_newBcn()
+    void particleFilterSlam_delete(particleFilterSlam_t* pf)
+    void particleFilterSlam_deleteBcn(bcn_t* bcn)
+    void particleFilterSlam_init(particleFilterSlam_t* pf)
+    void particleFilterSlam_setBcnRssiModel(bcn_t* bcn, const pfRssiModel_t* model)
+    void particleFilterSlam_depositTagVio(particleFilterSlam_t* pf, double t, float x, float y, float z, float dist) nogil
+    void particleFilterSlam_depositBcnVio(bcn_t* bcn, double t, float x, float y, float z, float dist) nogil
+    void particleFilterSlam_depositRange(particleFilterSlam_t* pf, bcn_t* bcn, float range, float stdRange, bcn_t** allBcns, int numBcns) nogil
+    void particleFilterSlam_depositRssi(particleFilterSlam_t* pf, bcn_t* bcn, int rssi, bcn_t** allBcns, int numBcns) nogil
+    uint8_t particleFilterSlam_getTagLoc(const particleFilterSlam_t* pf, double* t, float* x, float* y, float* z, float* theta) nogil
+    uint8_t particleFilterSlam_getBcnLoc(const particleFilterSlam_t* pf, const bcn_t* bcn, double* t, float* x, float* y, float* z, float* theta) nogil
+    ctypedef enum pfCpuLevel_t:
+        pass
+    pfCpuLevel_t particleFilterCpu_get()
+    const char* particleFilterCpu_name(pfCpuLevel_t level)
+
+cdef extern from "../include/pfAlloc.h":
+    ctypedef struct pfArena_t:
+        pass
+    uint32_t PF_ARENA_HUGE_TRANSPARENT
+    void pfArena_init(pfArena_t* arena, uint32_t flags)
+    void pfArena_allocator(pfArena_t* arena, pfAllocator_t* allocator)
+
+# Filters are allocated and freed with the GIL held, so one arena serves
+# every ParticleFilterLoc and recycles the memory of collected ones
+cdef pfArena_t _arena
+cdef pfAllocator_t _arenaHooks
+pfArena_init(&_arena, PF_ARENA_HUGE_TRANSPARENT)
+pfArena_allocator(&_arena, &_arenaHooks)
+particleFilterAllocator_set(&_arenaHooks)
+
+# The filters pick their kernels at the first init, which may run without
+# the GIL; pick them now so threads never race to
+particleFilterCpu_get()
+
+cdef class RssiModel:
+    cdef pfRssiModel_t* model;
+
+    def __cinit__(self, txPower: np.float32_t, exponent: np.float32_t, stdRssi: np.float32_t) -> None:
+        self.model = <pfRssiModel_t*>malloc(sizeof(pfRssiModel_t))
+        if self.model is NULL:
+            raise MemoryError()
+        particleFilterRssiModel_init(self.model, txPower, exponent, stdRssi)
+
+    def __dealloc__(self) -> None:
+        free(self.model)
 
 cdef class ParticleFilterLoc:
-    cdef particleFilterLoc_t pf;
+    cdef particleFilterLoc_t* pf;
 
     def __cinit__(self) -> None:
-        particleFilterLoc_init(&self.pf)
+        self.pf = particleFilterLoc_new()
+        if self.pf is NULL:
+            raise MemoryError()
+
+    def __dealloc__(self) -> None:
+        particleFilterLoc_delete(self.pf)
 
     cpdef void depositVio(self, t: np.float64_t, x: np.float32_t, y: np.float32_t, z: np.float32_t, dist: np.float32_t):
-        particleFilterLoc_depositVio(&self.pf, t, x, y, z, dist)
+        with nogil:
+            particleFilterLoc_depositVio(self.pf, t, x, y, z, dist)
 
     cpdef void depositRange(self, bx: np.float32_t, by: np.float32_t, bz: np.float32_t, range: np.float32_t, stdRange: np.float32_t):
-        particleFilterLoc_depositRange(&self.pf, bx, by, bz, range, stdRange)
+        with nogil:
+            particleFilterLoc_depositRange(self.pf, bx, by, bz, range, stdRange)
+
+    cpdef void depositRssi(self, bx: np.float32_t, by: np.float32_t, bz: np.float32_t, rssi: np.int32_t, RssiModel model=None):
+        cdef const pfRssiModel_t* m = NULL if model is None else model.model
+        with nogil:
+            if m is NULL:
+                particleFilterLoc_depositRssi(self.pf, bx, by, bz, rssi)
+            else:
+                particleFilterLoc_depositCalibratedRssi(self.pf, bx, by, bz, rssi, m)
+
+    cpdef (uint8_t, np.float64_t, np.float32_t, np.float32_t, np.float32_t, np.float32_t) getTagLoc(self):
+        cdef double t;
+        cdef float x, y, z, theta;
+        cdef uint8_t out
+        with nogil:
+            out = particleFilterLoc_getTagLoc(self.pf, &t, &x, &y, &z, &theta);
+        return (out, t, x, y, z, theta)
+
+    # Read-only views straight over the particles in pTag, which stay where
+    # they are for the life of the filter and are updated in place. A view
+    # keeps the filter alive and sees every later update, but covers the
+    # particles in use when it was taken
+    cdef np.ndarray _view(self, int nd, np.npy_intp* dims, np.npy_intp* strides, float* data):
+        cdef np.ndarray view = np.PyArray_New(np.ndarray, nd, dims, np.NPY_FLOAT32, strides, data, 0, np.NPY_ARRAY_ALIGNED, None)
+        np.set_array_base(view, self)
+        return view
+
+    @property
+    def numParticles(self) -> int:
+        return self.pf.numParticles
+
+    @property
+    def positions(self) -> np.ndarray:
+        cdef np.npy_intp dims[2]
+        cdef np.npy_intp strides[2]
+        dims[0] = self.pf.numParticles
+        dims[1] = 3
+        strides[0] = sizeof(tagParticle_t)
+        strides[1] = sizeof(float)
+        return self._view(2, dims, strides, &self.pf.pTag[0].x)
+
+    @property
+    def headings(self) -> np.ndarray:
+        cdef np.npy_intp dims[1]
+        cdef np.npy_intp strides[1]
+        dims[0] = self.pf.numParticles
+        strides[0] = sizeof(tagParticle_t)
+        return self._view(1, dims, strides, &self.pf.pTag[0].theta)
 
-    cpdef void depositRssi(self, bx: np.float32_t, by: np.float32_t, bz: np.float32_t, rssi: np.int32_t):
-        particleFilterLoc_depositRssi(&self.pf, bx, by, bz, rssi)
+    # Unnormalized, and logs in a -DPF_LOG_WEIGHTS=1 build
+    @property
+    def weights(self) -> np.ndarray:
+        cdef np.npy_intp dims[1]
+        cdef np.npy_intp strides[1]
+        dims[0] = self.pf.numParticles
+        strides[0] = sizeof(tagParticle_t)
+        return self._view(1, dims, strides, &self.pf.pTag[0].w)
+
+# Each filter is separate, so different filters can be updated from
+# different threads at once, but a ParticleFilterSlam and its beacons must
+# only be used by one thread at a time
+cdef uint64_t _numSlam = 0
+
+cdef class Beacon:
+    cdef bcn_t* bcn;
+    cdef uint64_t owner;        # the ParticleFilterSlam it was added to, 0 for none
+    cdef RssiModel model;
+
+    def __cinit__(self) -> None:
+        self.bcn = particleFilterSlam_newBcn()
+        if self.bcn is NULL:
+            raise MemoryError()
+        self.owner = 0
+
+    def __dealloc__(self) -> None:
+        particleFilterSlam_deleteBcn(self.bcn)
+
+    # Keeps the model alive for as long as the beacon uses it
+    cpdef void setRssiModel(self, RssiModel model=None):
+        self.model = model
+        particleFilterSlam_setBcnRssiModel(self.bcn, NULL if model is None else model.model)
+
+    cpdef void depositVio(self, t: np.float64_t, x: np.float32_t, y: np.float32_t, z: np.float32_t, dist: np.float32_t):
+        with nogil:
+            particleFilterSlam_depositBcnVio(self.bcn, t, x, y, z, dist)
+
+cdef class ParticleFilterSlam:
+    cdef particleFilterSlam_t* pf;
+    cdef uint64_t id;
+    cdef list _bcns;
+    cdef np.ndarray allBcns;    # of the bcn_t* in _bcns, as passed to every update
+
+    def __cinit__(self) -> None:
+        global _numSlam
+        self.pf = particleFilterSlam_new()
+        if self.pf is NULL:
+            raise MemoryError()
+        _numSlam += 1
+        self.id = _numSlam
+        self._bcns = []
+        self.allBcns = np.empty(0, dtype=np.uintp)
+
+    def __dealloc__(self) -> None:
+        particleFilterSlam_delete(self.pf)
+
+    # Every update commits the VIO of all beacons added here. Adds a new
+    # beacon, or one that has not been added to any filter yet, and returns it
+    cpdef Beacon addBcn(self, Beacon bcn=None):
+        if bcn is None:
+            bcn = Beacon()
+        elif bcn.owner != 0:
+            raise ValueError("beacon already added to a filter")
+        bcn.owner = self.id
+        self._bcns.append(bcn)
+        self.allBcns = np.append(self.allBcns, np.uintp(<size_t>bcn.bcn))
+        return bcn
+
+    @property
+    def bcns(self) -> tuple:
+        return tuple(self._bcns)
+
+    cdef bcn_t** _allBcns(self, Beacon bcn) except NULL:
+        if bcn.owner != self.id:
+            raise ValueError("beacon not added to this filter")
+        return <bcn_t**>np.PyArray_DATA(self.allBcns)
+
+    cpdef void depositTagVio(self, t: np.float64_t, x: np.float32_t, y: np.float32_t, z: np.float32_t, dist: np.float32_t):
+        with nogil:
+            particleFilterSlam_depositTagVio(self.pf, t, x, y, z, dist)
+
+    cpdef void depositRange(self, Beacon bcn, range: np.float32_t, stdRange: np.float32_t):
+        cdef bcn_t** allBcns = self._allBcns(bcn)
+        cdef int numBcns = len(self._bcns)
+        with nogil:
+            particleFilterSlam_depositRange(self.pf, bcn.bcn, range, stdRange, allBcns, numBcns)
+
+    cpdef void depositRssi(self, Beacon bcn, rssi: np.int32_t):
+        cdef bcn_t** allBcns = self._allBcns(bcn)
+        cdef int numBcns = len(self._bcns)
+        with nogil:
+            particleFilterSlam_depositRssi(self.pf, bcn.bcn, rssi, allBcns, numBcns)
 
     cpdef (uint8_t, np.float64_t, np.float32_t, np.float32_t, np.float32_t, np.float32_t) getTagLoc(self):
         cdef double t;
         cdef float x, y, z, theta;
-        cdef uint8_t out = particleFilterLoc_getTagLoc(&self.pf, &t, &x, &y, &z, &theta);
+        cdef uint8_t out
+        with nogil:
+            out = particleFilterSlam_getTagLoc(self.pf, &t, &x, &y, &z, &theta);
+        return (out, t, x, y, z, theta)
+
+    cpdef (uint8_t, np.float64_t, np.float32_t, np.float32_t, np.float32_t, np.float32_t) getBcnLoc(self, Beacon bcn):
+        cdef double t;
+        cdef float x, y, z, theta;
+        cdef uint8_t out
+        if bcn.owner != self.id:
+            raise ValueError("beacon not added to this filter")
+        with nogil:
+            out = particleFilterSlam_getBcnLoc(self.pf, bcn.bcn, &t, &x, &y, &z, &theta);
         return (out, t, x, y, z, theta)
 
 cpdef void setSeed(seed: np.uint32):
   particleFilterSeed_set(seed);
+
+cpdef str cpuLevel():
+  return particleFilterCpu_name(particleFilterCpu_get()).decode('ascii')
@@ -13,18 +13,53 @@
 #ifndef _PARTICLEFILTER_H
 #define _PARTICLEFILTER_H
 
+#include <stddef.h>
 #include <stdint.h>
 
+#ifndef PF_N_TAG_LOC
 #define PF_N_TAG_LOC    (10000)
+#endif
 #define PF_N_TAG_SLAM   (100)
 #define PF_N_BCN        (1000)
 
+#define PF_STATS_HIST_BINS  (16)
+
+#define PF_CHECKPOINT_MAGIC     (0x4b434650u)   // "PFCK" read as little-endian bytes
+#define PF_CHECKPOINT_VERSION   (1)
+#define PF_CHECKPOINT_ALIGN     (64)
+
+#define PF_ALLOC_ALIGN          (64)
+
+#define PF_RSSI_MIN             (-110)  // dBm, readings outside are clamped
+#define PF_RSSI_MAX             (-20)
+#define PF_RSSI_BINS            (256)
+#define PF_RSSI_BIN_SIZE        (0.1f)  // m, so the table covers 25.6 m
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
     void particleFilterSeed_set(unsigned int seed);
 
+    typedef enum
+    {
+        PF_RESAMPLE_SYSTEMATIC = 0,         // serial sweep over the weight CDF
+        PF_RESAMPLE_PARALLEL_SYSTEMATIC,    // the same draw from a blocked prefix sum, one pass per parent
+        PF_RESAMPLE_METROPOLIS,             // Metropolis chain per child, no weight sum; for wide parallel hardware
+
+    } pfResampler_t;
+
+    // Instruction sets the hot kernels are built for, chosen with cpuid at
+    // the first filter init. All give the same results
+    typedef enum
+    {
+        PF_CPU_SCALAR = 0,
+        PF_CPU_SSE42,
+        PF_CPU_AVX2,
+        PF_CPU_AVX512,
+
+    } pfCpuLevel_t;
+
     typedef struct
     {
         float w;
@@ -44,11 +79,87 @@ extern "C" {
         float theta;
 
     } bcnParticle_t;
+
+    // -DPF_COMPACT_BCN=1 stores beacon particles in 10 instead of 20 bytes:
+    // half-precision offsets from a per-row origin, heading in 2^16 steps
+    // and log2 weights in 1/256 steps (0x8000 is zero weight). Increments
+    // below those steps are rounded away, so this suits static beacons
+#if defined(PF_COMPACT_BCN) && PF_COMPACT_BCN
+    typedef struct
+    {
+        int16_t logW;
+        uint16_t theta;
+        uint16_t x;
+        uint16_t y;
+        uint16_t z;
+
+    } bcnStore_t;
+#else
+    typedef bcnParticle_t bcnStore_t;
+#endif
     
+    // -DPF_LOG_WEIGHTS=1 keeps tag weights as natural logs (see pfWeight.h).
+    // Beacon weights are unaffected
+    typedef struct
+    {
+        float max;
+        float norm;
+
+    } pfLogWeight_t;
+
+    typedef struct
+    {
+        uint64_t count;
+        uint64_t ns;
+        uint64_t maxNs;
+        uint64_t cycles;
+
+    } pfStatsTimer_t;
+
+    typedef struct
+    {
+        pfStatsTimer_t commitVio;
+        pfStatsTimer_t applyRange;
+        pfStatsTimer_t ess;         // weight sums and ESS, the first part of resample
+        pfStatsTimer_t resample;    // the whole step, ess included
+        pfStatsTimer_t getLoc;
+        uint64_t numResampleTriggered;
+        uint64_t numResampleSkipped;
+        uint64_t numSpawnEvents;
+        uint64_t numSpawnedParticles;
+        uint64_t essHist[PF_STATS_HIST_BINS];
+        uint64_t weightSumHist[PF_STATS_HIST_BINS];
+
+    } pfStats_t;
+
+    // Occupancy grid in the beacons' frame, one bit per cell. Each 64-bit
+    // word holds a 4x4x4 brick of cells (8x8 in a 2D map, which ignores z),
+    // so the cells around a particle share a cache line. The bits belong to
+    // the caller, see particleFilterMap_size(); cells outside the grid are
+    // free
+    typedef struct
+    {
+        uint64_t* bits;
+        float origin[3];
+        float cellSize;
+        float invCellSize;
+        int32_t cells[3];
+        int32_t bricks[2];
+        uint8_t shift[3];
+
+    } pfMap_t;
+
     typedef struct
     {
         tagParticle_t pTag[PF_N_TAG_LOC];
         tagParticle_t pTagBuf[PF_N_TAG_LOC];
+        // Per-particle scratch for one step, kept here rather than on the
+        // stack of the thread running the filter
+        float rangeBuf[PF_N_TAG_LOC];
+        float weightBuf[PF_N_TAG_LOC];
+        float cdfBuf[PF_N_TAG_LOC];
+        int ancestorBuf[PF_N_TAG_LOC];
+        int numParticles;       // in use, the first numParticles of pTag
         uint8_t initialized;
         double firstT;
         float firstX;
@@ -60,6 +171,13 @@ extern "C" {
         float lastY;
         float lastZ;
         float lastDist;
+        const pfMap_t* map;
+        uint8_t resampler;
+        unsigned int seed;
+#if defined(PF_LOG_WEIGHTS) && PF_LOG_WEIGHTS
+        pfLogWeight_t logW;
+#endif
+        pfStats_t stats;
 
     } particleFilterLoc_t;
 
@@ -78,13 +196,44 @@ extern "C" {
         float lastY;
         float lastZ;
         float lastDist;
+        uint8_t resampler;
+        unsigned int seed;
+#if defined(PF_LOG_WEIGHTS) && PF_LOG_WEIGHTS
+        pfLogWeight_t logW;
+#endif
+        pfStats_t stats;
         
     } particleFilterSlam_t;
     
+    // Log-distance path loss, rssi = txPower - 10 * exponent * log10(d) with
+    // N(0, stdRssi) shadowing, tabulated per dBm and distance bin so a
+    // particle costs a lookup. Build with particleFilterRssiModel_init()
+    // and share between beacons with the same calibration
     typedef struct
     {
-        bcnParticle_t pBcn[PF_N_TAG_SLAM][PF_N_BCN];
-        bcnParticle_t pBcnBuf[PF_N_BCN];
+        float txPower;
+        float exponent;
+        float stdRssi;
+        float range[PF_RSSI_MAX - PF_RSSI_MIN + 1];
+        float stdRange[PF_RSSI_MAX - PF_RSSI_MIN + 1];
+        float lik[PF_RSSI_MAX - PF_RSSI_MIN + 1][PF_RSSI_BINS];
+#if defined(PF_LOG_WEIGHTS) && PF_LOG_WEIGHTS
+        float lnLik[PF_RSSI_MAX - PF_RSSI_MIN + 1][PF_RSSI_BINS];
+#endif
+#if defined(PF_COMPACT_BCN) && PF_COMPACT_BCN
+        int16_t logLik[PF_RSSI_MAX - PF_RSSI_MIN + 1][PF_RSSI_BINS];
+#endif
+
+    } pfRssiModel_t;
+
+    typedef struct
+    {
+        bcnStore_t pBcn[PF_N_TAG_SLAM][PF_N_BCN];
+        bcnStore_t pBcnBuf[PF_N_BCN];
+#if defined(PF_COMPACT_BCN) && PF_COMPACT_BCN
+        float origin[PF_N_TAG_SLAM][3];
+#endif
+        const pfRssiModel_t* rssiModel;
         uint8_t initialized;
         double firstT;
         float firstX;
@@ -99,6 +248,47 @@ extern "C" {
         
     } bcn_t;
 
+    // Snapshot layout: this header, then the particles at particleOffset
+    // (a multiple of PF_CHECKPOINT_ALIGN) as a plain array in native byte
+    // order, so a mapped file can be read in place
+    typedef struct
+    {
+        uint32_t magic;
+        uint16_t version;
+        uint16_t kind;
+        uint32_t numParticles;
+        uint32_t particleSize;
+        uint64_t particleOffset;
+        uint32_t seed;
+        uint8_t initialized;
+        uint8_t logWeights;
+        uint8_t reserved[2];
+        double firstT;
+        float firstX;
+        float firstY;
+        float firstZ;
+        float firstDist;
+        double lastT;
+        float lastX;
+        float lastY;
+        float lastZ;
+        float lastDist;
+        float logWMax;
+        float logWNorm;
+
+    } pfCheckpoint_t;
+
+    // Memory for filters made by the _new() functions. alloc returns size
+    // bytes aligned to align (at most PF_ALLOC_ALIGN) or NULL; free gets the
+    // size that was allocated
+    typedef struct
+    {
+        void* (*alloc)(void* ctx, size_t size, size_t align);
+        void (*free)(void* ctx, void* p, size_t size);
+        void* ctx;
+
+    } pfAllocator_t;
+
     void particleFilterLoc_init(particleFilterLoc_t* pf);
     void particleFilterSlam_init(particleFilterSlam_t* pf);
     void particleFilterSlam_addBcn(bcn_t* bcn);
@@ -108,10 +298,45 @@ extern "C" {
     void particleFilterLoc_depositRange(particleFilterLoc_t* pf, float bx, float by, float bz, float range, float stdRange);
     void particleFilterSlam_depositRange(particleFilterSlam_t* pf, bcn_t* bcn, float range, float stdRange, bcn_t** allBcns, int numBcns);
     void particleFilterLoc_depositRssi(particleFilterLoc_t* pf, float bx, float by, float bz, int rssi);
+    void particleFilterLoc_depositCalibratedRssi(particleFilterLoc_t* pf, float bx, float by, float bz, int rssi, const pfRssiModel_t* model);
     void particleFilterSlam_depositRssi(particleFilterSlam_t* pf, bcn_t* bcn, int rssi, bcn_t** allBcns, int numBcns);
     uint8_t particleFilterLoc_getTagLoc(const particleFilterLoc_t* pf, double* t, float* x, float* y, float* z, float* theta);
     uint8_t particleFilterSlam_getTagLoc(const particleFilterSlam_t* pf, double* t, float* x, float* y, float* z, float* theta);
     uint8_t particleFilterSlam_getBcnLoc(const particleFilterSlam_t* pf, const bcn_t* bcn, double* t, float* x, float* y, float* z, float* theta);
+    uint8_t particleFilterLoc_getStats(const particleFilterLoc_t* pf, pfStats_t* stats);
+    uint8_t particleFilterSlam_getStats(const particleFilterSlam_t* pf, pfStats_t* stats);
+    void particleFilterLoc_resetStats(particleFilterLoc_t* pf);
+    void particleFilterSlam_resetStats(particleFilterSlam_t* pf);
+    void particleFilterLoc_setResampler(particleFilterLoc_t* pf, pfResampler_t resampler);
+    void particleFilterSlam_setResampler(particleFilterSlam_t* pf, pfResampler_t resampler);
+    int particleFilterLoc_setNumParticles(particleFilterLoc_t* pf, int numParticles);
+    void particleFilterLoc_setMap(particleFilterLoc_t* pf, const pfMap_t* map);
+    void particleFilterSlam_setBcnRssiModel(bcn_t* bcn, const pfRssiModel_t* model);
+    void particleFilterRssiModel_init(pfRssiModel_t* model, float txPower, float exponent, float stdRssi);
+    size_t particleFilterMap_size(int nx, int ny, int nz);
+    void particleFilterMap_init(pfMap_t* map, void* bits, float x, float y, float z, float cellSize, int nx, int ny, int nz);
+    void particleFilterMap_load(pfMap_t* map, const uint8_t* cells);
+    void particleFilterMap_fill(pfMap_t* map, float x0, float y0, float z0, float x1, float y1, float z1, uint8_t occupied);
+    pfCpuLevel_t particleFilterCpu_get(void);
+    pfCpuLevel_t particleFilterCpu_set(pfCpuLevel_t level);
+    const char* particleFilterCpu_name(pfCpuLevel_t level);
+    size_t particleFilterLoc_checkpointSize(void);
+    size_t particleFilterSlam_checkpointSize(void);
+    size_t particleFilterSlam_checkpointBcnSize(void);
+    size_t particleFilterLoc_checkpoint(const particleFilterLoc_t* pf, void* buf, size_t len);
+    size_t particleFilterSlam_checkpoint(const particleFilterSlam_t* pf, void* buf, size_t len);
+    size_t particleFilterSlam_checkpointBcn(const bcn_t* bcn, void* buf, size_t len);
+    uint8_t particleFilterLoc_checkpointValid(const void* buf, size_t len);
+    uint8_t particleFilterLoc_restore(particleFilterLoc_t* pf, const void* buf, size_t len);
+    uint8_t particleFilterSlam_restore(particleFilterSlam_t* pf, const void* buf, size_t len);
+    uint8_t particleFilterSlam_restoreBcn(bcn_t* bcn, const void* buf, size_t len);
+    void particleFilterAllocator_set(const pfAllocator_t* allocator);
+    particleFilterLoc_t* particleFilterLoc_new(void);
+    particleFilterSlam_t* particleFilterSlam_new(void);
+    bcn_t* particleFilterSlam_newBcn(void);
+    void particleFilterLoc_delete(particleFilterLoc_t* pf);
+    void particleFilterSlam_delete(particleFilterSlam_t* pf);
+    void particleFilterSlam_deleteBcn(bcn_t* bcn);
 
 #ifdef __cplusplus
 } // extern "C"
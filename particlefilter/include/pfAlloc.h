@@ -0,0 +1,63 @@
+/*
+ * pfAlloc.h
+ * Created by slam3d contributors on 10/19/26.
+ *
+ * Copyright (c) 2026, Wireless Sensing and Embedded Systems Lab, Carnegie
+ * Mellon University
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-3-Clause license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#ifndef _PFALLOC_H
+#define _PFALLOC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "particleFilter.h"
+
+#define PF_ARENA_HUGE_TRANSPARENT   (0x1)   // advise the kernel to back chunks with huge pages
+#define PF_ARENA_HUGE_EXPLICIT      (0x2)   // map from the reserved huge page pool, else as above
+#define PF_ARENA_CHUNK              (2u << 20)
+#define PF_ARENA_CLASSES            (8)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    typedef struct
+    {
+        size_t size;
+        void* free;
+
+    } pfArenaClass_t;
+
+    // Carves PF_ALLOC_ALIGN aligned blocks out of 2 MB aligned chunks and
+    // keeps freed blocks on per-size lists for the next allocation of that
+    // size, so a pool of filters is recycled rather than returned to the
+    // heap. Chunks are only unmapped by pfArena_destroy(). Not thread-safe:
+    // use one arena per thread or lock around it
+    typedef struct
+    {
+        void* chunks;
+        uint8_t* next;
+        size_t left;
+        size_t mapped;
+        uint32_t flags;
+        pfArenaClass_t classes[PF_ARENA_CLASSES];
+
+    } pfArena_t;
+
+    void pfArena_init(pfArena_t* arena, uint32_t flags);
+    void pfArena_destroy(pfArena_t* arena);
+    void* pfArena_alloc(pfArena_t* arena, size_t size);
+    void pfArena_free(pfArena_t* arena, void* p, size_t size);
+    void pfArena_allocator(pfArena_t* arena, pfAllocator_t* allocator);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
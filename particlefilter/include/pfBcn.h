@@ -0,0 +1,252 @@
+/*
+ * pfBcn.h
+ * Created by slam3d contributors on 10/19/26.
+ *
+ * Copyright (c) 2026, Wireless Sensing and Embedded Systems Lab, Carnegie
+ * Mellon University
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-3-Clause license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#ifndef _PFBCN_H
+#define _PFBCN_H
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "particleFilter.h"
+
+#if defined(PF_COMPACT_BCN) && PF_COMPACT_BCN && defined(__F16C__)
+#include <immintrin.h>
+#endif
+
+// Beacon particles are only touched through these, so the kernels are the
+// same for both storage formats. Kernels work on an unpacked bcnParticle_t;
+// origin is the row's origin from pfBcn_origin()
+#if defined(PF_COMPACT_BCN) && PF_COMPACT_BCN
+
+#define PF_BCN_THETA_SCALE  (65536.0f / (2 * 3.14159265358979f))
+#define PF_BCN_LOGW_SCALE   (256.0f)
+#define PF_BCN_LOGW_ZERO    (INT16_MIN)
+
+typedef int32_t pfBcnScale_t;
+
+static inline uint16_t _pfBcn_toHalf(float f)
+{
+#if defined(__F16C__)
+    return (uint16_t)_cvtss_sh(f, 0);
+#else
+    uint32_t u, sign, mant;
+    int32_t e;
+
+    memcpy(&u, &f, sizeof(u));
+    sign = (u >> 16) & 0x8000u;
+    e = (int32_t)((u >> 23) & 0xff) - 127 + 15;
+    mant = u & 0x7fffffu;
+    if (e >= 31)
+        return (uint16_t)(sign | 0x7bffu);  // saturate, offsets never reach this
+    if (e <= 0)
+    {
+        if (e < -10)
+            return (uint16_t)sign;
+        mant |= 0x800000u;
+        mant = (mant >> (14 - e)) + ((mant >> (13 - e)) & 1u);
+        return (uint16_t)(sign | mant);
+    }
+    // Round to nearest; a carry out of the mantissa correctly bumps the exponent
+    return (uint16_t)(sign | (((uint32_t)e << 10) + (mant >> 13) + ((mant >> 12) & 1u)));
+#endif
+}
+
+static inline float _pfBcn_fromHalf(uint16_t h)
+{
+#if defined(__F16C__)
+    return _cvtsh_ss(h);
+#else
+    uint32_t u, mant;
+    int32_t e;
+    float f;
+
+    e = (h >> 10) & 0x1f;
+    mant = h & 0x3ffu;
+    if (e == 0)
+    {
+        f = ldexpf((float)mant, -24);
+        return (h & 0x8000u) ? -f : f;
+    }
+    u = ((uint32_t)(h & 0x8000u) << 16) | ((uint32_t)(e - 15 + 127) << 23) | (mant << 13);
+    memcpy(&f, &u, sizeof(f));
+    return f;
+#endif
+}
+
+static inline int16_t _pfBcn_clampLogW(int32_t q)
+{
+    return (int16_t)(q <= PF_BCN_LOGW_ZERO ? PF_BCN_LOGW_ZERO + 1 : (q > INT16_MAX ? INT16_MAX : q));
+}
+
+// Weights convert on every load and store, so exp2()/log2() are cubic and
+// quartic fits over one octave (errors 2e-4, under a 1/256 step) with the
+// octave going straight into the exponent bits
+static inline float _pfBcn_fromLogW(int16_t logW)
+{
+    int32_t q, e;
+    uint32_t u;
+    float f, w;
+
+    if (logW == PF_BCN_LOGW_ZERO)
+        return 0.0f;
+    q = (int32_t)logW + 32768;
+    e = (q >> 8) - 128;
+    if (e < -126)
+        return 0.0f;
+    f = (q & 255) * (1.0f / PF_BCN_LOGW_SCALE);
+    w = 1.0f + f * (0.69503617f + f * (0.22830825f + f * 0.07632546f));
+    memcpy(&u, &w, sizeof(u));
+    u = (uint32_t)((int32_t)u + e * (1 << 23));
+    memcpy(&w, &u, sizeof(w));
+    return w;
+}
+
+static inline int16_t _pfBcn_toLogW(float w)
+{
+    uint32_t u;
+    int32_t e;
+    float m, l;
+
+    if (!(w > 0.0f))
+        return PF_BCN_LOGW_ZERO;
+    memcpy(&u, &w, sizeof(u));
+    e = (int32_t)((u >> 23) & 0xff) - 127;
+    u = (u & 0x7fffffu) | 0x3f800000u;
+    memcpy(&m, &u, sizeof(m));
+    m -= 1.0f;
+    l = m * (1.43854793f + m * (-0.67808946f + m * (0.32364631f + m * -0.08429466f)));
+    return _pfBcn_clampLogW(e * 256 + (int32_t)(l * PF_BCN_LOGW_SCALE + 0.5f));
+}
+
+static inline float* pfBcn_origin(bcn_t* bcn, int row)
+{
+    return bcn->origin[row];
+}
+
+static inline const float* pfBcn_constOrigin(const bcn_t* bcn, int row)
+{
+    return bcn->origin[row];
+}
+
+static inline void pfBcn_setOrigin(bcn_t* bcn, int row, const float* origin)
+{
+    memcpy(bcn->origin[row], origin, sizeof(bcn->origin[row]));
+}
+
+static inline void pfBcn_load(bcnParticle_t* bp, const bcnStore_t* sp, const float* origin)
+{
+    bp->w = _pfBcn_fromLogW(sp->logW);
+    bp->x = origin[0] + _pfBcn_fromHalf(sp->x);
+    bp->y = origin[1] + _pfBcn_fromHalf(sp->y);
+    bp->z = origin[2] + _pfBcn_fromHalf(sp->z);
+    bp->theta = sp->theta * (1.0f / PF_BCN_THETA_SCALE);
+}
+
+static inline void pfBcn_loadXyz(float* x, float* y, float* z, const bcnStore_t* sp, const float* origin)
+{
+    *x = origin[0] + _pfBcn_fromHalf(sp->x);
+    *y = origin[1] + _pfBcn_fromHalf(sp->y);
+    *z = origin[2] + _pfBcn_fromHalf(sp->z);
+}
+
+// Headings may arrive in (-2pi, 2pi) from fmodf(), they wrap onto [0, 2pi)
+static inline void pfBcn_store(bcnStore_t* sp, const bcnParticle_t* bp, const float* origin)
+{
+    sp->logW = _pfBcn_toLogW(bp->w);
+    sp->theta = (uint16_t)lrintf(bp->theta * PF_BCN_THETA_SCALE);
+    sp->x = _pfBcn_toHalf(bp->x - origin[0]);
+    sp->y = _pfBcn_toHalf(bp->y - origin[1]);
+    sp->z = _pfBcn_toHalf(bp->z - origin[2]);
+}
+
+static inline float pfBcn_weight(const bcnStore_t* sp)
+{
+    return _pfBcn_fromLogW(sp->logW);
+}
+
+static inline pfBcnScale_t pfBcn_scale(float m)
+{
+    return (pfBcnScale_t)lrintf(log2f(m) * PF_BCN_LOGW_SCALE);
+}
+
+// Scaling a weight is an add in the log domain
+static inline void pfBcn_scaleWeight(bcnStore_t* sp, pfBcnScale_t scale)
+{
+    if (sp->logW != PF_BCN_LOGW_ZERO)
+        sp->logW = _pfBcn_clampLogW(sp->logW + scale);
+}
+
+#else
+
+typedef float pfBcnScale_t;
+
+static inline float* pfBcn_origin(bcn_t* bcn, int row)
+{
+    (void)bcn;
+    (void)row;
+    return NULL;
+}
+
+static inline const float* pfBcn_constOrigin(const bcn_t* bcn, int row)
+{
+    (void)bcn;
+    (void)row;
+    return NULL;
+}
+
+static inline void pfBcn_setOrigin(bcn_t* bcn, int row, const float* origin)
+{
+    (void)bcn;
+    (void)row;
+    (void)origin;
+}
+
+static inline void pfBcn_load(bcnParticle_t* bp, const bcnStore_t* sp, const float* origin)
+{
+    (void)origin;
+    *bp = *sp;
+}
+
+static inline void pfBcn_loadXyz(float* x, float* y, float* z, const bcnStore_t* sp, const float* origin)
+{
+    (void)origin;
+    *x = sp->x;
+    *y = sp->y;
+    *z = sp->z;
+}
+
+static inline void pfBcn_store(bcnStore_t* sp, const bcnParticle_t* bp, const float* origin)
+{
+    (void)origin;
+    *sp = *bp;
+}
+
+static inline float pfBcn_weight(const bcnStore_t* sp)
+{
+    return sp->w;
+}
+
+static inline pfBcnScale_t pfBcn_scale(float m)
+{
+    return m;
+}
+
+static inline void pfBcn_scaleWeight(bcnStore_t* sp, pfBcnScale_t scale)
+{
+    sp->w *= scale;
+}
+
+#endif
+
+#endif
@@ -0,0 +1,53 @@
+/*
+ * pfCpu.h
+ * Created by slam3d contributors on 10/19/26.
+ *
+ * Copyright (c) 2026, Wireless Sensing and Embedded Systems Lab, Carnegie
+ * Mellon University
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-3-Clause license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#ifndef _PFCPU_H
+#define _PFCPU_H
+
+#include <stdint.h>
+
+#include "particleFilter.h"
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define PF_CPU_X86          (1)
+#else
+#define PF_CPU_X86          (0)
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    // Kernels built once per instruction set in pfKernels.c. Every variant
+    // gives bit-identical results, only the speed differs
+    typedef struct
+    {
+        void (*ranges)(const tagParticle_t* tp, int n, float bx, float by, float bz, float* ranges);
+        void (*sphere)(uint32_t key, float lo, float hi, float* x, float* y, float* z, float* theta, int n);
+
+    } pfKernels_t;
+
+    extern const pfKernels_t pfKernels_scalar;
+#if PF_CPU_X86
+    extern const pfKernels_t pfKernels_sse42;
+    extern const pfKernels_t pfKernels_avx2;
+    extern const pfKernels_t pfKernels_avx512;
+#endif
+
+    void pfCpu_init(void);
+    const pfKernels_t* pfCpu_kernels(void);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
@@ -21,12 +21,12 @@ extern "C" {
 
     void pfInit_initTagLoc(particleFilterLoc_t* pf, float bx, float by, float bz, float range, float stdRange);
     void pfInit_initTagSlam(particleFilterSlam_t* pf);
-    void pfInit_initBcnSlam(bcn_t* bcn, const particleFilterSlam_t* pf, float range, float stdRange);
+    void pfInit_initBcnSlam(bcn_t* bcn, particleFilterSlam_t* pf, float range, float stdRange);
     void pfInit_spawnTagParticleZero(tagParticle_t* tp);
-    void pfInit_spawnTagParticleFromRange(tagParticle_t* tp, float bx, float by, float bz, float range, float stdRange);
-    void pfInit_spawnTagParticleFromOther(tagParticle_t* tp, const tagParticle_t* other, float hXyz, float hTheta);
-    void pfInit_spawnBcnParticleFromRange(bcnParticle_t* bp, const tagParticle_t* tp, float range, float stdRange);
-    void pfInit_spawnBcnParticleFromOther(bcnParticle_t* bp, const bcnParticle_t* other, float hXyz, float hTheta);
+    void pfInit_spawnTagParticleFromRange(unsigned int* seed, tagParticle_t* tp, float bx, float by, float bz, float range, float stdRange);
+    void pfInit_spawnTagParticleFromOther(unsigned int* seed, tagParticle_t* tp, const tagParticle_t* other, float hXyz, float hTheta);
+    void pfInit_spawnBcnParticleFromRange(unsigned int* seed, bcnParticle_t* bp, const tagParticle_t* tp, float range, float stdRange);
+    void pfInit_spawnBcnParticleFromOther(unsigned int* seed, bcnParticle_t* bp, const bcnParticle_t* other, float hXyz, float hTheta);
     
 #ifdef __cplusplus
 } // extern "C"
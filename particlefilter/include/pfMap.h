@@ -0,0 +1,80 @@
+/*
+ * pfMap.h
+ * Created by slam3d contributors on 10/19/26.
+ *
+ * Copyright (c) 2026, Wireless Sensing and Embedded Systems Lab, Carnegie
+ * Mellon University
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-3-Clause license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#ifndef _PFMAP_H
+#define _PFMAP_H
+
+#include <math.h>
+#include <stdint.h>
+
+#include "particleFilter.h"
+
+#define PF_MAP_MAX_STEPS    (64)    // cells looked at along one VIO step
+
+static inline uint32_t pfMap_word(const pfMap_t* map, int32_t ix, int32_t iy, int32_t iz)
+{
+    return (uint32_t)(((iz >> map->shift[2]) * map->bricks[1] + (iy >> map->shift[1])) * map->bricks[0] + (ix >> map->shift[0]));
+}
+
+static inline uint32_t pfMap_bit(const pfMap_t* map, int32_t ix, int32_t iy, int32_t iz)
+{
+    return ((uint32_t)(iz & ((1 << map->shift[2]) - 1)) << (map->shift[0] + map->shift[1])) |
+           ((uint32_t)(iy & ((1 << map->shift[1]) - 1)) << map->shift[0]) |
+           (uint32_t)(ix & ((1 << map->shift[0]) - 1));
+}
+
+static inline uint8_t pfMap_cell(const pfMap_t* map, int32_t ix, int32_t iy, int32_t iz)
+{
+    return (uint8_t)((map->bits[pfMap_word(map, ix, iy, iz)] >> pfMap_bit(map, ix, iy, iz)) & 1u);
+}
+
+// Comparing in float before the cast keeps far-off particles from
+// overflowing the cell index
+static inline uint8_t pfMap_occupied(const pfMap_t* map, float x, float y, float z)
+{
+    float fx, fy, fz;
+
+    fx = (x - map->origin[0]) * map->invCellSize;
+    fy = (y - map->origin[1]) * map->invCellSize;
+    if (!(fx >= 0.0f && fx < map->cells[0] && fy >= 0.0f && fy < map->cells[1]))
+        return 0;
+    if (map->cells[2] == 1)
+        return pfMap_cell(map, (int32_t)fx, (int32_t)fy, 0);
+    fz = (z - map->origin[2]) * map->invCellSize;
+    if (!(fz >= 0.0f && fz < map->cells[2]))
+        return 0;
+    return pfMap_cell(map, (int32_t)fx, (int32_t)fy, (int32_t)fz);
+}
+
+// Whether a step from (x0, y0, z0) to (x1, y1, z1) enters an occupied cell,
+// sampled at most a cell apart; only PF_MAP_MAX_STEPS points are looked at
+// on longer steps
+static inline uint8_t pfMap_crosses(const pfMap_t* map, float x0, float y0, float z0, float x1, float y1, float z1)
+{
+    int i, n;
+    float dx, dy, dz, d, f;
+
+    dx = x1 - x0;
+    dy = y1 - y0;
+    dz = z1 - z0;
+    d = fmaxf(fabsf(dx), fmaxf(fabsf(dy), fabsf(dz))) * map->invCellSize;
+    n = d < PF_MAP_MAX_STEPS - 1 ? (int)d + 1 : PF_MAP_MAX_STEPS;
+    for (i = 1; i <= n; ++i)
+    {
+        f = (float)i / n;
+        if (pfMap_occupied(map, x0 + dx * f, y0 + dy * f, z0 + dz * f))
+            return 1;
+    }
+    return 0;
+}
+
+#endif
@@ -21,9 +21,11 @@ extern "C" {
     
     void pfMeasurement_applyVioLoc(particleFilterLoc_t* pf, float dt, float dx, float dy, float dz, float ddist);
     void pfMeasurement_applyTagVioSlam(particleFilterSlam_t* pf, float dt, float dx, float dy, float dz, float ddist);
-    void pfMeasurement_applyBcnVioSlam(bcn_t* bcn, float dt, float dx, float dy, float dz, float ddist);
+    void pfMeasurement_applyBcnVioSlam(particleFilterSlam_t* pf, bcn_t* bcn, float dt, float dx, float dy, float dz, float ddist);
     void pfMeasurement_applyRangeLoc(particleFilterLoc_t* pf, float bx, float by, float bz, float range, float stdRange);
     void pfMeasurement_applyRangeSlam(particleFilterSlam_t* pf, bcn_t* bcn, float range, float stdRange);
+    void pfMeasurement_applyRssiLoc(particleFilterLoc_t* pf, float bx, float by, float bz, const pfRssiModel_t* model, int rssi);
+    void pfMeasurement_applyRssiSlam(particleFilterSlam_t* pf, bcn_t* bcn, const pfRssiModel_t* model, int rssi);
     
 #ifdef __cplusplus
 } // extern "C"
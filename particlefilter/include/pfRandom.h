@@ -13,6 +13,10 @@
 #ifndef _PFRANDOM_H
 #define _PFRANDOM_H
 
+#include <stdint.h>
+
+#define PF_RANDOM_BULK  (256)   // particles per pfRandom_sphereBulk() block in pfInit.c
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -20,10 +24,32 @@ extern "C" {
     extern unsigned int PF_SEED;
     extern int PF_SEED_SET;
     
-    void pfRandom_init(void);
-    float pfRandom_uniform(void);
-    void pfRandom_normal2(float* x, float* y);
-    void pfRandom_sphere(float* x, float* y, float* z, float range, float stdRange);
+    void pfRandom_init(unsigned int* seed);
+    float pfRandom_uniform(unsigned int* seed);
+    void pfRandom_normal2(unsigned int* seed, float* x, float* y);
+    void pfRandom_sphere(unsigned int* seed, float* x, float* y, float* z, float range, float stdRange);
+    void pfRandom_sphereBulk(unsigned int* seed, float* x, float* y, float* z, float* theta, int n, float range, float stdRange);
+    uint32_t pfRandom_key(unsigned int* seed);
+
+    // Counter-based draws, pfRandom_hash(key + counter) for a key from
+    // pfRandom_key(). Any counter can be drawn independently of the others,
+    // so loops using them vectorize and split across threads.
+    // lowbias32 integer hash (Chris Wellons), full avalanche on 32 bits
+    static inline uint32_t pfRandom_hash(uint32_t x)
+    {
+        x ^= x >> 16;
+        x *= 0x7feb352du;
+        x ^= x >> 15;
+        x *= 0x846ca68bu;
+        x ^= x >> 16;
+        return x;
+    }
+
+    // Uniform in [0, 1)
+    static inline float pfRandom_hashUniform(uint32_t x)
+    {
+        return (pfRandom_hash(x) >> 8) * (1.0f / 16777216.0f);
+    }
     
 #ifdef __cplusplus
 } // extern "C"
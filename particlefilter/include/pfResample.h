@@ -20,7 +20,9 @@ extern "C" {
 #endif
     
     void pfResample_resampleLoc(particleFilterLoc_t* pf, float bx, float by, float bz, float range, float stdRange);
+    void pfResample_resizeLoc(particleFilterLoc_t* pf, int numParticles);
     void pfResample_resampleSlam(particleFilterSlam_t* pf, bcn_t* bcn, float range, float stdRange, bcn_t** allBcns, int numBcns);
+    void pfResample_ancestors(uint8_t resampler, unsigned int* seed, const float* weights, float* weightCdf, int* ancestors, int n, float s);
     
 #ifdef __cplusplus
 } // extern "C"
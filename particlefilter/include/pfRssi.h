@@ -0,0 +1,58 @@
+/*
+ * pfRssi.h
+ * Created by slam3d contributors on 10/19/26.
+ *
+ * Copyright (c) 2026, Wireless Sensing and Embedded Systems Lab, Carnegie
+ * Mellon University
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-3-Clause license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#ifndef _PFRSSI_H
+#define _PFRSSI_H
+
+#include "pfBcn.h"
+#include "particleFilter.h"
+
+static inline int pfRssi_row(int rssi)
+{
+    if (rssi < PF_RSSI_MIN)
+        return 0;
+    if (rssi > PF_RSSI_MAX)
+        return PF_RSSI_MAX - PF_RSSI_MIN;
+    return rssi - PF_RSSI_MIN;
+}
+
+// Ranges past the table use its last bin
+static inline int pfRssi_bin(float range)
+{
+    int bin;
+
+    bin = (int)(range * (1.0f / PF_RSSI_BIN_SIZE));
+    return bin < PF_RSSI_BINS ? bin : PF_RSSI_BINS - 1;
+}
+
+// The likelihood as a tag weight factor, see pfWeight.h
+static inline float pfRssi_likelihood(const pfRssiModel_t* model, int row, int bin)
+{
+#if defined(PF_LOG_WEIGHTS) && PF_LOG_WEIGHTS
+    return model->lnLik[row][bin];
+#else
+    return model->lik[row][bin];
+#endif
+}
+
+// The likelihood as a beacon weight factor, already in log2 form for
+// compact beacons
+static inline pfBcnScale_t pfRssi_scale(const pfRssiModel_t* model, int row, int bin)
+{
+#if defined(PF_COMPACT_BCN) && PF_COMPACT_BCN
+    return model->logLik[row][bin];
+#else
+    return model->lik[row][bin];
+#endif
+}
+
+#endif
@@ -0,0 +1,70 @@
+/*
+ * pfStats.h
+ * Created by slam3d contributors on 10/19/26.
+ *
+ * Copyright (c) 2026, Wireless Sensing and Embedded Systems Lab, Carnegie
+ * Mellon University
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-3-Clause license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#ifndef _PFSTATS_H
+#define _PFSTATS_H
+
+#include <stdint.h>
+
+#include "particleFilter.h"
+#include "pfTrace.h"
+
+// Hot-path instrumentation is compiled in only with -DPF_ENABLE_STATS=1.
+// Otherwise every macro below expands to nothing and pfStats_t stays zeroed.
+// -DPF_ENABLE_TRACE=1 records each timed span to pfTrace as well, named
+// after its timer, with or without the stats
+#if defined(PF_ENABLE_STATS) && PF_ENABLE_STATS
+#define PF_STATS_TIME(stats, timer, span)   pfStats_end(&(stats)->timer, &span)
+#define PF_STATS_ADD(stats, counter, n)     ((stats)->counter += (uint64_t)(n))
+#define PF_STATS_WEIGHTS(stats, essN, sN)   pfStats_recordWeights(stats, essN, sN)
+#else
+#define PF_STATS_TIME(stats, timer, span)
+#define PF_STATS_ADD(stats, counter, n)
+#define PF_STATS_WEIGHTS(stats, essN, sN)
+#endif
+#if defined(PF_ENABLE_TRACE) && PF_ENABLE_TRACE
+#define PF_STATS_TRACE(timer, span)         pfTrace_record(#timer, (span).ns)
+#else
+#define PF_STATS_TRACE(timer, span)
+#endif
+#if (defined(PF_ENABLE_STATS) && PF_ENABLE_STATS) || (defined(PF_ENABLE_TRACE) && PF_ENABLE_TRACE)
+#define PF_STATS_BEGIN(span)                pfStatsSpan_t span; pfStats_begin(&span)
+#define PF_STATS_END(stats, timer, span)    do { PF_STATS_TIME(stats, timer, span); PF_STATS_TRACE(timer, span); } while (0)
+#else
+#define PF_STATS_BEGIN(span)
+#define PF_STATS_END(stats, timer, span)
+#endif
+
+// getTagLoc()/getBcnLoc() only take a const filter, the counters are mutable
+#define PF_STATS_MUTABLE(pf)                ((pfStats_t*)&(pf)->stats)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    typedef struct
+    {
+        uint64_t ns;
+        uint64_t cycles;
+
+    } pfStatsSpan_t;
+
+    void pfStats_reset(pfStats_t* stats);
+    void pfStats_begin(pfStatsSpan_t* span);
+    void pfStats_end(pfStatsTimer_t* timer, const pfStatsSpan_t* span);
+    void pfStats_recordWeights(pfStats_t* stats, float essN, float sN);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
@@ -0,0 +1,44 @@
+/*
+ * pfTrace.h
+ * Created by slam3d contributors on 10/19/26.
+ *
+ * Copyright (c) 2026, Wireless Sensing and Embedded Systems Lab, Carnegie
+ * Mellon University
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-3-Clause license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#ifndef _PFTRACE_H
+#define _PFTRACE_H
+
+#include <stdint.h>
+
+// Timeline of scoped spans, dumped as Chrome trace-event JSON for
+// chrome://tracing or ui.perfetto.dev. The library's own spans (commitVio,
+// applyRange, ess, resample, getLoc) are compiled in only with
+// -DPF_ENABLE_TRACE=1; applications can record theirs with pfTrace_now()
+// and pfTrace_record() in any build. Nothing is recorded outside
+// pfTrace_start() and pfTrace_stop().
+#define PF_TRACE_ARG_LEN        (24)    // of a span's argument, with the terminator
+#define PF_TRACE_NAME_LEN       (32)    // of a thread's name, with the terminator
+#define PF_TRACE_DEFAULT_LEN    (65536) // spans kept per thread
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    void pfTrace_start(uint32_t spansPerThread);
+    void pfTrace_stop(void);
+    uint64_t pfTrace_now(void);
+    void pfTrace_record(const char* name, uint64_t beginNs);
+    void pfTrace_setArg(const char* arg);
+    void pfTrace_setThreadName(const char* name);
+    uint8_t pfTrace_dump(const char* path);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
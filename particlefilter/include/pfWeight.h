@@ -0,0 +1,51 @@
+/*
+ * pfWeight.h
+ * Created by slam3d contributors on 10/19/26.
+ *
+ * Copyright (c) 2026, Wireless Sensing and Embedded Systems Lab, Carnegie
+ * Mellon University
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-3-Clause license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#ifndef _PFWEIGHT_H
+#define _PFWEIGHT_H
+
+#include <math.h>
+
+#include "particleFilter.h"
+
+// Tag particle weights are only touched through these. By default they are
+// plain floats. With -DPF_LOG_WEIGHTS=1 they are natural logs, so products of
+// likelihoods cannot underflow, and normalizing only records an offset in
+// pf->logW that the next measurement pass folds in (PF_WEIGHT_PASS_*) while
+// it finds the largest weight. Weights are read relative to that largest one
+#if defined(PF_LOG_WEIGHTS) && PF_LOG_WEIGHTS
+#define PF_WEIGHT_ONE                   (0.0f)
+#define PF_WEIGHT_FACTOR(f)             (logf(f))
+#define PF_WEIGHT_MUL(w, f)             ((w) + (f))
+#define PF_WEIGHT_PASS_BEGIN(pf, pass)  pfLogWeight_t pass = { -INFINITY, (pf)->logW.norm }
+#define PF_WEIGHT_PASS_FOLD(pass, w)    ((w) += (pass).norm)
+#define PF_WEIGHT_PASS_MAX(pass, w)     ((pass).max = fmaxf((pass).max, (w)))
+#define PF_WEIGHT_PASS_END(pf, pass)    ((pf)->logW.max = (pass).max, (pf)->logW.norm = 0.0f)
+#define PF_WEIGHT_VALUE(pf, w)          (expf((w) - (pf)->logW.max))
+#define PF_WEIGHT_MEAN(pf, sN)          ((sN) * expf((pf)->logW.max + (pf)->logW.norm))
+#define PF_WEIGHT_NORMALIZE(pf, n, m)   ((pf)->logW.norm = logf(m) - (pf)->logW.max)
+#define PF_WEIGHT_RESET(pf)             ((pf)->logW.max = 0.0f, (pf)->logW.norm = 0.0f)
+#else
+#define PF_WEIGHT_ONE                   (1.0f)
+#define PF_WEIGHT_FACTOR(f)             (f)
+#define PF_WEIGHT_MUL(w, f)             ((w) * (f))
+#define PF_WEIGHT_PASS_BEGIN(pf, pass)
+#define PF_WEIGHT_PASS_FOLD(pass, w)
+#define PF_WEIGHT_PASS_MAX(pass, w)
+#define PF_WEIGHT_PASS_END(pf, pass)
+#define PF_WEIGHT_VALUE(pf, w)          (w)
+#define PF_WEIGHT_MEAN(pf, sN)          (sN)
+#define PF_WEIGHT_NORMALIZE(pf, n, m)   do { int _i; for (_i = 0; _i < (n); ++_i) (pf)->pTag[_i].w *= (m); } while (0)
+#define PF_WEIGHT_RESET(pf)
+#endif
+
+#endif
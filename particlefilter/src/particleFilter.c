@@ -12,16 +12,25 @@
 
 #include <math.h>
 #include <stdint.h>
+#include <string.h>
 
 #include "particleFilter.h"
+#include "pfBcn.h"
+#include "pfCpu.h"
 #include "pfInit.h"
 #include "pfMeasurement.h"
 #include "pfRandom.h"
 #include "pfResample.h"
+#include "pfRssi.h"
+#include "pfStats.h"
+#include "pfWeight.h"
+
+#define RSSI_RANGE          (1.5f)
+#define RSSI_STD_RANGE      (0.5f)
 
 static void _commitVioLoc(particleFilterLoc_t* pf);
 static void _commitTagVioSlam(particleFilterSlam_t* pf);
-static void _commitBcnVioSlam(bcn_t* bcn);
+static void _commitBcnVioSlam(particleFilterSlam_t* pf, bcn_t* bcn);
 
 void particleFilterSeed_set(unsigned int seed)
 {
@@ -41,7 +50,13 @@ void particleFilterLoc_init(particleFilterLoc_t* pf)
     pf->lastY = 0.0f;
     pf->lastZ = 0.0f;
     pf->lastDist = 0.0f;
-    pfRandom_init();
+    pfStats_reset(&pf->stats);
+    pfRandom_init(&pf->seed);
+    pf->map = NULL;
+    pf->resampler = PF_RESAMPLE_SYSTEMATIC;
+    pf->numParticles = PF_N_TAG_LOC;
+    PF_WEIGHT_RESET(pf);
+    pfCpu_init();
     pf->initialized = 0;
 }
 
@@ -57,13 +72,17 @@ void particleFilterSlam_init(particleFilterSlam_t* pf)
     pf->lastY = 0.0f;
     pf->lastZ = 0.0f;
     pf->lastDist = 0.0f;
-    pfRandom_init();
+    pfStats_reset(&pf->stats);
+    pfRandom_init(&pf->seed);
+    pf->resampler = PF_RESAMPLE_SYSTEMATIC;
+    pfCpu_init();
     pfInit_initTagSlam(pf);
     pf->initialized = 1;
 }
 
 void particleFilterSlam_addBcn(bcn_t* bcn)
 {
+    bcn->rssiModel = NULL;
     bcn->initialized = 0;
 }
 
@@ -177,11 +196,17 @@ void particleFilterSlam_depositBcnVio(bcn_t* bcn, double t, float x, float y, fl
 
 void particleFilterLoc_depositRange(particleFilterLoc_t* pf, float bx, float by, float bz, float range, float stdRange)
 {
+    PF_STATS_BEGIN(span);
     _commitVioLoc(pf);
+    PF_STATS_END(&pf->stats, commitVio, span);
     if (pf->initialized)
     {
+        PF_STATS_BEGIN(applySpan);
         pfMeasurement_applyRangeLoc(pf, bx, by, bz, range, stdRange);
+        PF_STATS_END(&pf->stats, applyRange, applySpan);
+        PF_STATS_BEGIN(resampleSpan);
         pfResample_resampleLoc(pf, bx, by, bz, range, stdRange);
+        PF_STATS_END(&pf->stats, resample, resampleSpan);
     }
     else
     {
@@ -194,14 +219,20 @@ void particleFilterSlam_depositRange(particleFilterSlam_t* pf, bcn_t* bcn, float
 {
     int i;
 
+    PF_STATS_BEGIN(span);
     _commitTagVioSlam(pf);
     for (i = 0; i < numBcns; ++i)
-        _commitBcnVioSlam(allBcns[i]);
+        _commitBcnVioSlam(pf, allBcns[i]);
+    PF_STATS_END(&pf->stats, commitVio, span);
 
     if (bcn->initialized)
     {
+        PF_STATS_BEGIN(applySpan);
         pfMeasurement_applyRangeSlam(pf, bcn, range, stdRange);
+        PF_STATS_END(&pf->stats, applyRange, applySpan);
+        PF_STATS_BEGIN(resampleSpan);
         pfResample_resampleSlam(pf, bcn, range, stdRange, allBcns, numBcns);
+        PF_STATS_END(&pf->stats, resample, resampleSpan);
     }
     else
     {
@@ -210,37 +241,73 @@ void particleFilterSlam_depositRange(particleFilterSlam_t* pf, bcn_t* bcn, float
     }
 }
 
+// Without a calibration the reading only says the tag is near the beacon
 void particleFilterLoc_depositRssi(particleFilterLoc_t* pf, float bx, float by, float bz, int rssi)
 {
+    particleFilterLoc_depositCalibratedRssi(pf, bx, by, bz, rssi, NULL);
+}
+
+void particleFilterLoc_depositCalibratedRssi(particleFilterLoc_t* pf, float bx, float by, float bz, int rssi, const pfRssiModel_t* model)
+{
+    int row;
+    float range, stdRange;
+
+    row = pfRssi_row(rssi);
+    range = model != NULL ? model->range[row] : RSSI_RANGE;
+    stdRange = model != NULL ? model->stdRange[row] : RSSI_STD_RANGE;
+
+    PF_STATS_BEGIN(span);
     _commitVioLoc(pf);
+    PF_STATS_END(&pf->stats, commitVio, span);
     if (pf->initialized)
     {
-        pfMeasurement_applyRangeLoc(pf, bx, by, bz, 1.5f, 0.5f);
-        pfResample_resampleLoc(pf, bx, by, bz, 1.5f, 0.5f);
+        PF_STATS_BEGIN(applySpan);
+        if (model != NULL)
+            pfMeasurement_applyRssiLoc(pf, bx, by, bz, model, rssi);
+        else
+            pfMeasurement_applyRangeLoc(pf, bx, by, bz, range, stdRange);
+        PF_STATS_END(&pf->stats, applyRange, applySpan);
+        PF_STATS_BEGIN(resampleSpan);
+        pfResample_resampleLoc(pf, bx, by, bz, range, stdRange);
+        PF_STATS_END(&pf->stats, resample, resampleSpan);
     }
     else
     {
-        pfInit_initTagLoc(pf, bx, by, bz, 1.5f, 0.5f);
+        pfInit_initTagLoc(pf, bx, by, bz, range, stdRange);
         pf->initialized = 1;
     }
 }
 
 void particleFilterSlam_depositRssi(particleFilterSlam_t* pf, bcn_t* bcn, int rssi, bcn_t** allBcns, int numBcns)
 {
-    int i;
+    int i, row;
+    float range, stdRange;
+
+    row = pfRssi_row(rssi);
+    range = bcn->rssiModel != NULL ? bcn->rssiModel->range[row] : RSSI_RANGE;
+    stdRange = bcn->rssiModel != NULL ? bcn->rssiModel->stdRange[row] : RSSI_STD_RANGE;
 
+    PF_STATS_BEGIN(span);
     _commitTagVioSlam(pf);
     for (i = 0; i < numBcns; ++i)
-        _commitBcnVioSlam(allBcns[i]);
+        _commitBcnVioSlam(pf, allBcns[i]);
+    PF_STATS_END(&pf->stats, commitVio, span);
 
     if (bcn->initialized)
     {
-        pfMeasurement_applyRangeSlam(pf, bcn, 1.5f, 0.5f);
-        pfResample_resampleSlam(pf, bcn, 1.5f, 0.5f, allBcns, numBcns);
+        PF_STATS_BEGIN(applySpan);
+        if (bcn->rssiModel != NULL)
+            pfMeasurement_applyRssiSlam(pf, bcn, bcn->rssiModel, rssi);
+        else
+            pfMeasurement_applyRangeSlam(pf, bcn, range, stdRange);
+        PF_STATS_END(&pf->stats, applyRange, applySpan);
+        PF_STATS_BEGIN(resampleSpan);
+        pfResample_resampleSlam(pf, bcn, range, stdRange, allBcns, numBcns);
+        PF_STATS_END(&pf->stats, resample, resampleSpan);
     }
     else
     {
-        pfInit_initBcnSlam(bcn, pf, 1.5f, 0.5f);
+        pfInit_initBcnSlam(bcn, pf, range, stdRange);
         bcn->initialized = 1;
     }
 }
@@ -254,16 +321,17 @@ uint8_t particleFilterLoc_getTagLoc(const particleFilterLoc_t* pf, double* t, fl
     if (!pf->initialized)
         return 0;
 
+    PF_STATS_BEGIN(span);
     s = 0.0f;
     xsum = 0.0f;
     ysum = 0.0f;
     zsum = 0.0f;
     csum = 0.0f;
     ssum = 0.0f;
-    for (i = 0; i < PF_N_TAG_LOC; ++i)
+    for (i = 0; i < pf->numParticles; ++i)
     {
         tp = &pf->pTag[i];
-        w = tp->w;
+        w = PF_WEIGHT_VALUE(pf, tp->w);
         s += w;
         xsum += w * tp->x;
         ysum += w * tp->y;
@@ -286,6 +354,7 @@ uint8_t particleFilterLoc_getTagLoc(const particleFilterLoc_t* pf, double* t, fl
     *x += dx * co - dy * si;
     *y += dx * si + dy * co;
     *z += dz;
+    PF_STATS_END(PF_STATS_MUTABLE(pf), getLoc, span);
 
     return 1;
 }
@@ -299,6 +368,7 @@ uint8_t particleFilterSlam_getTagLoc(const particleFilterSlam_t* pf, double* t,
     if (!pf->initialized)
         return 0;
 
+    PF_STATS_BEGIN(span);
     s = 0.0f;
     xsum = 0.0f;
     ysum = 0.0f;
@@ -308,7 +378,7 @@ uint8_t particleFilterSlam_getTagLoc(const particleFilterSlam_t* pf, double* t,
     for (i = 0; i < PF_N_TAG_SLAM; ++i)
     {
         tp = &pf->pTag[i];
-        w = tp->w;
+        w = PF_WEIGHT_VALUE(pf, tp->w);
         s += w;
         xsum += w * tp->x;
         ysum += w * tp->y;
@@ -331,6 +401,7 @@ uint8_t particleFilterSlam_getTagLoc(const particleFilterSlam_t* pf, double* t,
     *x += dx * co - dy * si;
     *y += dx * si + dy * co;
     *z += dz;
+    PF_STATS_END(PF_STATS_MUTABLE(pf), getLoc, span);
 
     return 1;
 }
@@ -338,12 +409,14 @@ uint8_t particleFilterSlam_getTagLoc(const particleFilterSlam_t* pf, double* t,
 uint8_t particleFilterSlam_getBcnLoc(const particleFilterSlam_t* pf, const bcn_t* bcn, double* t, float* x, float* y, float* z, float* theta)
 {
     int i, j;
-    const bcnParticle_t* bp;
+    bcnParticle_t bp;
+    const float* origin;
     float w1, w2, s1, s2, xsum1, xsum2, ysum1, ysum2, zsum1, zsum2, csum1, csum2, ssum1, ssum2;
     
     if (!bcn->initialized)
         return 0;
     
+    PF_STATS_BEGIN(span);
     s1 = 0.0f;
     xsum1 = 0.0f;
     ysum1 = 0.0f;
@@ -352,7 +425,7 @@ uint8_t particleFilterSlam_getBcnLoc(const particleFilterSlam_t* pf, const bcn_t
     ssum1 = 0.0f;
     for (i = 0; i < PF_N_TAG_SLAM; ++i)
     {
-        w1 = pf->pTag[i].w;
+        w1 = PF_WEIGHT_VALUE(pf, pf->pTag[i].w);
         s1 += w1;
         s2 = 0.0f;
         xsum2 = 0.0f;
@@ -360,16 +433,17 @@ uint8_t particleFilterSlam_getBcnLoc(const particleFilterSlam_t* pf, const bcn_t
         zsum2 = 0.0f;
         csum2 = 0.0f;
         ssum2 = 0.0f;
+        origin = pfBcn_constOrigin(bcn, i);
         for (j = 0; j < PF_N_BCN; ++j)
         {
-            bp = &bcn->pBcn[i][j];
-            w2 = bp->w;
+            pfBcn_load(&bp, &bcn->pBcn[i][j], origin);
+            w2 = bp.w;
             s2 += w2;
-            xsum2 += w2 * bp->x;
-            ysum2 += w2 * bp->y;
-            zsum2 += w2 * bp->z;
-            csum2 += w2 * cosf(bp->theta);
-            ssum2 += w2 * sinf(bp->theta);
+            xsum2 += w2 * bp.x;
+            ysum2 += w2 * bp.y;
+            zsum2 += w2 * bp.z;
+            csum2 += w2 * cosf(bp.theta);
+            ssum2 += w2 * sinf(bp.theta);
         }
         xsum1 += w1 * xsum2 / s2;
         ysum1 += w1 * ysum2 / s2;
@@ -382,8 +456,75 @@ uint8_t particleFilterSlam_getBcnLoc(const particleFilterSlam_t* pf, const bcn_t
     *y = ysum1 / s1;
     *z = zsum1 / s1;
     *theta = atan2f(ssum1, csum1);
+    PF_STATS_END(PF_STATS_MUTABLE(pf), getLoc, span);
+
+    return 1;
+}
 
+uint8_t particleFilterLoc_getStats(const particleFilterLoc_t* pf, pfStats_t* stats)
+{
+    memcpy(stats, &pf->stats, sizeof(pfStats_t));
+#if defined(PF_ENABLE_STATS) && PF_ENABLE_STATS
+    return 1;
+#else
+    return 0;
+#endif
+}
+
+uint8_t particleFilterSlam_getStats(const particleFilterSlam_t* pf, pfStats_t* stats)
+{
+    memcpy(stats, &pf->stats, sizeof(pfStats_t));
+#if defined(PF_ENABLE_STATS) && PF_ENABLE_STATS
     return 1;
+#else
+    return 0;
+#endif
+}
+
+void particleFilterLoc_resetStats(particleFilterLoc_t* pf)
+{
+    pfStats_reset(&pf->stats);
+}
+
+void particleFilterSlam_resetStats(particleFilterSlam_t* pf)
+{
+    pfStats_reset(&pf->stats);
+}
+
+// Every scheme draws children in proportion to weight; the others change the
+// random stream, so only PF_RESAMPLE_SYSTEMATIC reproduces earlier results
+void particleFilterLoc_setResampler(particleFilterLoc_t* pf, pfResampler_t resampler)
+{
+    pf->resampler = (uint8_t)resampler;
+}
+
+// Runs the filter on fewer particles than PF_N_TAG_LOC, to trade accuracy
+// for time under load, or back up to at most PF_N_TAG_LOC. An initialized
+// filter draws the new set from the old, see pfResample_resizeLoc().
+// Returns the count in use, numParticles clamped to [1, PF_N_TAG_LOC]
+int particleFilterLoc_setNumParticles(particleFilterLoc_t* pf, int numParticles)
+{
+    numParticles = numParticles < 1 ? 1 : (numParticles > PF_N_TAG_LOC ? PF_N_TAG_LOC : numParticles);
+    if (numParticles == pf->numParticles)
+        return numParticles;
+    if (pf->initialized)
+        pfResample_resizeLoc(pf, numParticles);
+    else
+        pf->numParticles = numParticles;
+    return numParticles;
+}
+
+// Applies to the tag particles and every beacon's rows
+void particleFilterSlam_setResampler(particleFilterSlam_t* pf, pfResampler_t resampler)
+{
+    pf->resampler = (uint8_t)resampler;
+}
+
+// The model is not copied and must outlive the beacon. NULL, the default
+// from particleFilterSlam_addBcn(), treats readings as proximity only
+void particleFilterSlam_setBcnRssiModel(bcn_t* bcn, const pfRssiModel_t* model)
+{
+    bcn->rssiModel = model;
 }
 
 static void _commitVioLoc(particleFilterLoc_t* pf)
@@ -420,7 +561,7 @@ static void _commitTagVioSlam(particleFilterSlam_t* pf)
     pfMeasurement_applyTagVioSlam(pf, dt, dx, dy, dz, ddist);
 }
 
-static void _commitBcnVioSlam(bcn_t* bcn)
+static void _commitBcnVioSlam(particleFilterSlam_t* pf, bcn_t* bcn)
 {
     float dt, dx, dy, dz, ddist;
 
@@ -434,5 +575,5 @@ static void _commitBcnVioSlam(bcn_t* bcn)
     bcn->firstY = bcn->lastY;
     bcn->firstZ = bcn->lastZ;
     bcn->firstDist = bcn->lastDist;
-    pfMeasurement_applyBcnVioSlam(bcn, dt, dx, dy, dz, ddist);
+    pfMeasurement_applyBcnVioSlam(pf, bcn, dt, dx, dy, dz, ddist);
 }
@@ -0,0 +1,308 @@
+/*
+ * pfAlloc.c
+ * Created by slam3d contributors on 10/19/26.
+ *
+ * Copyright (c) 2026, Wireless Sensing and Embedded Systems Lab, Carnegie
+ * Mellon University
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-3-Clause license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#if !defined(_WIN32) && !defined(_DEFAULT_SOURCE)
+#define _DEFAULT_SOURCE
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_WIN32)
+#include <malloc.h>
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+#include "particleFilter.h"
+#include "pfAlloc.h"
+
+#define ROUND_UP(n, a)      (((n) + (a) - 1) / (a) * (a))
+#define CHUNK_HEADER        ROUND_UP(sizeof(_chunk_t), PF_ALLOC_ALIGN)
+
+typedef struct _chunk_s
+{
+    struct _chunk_s* next;
+    size_t size;
+
+} _chunk_t;
+
+static void* _heapAlloc(void* ctx, size_t size, size_t align);
+static void _heapFree(void* ctx, void* p, size_t size);
+static void* _arenaAlloc(void* ctx, size_t size, size_t align);
+static void _arenaFree(void* ctx, void* p, size_t size);
+static pfArenaClass_t* _class(pfArena_t* arena, size_t size, uint8_t create);
+static void* _mapChunk(size_t size, uint32_t flags);
+static void _unmapChunk(void* p, size_t size);
+
+static pfAllocator_t _allocator = { _heapAlloc, _heapFree, NULL };
+
+// NULL restores the default, aligned heap blocks. Filters must be deleted
+// with the allocator they were made with
+void particleFilterAllocator_set(const pfAllocator_t* allocator)
+{
+    if (allocator != NULL)
+        _allocator = *allocator;
+    else
+    {
+        _allocator.alloc = _heapAlloc;
+        _allocator.free = _heapFree;
+        _allocator.ctx = NULL;
+    }
+}
+
+particleFilterLoc_t* particleFilterLoc_new(void)
+{
+    particleFilterLoc_t* pf;
+
+    pf = (particleFilterLoc_t*)_allocator.alloc(_allocator.ctx, sizeof(particleFilterLoc_t), PF_ALLOC_ALIGN);
+    if (pf != NULL)
+        particleFilterLoc_init(pf);
+    return pf;
+}
+
+particleFilterSlam_t* particleFilterSlam_new(void)
+{
+    particleFilterSlam_t* pf;
+
+    pf = (particleFilterSlam_t*)_allocator.alloc(_allocator.ctx, sizeof(particleFilterSlam_t), PF_ALLOC_ALIGN);
+    if (pf != NULL)
+        particleFilterSlam_init(pf);
+    return pf;
+}
+
+bcn_t* particleFilterSlam_newBcn(void)
+{
+    bcn_t* bcn;
+
+    bcn = (bcn_t*)_allocator.alloc(_allocator.ctx, sizeof(bcn_t), PF_ALLOC_ALIGN);
+    if (bcn != NULL)
+        particleFilterSlam_addBcn(bcn);
+    return bcn;
+}
+
+void particleFilterLoc_delete(particleFilterLoc_t* pf)
+{
+    if (pf != NULL)
+        _allocator.free(_allocator.ctx, pf, sizeof(particleFilterLoc_t));
+}
+
+void particleFilterSlam_delete(particleFilterSlam_t* pf)
+{
+    if (pf != NULL)
+        _allocator.free(_allocator.ctx, pf, sizeof(particleFilterSlam_t));
+}
+
+void particleFilterSlam_deleteBcn(bcn_t* bcn)
+{
+    if (bcn != NULL)
+        _allocator.free(_allocator.ctx, bcn, sizeof(bcn_t));
+}
+
+void pfArena_init(pfArena_t* arena, uint32_t flags)
+{
+    memset(arena, 0, sizeof(pfArena_t));
+    arena->flags = flags;
+}
+
+void pfArena_destroy(pfArena_t* arena)
+{
+    _chunk_t* chunk;
+    _chunk_t* next;
+
+    for (chunk = (_chunk_t*)arena->chunks; chunk != NULL; chunk = next)
+    {
+        next = chunk->next;
+        _unmapChunk(chunk, chunk->size);
+    }
+    pfArena_init(arena, arena->flags);
+}
+
+void* pfArena_alloc(pfArena_t* arena, size_t size)
+{
+    pfArenaClass_t* c;
+    _chunk_t* chunk;
+    size_t chunkSize;
+    uint8_t* p;
+
+    size = size > 0 ? ROUND_UP(size, PF_ALLOC_ALIGN) : PF_ALLOC_ALIGN;
+    c = _class(arena, size, 0);
+    if (c != NULL && c->free != NULL)
+    {
+        p = (uint8_t*)c->free;
+        c->free = *(void**)p;
+        return p;
+    }
+
+    if (arena->left >= size)
+    {
+        p = arena->next;
+        arena->next += size;
+        arena->left -= size;
+        return p;
+    }
+
+    chunkSize = ROUND_UP(CHUNK_HEADER + size, PF_ARENA_CHUNK);
+    chunk = (_chunk_t*)_mapChunk(chunkSize, arena->flags);
+    if (chunk == NULL)
+        return NULL;
+    chunk->next = (_chunk_t*)arena->chunks;
+    chunk->size = chunkSize;
+    arena->chunks = chunk;
+    arena->mapped += chunkSize;
+
+    // Carry on from whichever chunk has more room left
+    p = (uint8_t*)chunk + CHUNK_HEADER;
+    if (chunkSize - CHUNK_HEADER - size > arena->left)
+    {
+        arena->next = p + size;
+        arena->left = chunkSize - CHUNK_HEADER - size;
+    }
+    return p;
+}
+
+// Blocks of more than PF_ARENA_CLASSES distinct sizes are not reused, they
+// are reclaimed by pfArena_destroy()
+void pfArena_free(pfArena_t* arena, void* p, size_t size)
+{
+    pfArenaClass_t* c;
+
+    if (p == NULL)
+        return;
+    size = size > 0 ? ROUND_UP(size, PF_ALLOC_ALIGN) : PF_ALLOC_ALIGN;
+    c = _class(arena, size, 1);
+    if (c == NULL)
+        return;
+    *(void**)p = c->free;
+    c->free = p;
+}
+
+// Fills allocator with hooks that allocate from arena, for
+// particleFilterAllocator_set()
+void pfArena_allocator(pfArena_t* arena, pfAllocator_t* allocator)
+{
+    allocator->alloc = _arenaAlloc;
+    allocator->free = _arenaFree;
+    allocator->ctx = arena;
+}
+
+static void* _heapAlloc(void* ctx, size_t size, size_t align)
+{
+    (void)ctx;
+#if defined(_WIN32)
+    return _aligned_malloc(size, align);
+#else
+    void* p;
+
+    return posix_memalign(&p, align, size) == 0 ? p : NULL;
+#endif
+}
+
+static void _heapFree(void* ctx, void* p, size_t size)
+{
+    (void)ctx;
+    (void)size;
+#if defined(_WIN32)
+    _aligned_free(p);
+#else
+    free(p);
+#endif
+}
+
+static void* _arenaAlloc(void* ctx, size_t size, size_t align)
+{
+    if (align > PF_ALLOC_ALIGN)
+        return NULL;
+    return pfArena_alloc((pfArena_t*)ctx, size);
+}
+
+static void _arenaFree(void* ctx, void* p, size_t size)
+{
+    pfArena_free((pfArena_t*)ctx, p, size);
+}
+
+static pfArenaClass_t* _class(pfArena_t* arena, size_t size, uint8_t create)
+{
+    int i;
+
+    for (i = 0; i < PF_ARENA_CLASSES && arena->classes[i].size != 0; ++i)
+        if (arena->classes[i].size == size)
+            return &arena->classes[i];
+    if (!create || i == PF_ARENA_CLASSES)
+        return NULL;
+    arena->classes[i].size = size;
+    arena->classes[i].free = NULL;
+    return &arena->classes[i];
+}
+
+// Chunks start on a 2 MB boundary, the size of a huge page on x86-64 and
+// arm64, so the kernel can back them with huge pages when asked to
+static void* _mapChunk(size_t size, uint32_t flags)
+{
+#if defined(_WIN32)
+    void* p;
+    SIZE_T large;
+
+    // Large pages need the "Lock pages in memory" privilege, without it
+    // this fails and the chunk gets normal pages
+    large = GetLargePageMinimum();
+    if ((flags & PF_ARENA_HUGE_EXPLICIT) && large > 0 && size % large == 0)
+    {
+        p = VirtualAlloc(NULL, size, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+        if (p != NULL)
+            return p;
+    }
+    return VirtualAlloc(NULL, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+#else
+    void* p;
+    uint8_t* base;
+    size_t lead;
+
+#if defined(MAP_HUGETLB)
+    if (flags & PF_ARENA_HUGE_EXPLICIT)
+    {
+        p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (p != MAP_FAILED)
+            return p;
+    }
+#endif
+
+    // Over-map by a chunk and trim both ends to get the alignment
+    p = mmap(NULL, size + PF_ARENA_CHUNK, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED)
+        return NULL;
+    base = (uint8_t*)(((uintptr_t)p + PF_ARENA_CHUNK - 1) & ~(uintptr_t)(PF_ARENA_CHUNK - 1));
+    lead = (size_t)(base - (uint8_t*)p);
+    if (lead > 0)
+        munmap(p, lead);
+    if (PF_ARENA_CHUNK - lead > 0)
+        munmap(base + size, PF_ARENA_CHUNK - lead);
+#if defined(MADV_HUGEPAGE)
+    if (flags & (PF_ARENA_HUGE_TRANSPARENT | PF_ARENA_HUGE_EXPLICIT))
+        madvise(base, size, MADV_HUGEPAGE);
+#endif
+    return base;
+#endif
+}
+
+static void _unmapChunk(void* p, size_t size)
+{
+#if defined(_WIN32)
+    (void)size;
+    VirtualFree(p, 0, MEM_RELEASE);
+#else
+    munmap(p, size);
+#endif
+}
@@ -0,0 +1,235 @@
+/*
+ * pfCheckpoint.c
+ * Created by slam3d contributors on 10/19/26.
+ *
+ * Copyright (c) 2026, Wireless Sensing and Embedded Systems Lab, Carnegie
+ * Mellon University
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-3-Clause license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "particleFilter.h"
+
+#define KIND_LOC            (1)
+#define KIND_SLAM           (2)
+#define KIND_BCN            (3)
+#define PARTICLE_OFFSET     ((sizeof(pfCheckpoint_t) + PF_CHECKPOINT_ALIGN - 1) / PF_CHECKPOINT_ALIGN * PF_CHECKPOINT_ALIGN)
+
+// Compact beacons also need their row origins, stored after the particles
+#if defined(PF_COMPACT_BCN) && PF_COMPACT_BCN
+#define BCN_ORIGIN_SIZE     (sizeof(((bcn_t*)0)->origin))
+#else
+#define BCN_ORIGIN_SIZE     (0)
+#endif
+
+// The anchor fields are laid out identically in all three structs
+#define CHECKPOINT_SAVE(ck, pf)     do { \
+        (ck)->initialized = (pf)->initialized; \
+        (ck)->firstT = (pf)->firstT; \
+        (ck)->firstX = (pf)->firstX; \
+        (ck)->firstY = (pf)->firstY; \
+        (ck)->firstZ = (pf)->firstZ; \
+        (ck)->firstDist = (pf)->firstDist; \
+        (ck)->lastT = (pf)->lastT; \
+        (ck)->lastX = (pf)->lastX; \
+        (ck)->lastY = (pf)->lastY; \
+        (ck)->lastZ = (pf)->lastZ; \
+        (ck)->lastDist = (pf)->lastDist; \
+    } while (0)
+#define CHECKPOINT_LOAD(pf, ck)     do { \
+        (pf)->initialized = (ck)->initialized; \
+        (pf)->firstT = (ck)->firstT; \
+        (pf)->firstX = (ck)->firstX; \
+        (pf)->firstY = (ck)->firstY; \
+        (pf)->firstZ = (ck)->firstZ; \
+        (pf)->firstDist = (ck)->firstDist; \
+        (pf)->lastT = (ck)->lastT; \
+        (pf)->lastX = (ck)->lastX; \
+        (pf)->lastY = (ck)->lastY; \
+        (pf)->lastZ = (ck)->lastZ; \
+        (pf)->lastDist = (ck)->lastDist; \
+    } while (0)
+
+// Log weights keep their pending normalization, and only restore into a
+// build that also uses them
+#if defined(PF_LOG_WEIGHTS) && PF_LOG_WEIGHTS
+#define LOG_WEIGHTS         (1)
+#define LOG_WEIGHTS_SAVE(ck, pf)    ((ck)->logWMax = (pf)->logW.max, (ck)->logWNorm = (pf)->logW.norm)
+#define LOG_WEIGHTS_LOAD(pf, ck)    ((pf)->logW.max = (ck)->logWMax, (pf)->logW.norm = (ck)->logWNorm)
+#else
+#define LOG_WEIGHTS         (0)
+#define LOG_WEIGHTS_SAVE(ck, pf)
+#define LOG_WEIGHTS_LOAD(pf, ck)
+#endif
+
+static pfCheckpoint_t* _begin(void* buf, size_t len, uint16_t kind, uint32_t numParticles, uint32_t particleSize);
+static const pfCheckpoint_t* _check(const void* buf, size_t len, uint16_t kind, uint32_t numParticles, uint32_t particleSize);
+
+size_t particleFilterLoc_checkpointSize(void)
+{
+    return PARTICLE_OFFSET + sizeof(tagParticle_t) * PF_N_TAG_LOC;
+}
+
+size_t particleFilterSlam_checkpointSize(void)
+{
+    return PARTICLE_OFFSET + sizeof(tagParticle_t) * PF_N_TAG_SLAM;
+}
+
+size_t particleFilterSlam_checkpointBcnSize(void)
+{
+    return PARTICLE_OFFSET + sizeof(bcnStore_t) * PF_N_TAG_SLAM * PF_N_BCN + BCN_ORIGIN_SIZE;
+}
+
+// Returns the number of bytes written, 0 if len is too small
+size_t particleFilterLoc_checkpoint(const particleFilterLoc_t* pf, void* buf, size_t len)
+{
+    pfCheckpoint_t* ck;
+    int i, n;
+
+    ck = _begin(buf, len, KIND_LOC, PF_N_TAG_LOC, sizeof(tagParticle_t));
+    if (ck == NULL)
+        return 0;
+    ck->seed = pf->seed;
+    CHECKPOINT_SAVE(ck, pf);
+    ck->logWeights = LOG_WEIGHTS;
+    LOG_WEIGHTS_SAVE(ck, pf);
+
+    // A filter running on fewer particles is saved with them repeated to
+    // fill the array, so the snapshot restores as a full filter with the
+    // same estimate
+    for (i = 0; i < PF_N_TAG_LOC; i += n)
+    {
+        n = PF_N_TAG_LOC - i < pf->numParticles ? PF_N_TAG_LOC - i : pf->numParticles;
+        memcpy((uint8_t*)buf + PARTICLE_OFFSET + i * sizeof(tagParticle_t), pf->pTag, n * sizeof(tagParticle_t));
+    }
+    return particleFilterLoc_checkpointSize();
+}
+
+size_t particleFilterSlam_checkpoint(const particleFilterSlam_t* pf, void* buf, size_t len)
+{
+    pfCheckpoint_t* ck;
+
+    ck = _begin(buf, len, KIND_SLAM, PF_N_TAG_SLAM, sizeof(tagParticle_t));
+    if (ck == NULL)
+        return 0;
+    ck->seed = pf->seed;
+    CHECKPOINT_SAVE(ck, pf);
+    ck->logWeights = LOG_WEIGHTS;
+    LOG_WEIGHTS_SAVE(ck, pf);
+    memcpy((uint8_t*)buf + PARTICLE_OFFSET, pf->pTag, sizeof(pf->pTag));
+    return particleFilterSlam_checkpointSize();
+}
+
+// Beacons draw from the filter's generator, so they carry no seed
+size_t particleFilterSlam_checkpointBcn(const bcn_t* bcn, void* buf, size_t len)
+{
+    pfCheckpoint_t* ck;
+
+    if (len < particleFilterSlam_checkpointBcnSize())
+        return 0;
+    ck = _begin(buf, len, KIND_BCN, PF_N_TAG_SLAM * PF_N_BCN, sizeof(bcnStore_t));
+    if (ck == NULL)
+        return 0;
+    CHECKPOINT_SAVE(ck, bcn);
+    memcpy((uint8_t*)buf + PARTICLE_OFFSET, bcn->pBcn, sizeof(bcn->pBcn));
+#if defined(PF_COMPACT_BCN) && PF_COMPACT_BCN
+    memcpy((uint8_t*)buf + PARTICLE_OFFSET + sizeof(bcn->pBcn), bcn->origin, sizeof(bcn->origin));
+#endif
+    return particleFilterSlam_checkpointBcnSize();
+}
+
+// Returns 1 if particleFilterLoc_restore() would take buf. Until then none
+// of the header, lastT included, should be trusted
+uint8_t particleFilterLoc_checkpointValid(const void* buf, size_t len)
+{
+    const pfCheckpoint_t* ck;
+
+    ck = _check(buf, len, KIND_LOC, PF_N_TAG_LOC, sizeof(tagParticle_t));
+    return ck != NULL && ck->logWeights == LOG_WEIGHTS;
+}
+
+// Returns 0 and leaves the filter untouched if buf is not a snapshot of
+// this kind of filter taken by a build with the same particle counts.
+// Statistics are not part of the snapshot and are kept
+uint8_t particleFilterLoc_restore(particleFilterLoc_t* pf, const void* buf, size_t len)
+{
+    const pfCheckpoint_t* ck;
+
+    if (!particleFilterLoc_checkpointValid(buf, len))
+        return 0;
+    ck = (const pfCheckpoint_t*)buf;
+    pf->seed = ck->seed;
+    CHECKPOINT_LOAD(pf, ck);
+    LOG_WEIGHTS_LOAD(pf, ck);
+    memcpy(pf->pTag, (const uint8_t*)buf + ck->particleOffset, sizeof(pf->pTag));
+    pf->numParticles = PF_N_TAG_LOC;
+    return 1;
+}
+
+uint8_t particleFilterSlam_restore(particleFilterSlam_t* pf, const void* buf, size_t len)
+{
+    const pfCheckpoint_t* ck;
+
+    ck = _check(buf, len, KIND_SLAM, PF_N_TAG_SLAM, sizeof(tagParticle_t));
+    if (ck == NULL || ck->logWeights != LOG_WEIGHTS)
+        return 0;
+    pf->seed = ck->seed;
+    CHECKPOINT_LOAD(pf, ck);
+    LOG_WEIGHTS_LOAD(pf, ck);
+    memcpy(pf->pTag, (const uint8_t*)buf + ck->particleOffset, sizeof(pf->pTag));
+    return 1;
+}
+
+uint8_t particleFilterSlam_restoreBcn(bcn_t* bcn, const void* buf, size_t len)
+{
+    const pfCheckpoint_t* ck;
+
+    ck = _check(buf, len, KIND_BCN, PF_N_TAG_SLAM * PF_N_BCN, sizeof(bcnStore_t));
+    if (ck == NULL || len - ck->particleOffset < sizeof(bcn->pBcn) + BCN_ORIGIN_SIZE)
+        return 0;
+    CHECKPOINT_LOAD(bcn, ck);
+    memcpy(bcn->pBcn, (const uint8_t*)buf + ck->particleOffset, sizeof(bcn->pBcn));
+#if defined(PF_COMPACT_BCN) && PF_COMPACT_BCN
+    memcpy(bcn->origin, (const uint8_t*)buf + ck->particleOffset + sizeof(bcn->pBcn), sizeof(bcn->origin));
+#endif
+    return 1;
+}
+
+static pfCheckpoint_t* _begin(void* buf, size_t len, uint16_t kind, uint32_t numParticles, uint32_t particleSize)
+{
+    pfCheckpoint_t* ck;
+
+    if (len < PARTICLE_OFFSET + (size_t)numParticles * particleSize)
+        return NULL;
+    ck = (pfCheckpoint_t*)buf;
+    memset(buf, 0, PARTICLE_OFFSET);
+    ck->magic = PF_CHECKPOINT_MAGIC;
+    ck->version = PF_CHECKPOINT_VERSION;
+    ck->kind = kind;
+    ck->numParticles = numParticles;
+    ck->particleSize = particleSize;
+    ck->particleOffset = PARTICLE_OFFSET;
+    return ck;
+}
+
+static const pfCheckpoint_t* _check(const void* buf, size_t len, uint16_t kind, uint32_t numParticles, uint32_t particleSize)
+{
+    const pfCheckpoint_t* ck;
+
+    if (len < sizeof(pfCheckpoint_t))
+        return NULL;
+    ck = (const pfCheckpoint_t*)buf;
+    if (ck->magic != PF_CHECKPOINT_MAGIC || ck->version != PF_CHECKPOINT_VERSION || ck->kind != kind)
+        return NULL;
+    if (ck->numParticles != numParticles || ck->particleSize != particleSize)
+        return NULL;
+    if (ck->particleOffset < sizeof(pfCheckpoint_t) || ck->particleOffset > len || len - ck->particleOffset < (size_t)numParticles * particleSize)
+        return NULL;
+    return ck;
+}
@@ -0,0 +1,166 @@
+/*
+ * pfCpu.c
+ * Created by slam3d contributors on 10/19/26.
+ *
+ * Copyright (c) 2026, Wireless Sensing and Embedded Systems Lab, Carnegie
+ * Mellon University
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-3-Clause license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "pfCpu.h"
+
+#if PF_CPU_X86 && defined(_MSC_VER)
+#include <intrin.h>
+#elif PF_CPU_X86
+#include <cpuid.h>
+#endif
+
+#define XCR0_AVX            (0x06u)     // SSE and AVX state
+#define XCR0_AVX512         (0xe6u)     // the above plus opmask and upper zmm state
+
+static pfCpuLevel_t _detect(void);
+static const pfKernels_t* _table(pfCpuLevel_t level);
+#if PF_CPU_X86
+static void _cpuid(uint32_t leaf, uint32_t sub, uint32_t r[4]);
+static uint64_t _osStateMask(void);
+#endif
+
+// Filters may be set up from several threads; they all store the same
+// values, so a race here is harmless
+static volatile int _supported = -1;
+static volatile int _level = -1;
+static const pfKernels_t* volatile _kernels = &pfKernels_scalar;
+
+void pfCpu_init(void)
+{
+    if (_supported < 0)
+    {
+        _level = (int)_detect();
+        _kernels = _table((pfCpuLevel_t)_level);
+        _supported = _level;
+    }
+}
+
+const pfKernels_t* pfCpu_kernels(void)
+{
+    pfCpu_init();
+    return _kernels;
+}
+
+// The best variant this CPU and OS support, picked at the first filter init
+pfCpuLevel_t particleFilterCpu_get(void)
+{
+    pfCpu_init();
+    return (pfCpuLevel_t)_level;
+}
+
+// Caps the variant, for comparing them on one machine. Returns the one in
+// use, which is never above what the CPU supports
+pfCpuLevel_t particleFilterCpu_set(pfCpuLevel_t level)
+{
+    pfCpu_init();
+    if ((int)level > _supported)
+        level = (pfCpuLevel_t)_supported;
+    _kernels = _table(level);
+    _level = (int)level;
+    return level;
+}
+
+const char* particleFilterCpu_name(pfCpuLevel_t level)
+{
+    switch (level)
+    {
+    case PF_CPU_SSE42:
+        return "sse4.2";
+    case PF_CPU_AVX2:
+        return "avx2";
+    case PF_CPU_AVX512:
+        return "avx512";
+    default:
+        return "scalar";
+    }
+}
+
+static pfCpuLevel_t _detect(void)
+{
+#if PF_CPU_X86
+    uint32_t r[4], maxLeaf;
+    uint64_t xcr0;
+
+    _cpuid(0, 0, r);
+    maxLeaf = r[0];
+    if (maxLeaf < 1)
+        return PF_CPU_SCALAR;
+    _cpuid(1, 0, r);
+    if (!(r[2] & (1u << 20)))
+        return PF_CPU_SCALAR;
+
+    // AVX needs the OS to save ymm state too (OSXSAVE, then XCR0)
+    if (!(r[2] & (1u << 27)) || !(r[2] & (1u << 28)))
+        return PF_CPU_SSE42;
+    xcr0 = _osStateMask();
+    if ((xcr0 & XCR0_AVX) != XCR0_AVX || maxLeaf < 7)
+        return PF_CPU_SSE42;
+    _cpuid(7, 0, r);
+    if (!(r[1] & (1u << 5)))
+        return PF_CPU_SSE42;
+    if ((r[1] & (1u << 16)) && (xcr0 & XCR0_AVX512) == XCR0_AVX512)
+        return PF_CPU_AVX512;
+    return PF_CPU_AVX2;
+#else
+    return PF_CPU_SCALAR;
+#endif
+}
+
+static const pfKernels_t* _table(pfCpuLevel_t level)
+{
+    switch (level)
+    {
+#if PF_CPU_X86
+    case PF_CPU_SSE42:
+        return &pfKernels_sse42;
+    case PF_CPU_AVX2:
+        return &pfKernels_avx2;
+    case PF_CPU_AVX512:
+        return &pfKernels_avx512;
+#endif
+    default:
+        return &pfKernels_scalar;
+    }
+}
+
+#if PF_CPU_X86
+static void _cpuid(uint32_t leaf, uint32_t sub, uint32_t r[4])
+{
+#if defined(_MSC_VER)
+    int regs[4];
+
+    __cpuidex(regs, (int)leaf, (int)sub);
+    r[0] = (uint32_t)regs[0];
+    r[1] = (uint32_t)regs[1];
+    r[2] = (uint32_t)regs[2];
+    r[3] = (uint32_t)regs[3];
+#else
+    __cpuid_count(leaf, sub, r[0], r[1], r[2], r[3]);
+#endif
+}
+
+// XCR0, only read once OSXSAVE is known to be set
+static uint64_t _osStateMask(void)
+{
+#if defined(_MSC_VER)
+    return _xgetbv(0);
+#else
+    uint32_t lo, hi;
+
+    __asm__ __volatile__("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+    return ((uint64_t)hi << 32) | lo;
+#endif
+}
+#endif
@@ -14,14 +14,38 @@
 #include <math.h>
 #undef _USE_MATH_DEFINES
 
+#include "pfBcn.h"
 #include "pfInit.h"
 #include "pfRandom.h"
+#include "pfWeight.h"
 
 void pfInit_initTagLoc(particleFilterLoc_t* pf, float bx, float by, float bz, float range, float stdRange)
 {
+#if defined(PF_BULK_INIT) && PF_BULK_INIT
+    int i, j, n;
+    tagParticle_t* tp;
+    float x[PF_RANDOM_BULK], y[PF_RANDOM_BULK], z[PF_RANDOM_BULK], theta[PF_RANDOM_BULK];
+
+    for (i = 0; i < pf->numParticles; i += n)
+    {
+        n = pf->numParticles - i < PF_RANDOM_BULK ? pf->numParticles - i : PF_RANDOM_BULK;
+        pfRandom_sphereBulk(&pf->seed, x, y, z, theta, n, range, stdRange);
+        for (j = 0; j < n; ++j)
+        {
+            tp = &pf->pTag[i + j];
+            tp->w = PF_WEIGHT_ONE;
+            tp->x = bx + x[j];
+            tp->y = by + y[j];
+            tp->z = bz + z[j];
+            tp->theta = theta[j];
+        }
+    }
+#else
     int i;
-    for (i = 0; i < PF_N_TAG_LOC; ++i)
-        pfInit_spawnTagParticleFromRange(&pf->pTag[i], bx, by, bz, range, stdRange);
+    for (i = 0; i < pf->numParticles; ++i)
+        pfInit_spawnTagParticleFromRange(&pf->seed, &pf->pTag[i], bx, by, bz, range, stdRange);
+#endif
+    PF_WEIGHT_RESET(pf);
 }
 
 void pfInit_initTagSlam(particleFilterSlam_t* pf)
@@ -29,73 +53,104 @@ void pfInit_initTagSlam(particleFilterSlam_t* pf)
     int i;
     for (i = 0; i < PF_N_TAG_SLAM; ++i)
         pfInit_spawnTagParticleZero(&pf->pTag[i]);
+    PF_WEIGHT_RESET(pf);
 }
 
-void pfInit_initBcnSlam(bcn_t* bcn, const particleFilterSlam_t* pf, float range, float stdRange)
+void pfInit_initBcnSlam(bcn_t* bcn, particleFilterSlam_t* pf, float range, float stdRange)
 {
     int i, j;
     const tagParticle_t* tp;
+    bcnParticle_t bp;
+    float origin[3];
+#if defined(PF_BULK_INIT) && PF_BULK_INIT
+    int k, n;
+    float x[PF_RANDOM_BULK], y[PF_RANDOM_BULK], z[PF_RANDOM_BULK], theta[PF_RANDOM_BULK];
+#endif
     
     for (i = 0; i < PF_N_TAG_SLAM; ++i)
     {
         tp = &pf->pTag[i];
+        origin[0] = tp->x;
+        origin[1] = tp->y;
+        origin[2] = tp->z;
+        pfBcn_setOrigin(bcn, i, origin);
+#if defined(PF_BULK_INIT) && PF_BULK_INIT
+        for (j = 0; j < PF_N_BCN; j += n)
+        {
+            n = PF_N_BCN - j < PF_RANDOM_BULK ? PF_N_BCN - j : PF_RANDOM_BULK;
+            pfRandom_sphereBulk(&pf->seed, x, y, z, theta, n, range, stdRange);
+            for (k = 0; k < n; ++k)
+            {
+                bp.w = 1.0f;
+                bp.x = tp->x + x[k];
+                bp.y = tp->y + y[k];
+                bp.z = tp->z + z[k];
+                bp.theta = theta[k];
+                pfBcn_store(&bcn->pBcn[i][j + k], &bp, origin);
+            }
+        }
+#else
         for (j = 0; j < PF_N_BCN; ++j)
-            pfInit_spawnBcnParticleFromRange(&bcn->pBcn[i][j], tp, range, stdRange);
+        {
+            pfInit_spawnBcnParticleFromRange(&pf->seed, &bp, tp, range, stdRange);
+            pfBcn_store(&bcn->pBcn[i][j], &bp, origin);
+        }
+#endif
     }
 }
 
 void pfInit_spawnTagParticleZero(tagParticle_t* tp)
 {
-    tp->w = 1.0f;
+    tp->w = PF_WEIGHT_ONE;
     tp->x = 0.0f;
     tp->y = 0.0f;
     tp->z = 0.0f;
     tp->theta = 0.0f;
 }
 
-void pfInit_spawnTagParticleFromRange(tagParticle_t* tp, float bx, float by, float bz, float range, float stdRange)
+void pfInit_spawnTagParticleFromRange(unsigned int* seed, tagParticle_t* tp, float bx, float by, float bz, float range, float stdRange)
 {
     float dx, dy, dz;
 
-    pfRandom_sphere(&dx, &dy, &dz, range, stdRange);
-    tp->w = 1.0f;
+    pfRandom_sphere(seed, &dx, &dy, &dz, range, stdRange);
+    tp->w = PF_WEIGHT_ONE;
     tp->x = bx + dx;
     tp->y = by + dy;
     tp->z = bz + dz;
-    tp->theta = pfRandom_uniform() * 2 * (float)M_PI;
+    tp->theta = pfRandom_uniform(seed) * 2 * (float)M_PI;
 }
 
-void pfInit_spawnTagParticleFromOther(tagParticle_t* tp, const tagParticle_t* other, float hXyz, float hTheta)
+void pfInit_spawnTagParticleFromOther(unsigned int* seed, tagParticle_t* tp, const tagParticle_t* other, float hXyz, float hTheta)
 {
     float dx, dy, dz, dtheta;
     
-    pfRandom_normal2(&dx, &dy);
-    pfRandom_normal2(&dz, &dtheta);
-    tp->w = 1.0f;
+    pfRandom_normal2(seed, &dx, &dy);
+    pfRandom_normal2(seed, &dz, &dtheta);
+    tp->w = PF_WEIGHT_ONE;
     tp->x = other->x + dx * hXyz;
     tp->y = other->y + dy * hXyz;
     tp->z = other->z + dz * hXyz;
     tp->theta = fmodf(other->theta + dtheta * hTheta, 2 * (float)M_PI);
 }
 
-void pfInit_spawnBcnParticleFromRange(bcnParticle_t* bp, const tagParticle_t* tp, float range, float stdRange)
+void pfInit_spawnBcnParticleFromRange(unsigned int* seed, bcnParticle_t* bp, const tagParticle_t* tp, float range, float stdRange)
 {
     float dx, dy, dz;
     
-    pfRandom_sphere(&dx, &dy, &dz, range, stdRange);
+    pfRandom_sphere(seed, &dx, &dy, &dz, range, stdRange);
     bp->w = 1.0f;
     bp->x = tp->x + dx;
     bp->y = tp->y + dy;
     bp->z = tp->z + dz;
-    bp->theta = pfRandom_uniform() * 2 * (float)M_PI;
+    bp->theta = pfRandom_uniform(seed) * 2 * (float)M_PI;
 }
 
-void pfInit_spawnBcnParticleFromOther(bcnParticle_t* bp, const bcnParticle_t* other, float hXyz, float hTheta)
+void pfInit_spawnBcnParticleFromOther(unsigned int* seed, bcnParticle_t* bp, const bcnParticle_t* other, float hXyz, float hTheta)
 {
     float dx, dy, dz, dtheta;
     
-    pfRandom_normal2(&dx, &dy);
-    pfRandom_normal2(&dz, &dtheta);
+    pfRandom_normal2(seed, &dx, &dy);
+    pfRandom_normal2(seed, &dz, &dtheta);
     bp->w = 1.0f;
     bp->x = other->x + dx * hXyz;
     bp->y = other->y + dy * hXyz;
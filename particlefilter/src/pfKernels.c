@@ -0,0 +1,245 @@
+/*
+ * pfKernels.c
+ * Created by slam3d contributors on 10/19/26.
+ *
+ * Copyright (c) 2026, Wireless Sensing and Embedded Systems Lab, Carnegie
+ * Mellon University
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-3-Clause license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// Each kernel body is written once and compiled for several instruction
+// sets through target attributes, so the library itself needs no -m flags.
+// Contraction into FMA stays off, which keeps every variant bit-identical
+// to the scalar one (and to the regression output). GCC keeps the errno
+// branch around sqrtf() whatever the function's options, which stops the
+// vectorizer, so square roots are taken with the instruction set's own
+// sqrt, correctly rounded like sqrtf()
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC optimize("tree-vectorize", "fp-contract=off")
+#elif defined(__clang__)
+#pragma clang fp contract(off)
+#endif
+
+#define _USE_MATH_DEFINES
+#include <math.h>
+#undef _USE_MATH_DEFINES
+#include <stdint.h>
+
+#include "pfCpu.h"
+#include "pfRandom.h"
+
+#if PF_CPU_X86
+#include <immintrin.h>
+#endif
+
+#define STRIDE              ((int)(sizeof(tagParticle_t) / sizeof(float)))
+
+#if defined(__GNUC__)
+#define TARGET(t)           __attribute__((target(t)))
+#define BODY                static inline __attribute__((always_inline))
+#else
+#define TARGET(t)
+#define BODY                static __forceinline
+#endif
+
+static void _rangesScalar(const tagParticle_t* tp, int n, float bx, float by, float bz, float* ranges);
+static void _sphereScalar(uint32_t key, float lo, float hi, float* x, float* y, float* z, float* theta, int n);
+#if PF_CPU_X86
+static void _rangesSse42(const tagParticle_t* tp, int n, float bx, float by, float bz, float* ranges);
+static void _sphereSse42(uint32_t key, float lo, float hi, float* x, float* y, float* z, float* theta, int n);
+static void _rangesAvx2(const tagParticle_t* tp, int n, float bx, float by, float bz, float* ranges);
+static void _sphereAvx2(uint32_t key, float lo, float hi, float* x, float* y, float* z, float* theta, int n);
+static void _rangesAvx512(const tagParticle_t* tp, int n, float bx, float by, float bz, float* ranges);
+static void _sphereAvx512(uint32_t key, float lo, float hi, float* x, float* y, float* z, float* theta, int n);
+#endif
+
+const pfKernels_t pfKernels_scalar = { _rangesScalar, _sphereScalar };
+#if PF_CPU_X86
+const pfKernels_t pfKernels_sse42 = { _rangesSse42, _sphereSse42 };
+const pfKernels_t pfKernels_avx2 = { _rangesAvx2, _sphereAvx2 };
+const pfKernels_t pfKernels_avx512 = { _rangesAvx512, _sphereAvx512 };
+#endif
+
+// See pfRandom_sphereBulk(). The first pass leaves 1 - zu^2 in x and the
+// azimuth draw in y for the square root pass; the radius draw is cheaper
+// to hash again than to keep
+BODY void _spherePre(uint32_t key, float lo, float hi, float* x, float* y, float* z, float* theta, int n)
+{
+    int i;
+    uint32_t ctr;
+    float rad, zu;
+
+    for (i = 0; i < n; ++i)
+    {
+        ctr = key + (uint32_t)i * 4u;
+        rad = lo + (hi - lo) * pfRandom_hashUniform(ctr);
+        zu = pfRandom_hashUniform(ctr + 1u) * 2 - 1;
+
+        x[i] = 1 - zu * zu;
+        y[i] = pfRandom_hashUniform(ctr + 2u);
+        z[i] = rad * zu;
+        theta[i] = pfRandom_hashUniform(ctr + 3u) * 2 * (float)M_PI;
+    }
+}
+
+BODY void _spherePost(uint32_t key, float lo, float hi, float* x, float* y, int n)
+{
+    int i;
+    float rad, c, h, h2, s, co;
+
+    for (i = 0; i < n; ++i)
+    {
+        rad = lo + (hi - lo) * pfRandom_hashUniform(key + (uint32_t)i * 4u);
+        c = rad * x[i];
+
+        // Half the azimuth, in [-pi/2, pi/2), where Taylor series to h^11
+        // and h^12 are within 1e-7
+        h = (y[i] - 0.5f) * (float)M_PI;
+        h2 = h * h;
+        s = h * (1 + h2 * (-1.0f / 6 + h2 * (1.0f / 120 + h2 * (-1.0f / 5040 + h2 * (1.0f / 362880 + h2 * (-1.0f / 39916800))))));
+        co = 1 + h2 * (-0.5f + h2 * (1.0f / 24 + h2 * (-1.0f / 720 + h2 * (1.0f / 40320 + h2 * (-1.0f / 3628800 + h2 * (1.0f / 479001600))))));
+
+        x[i] = c * (co * co - s * s);
+        y[i] = c * 2 * s * co;
+    }
+}
+
+BODY void _sqrtTail(float* v, int i, int n)
+{
+    for (; i < n; ++i)
+        v[i] = sqrtf(v[i]);
+}
+
+// Distance from each particle to a beacon, for the gating and RSSI passes
+static void _rangesScalar(const tagParticle_t* tp, int n, float bx, float by, float bz, float* ranges)
+{
+    int i;
+    float dx, dy, dz;
+
+    for (i = 0; i < n; ++i)
+    {
+        dx = tp[i].x - bx;
+        dy = tp[i].y - by;
+        dz = tp[i].z - bz;
+        ranges[i] = sqrtf(dx * dx + dy * dy + dz * dz);
+    }
+}
+
+static void _sphereScalar(uint32_t key, float lo, float hi, float* x, float* y, float* z, float* theta, int n)
+{
+    _spherePre(key, lo, hi, x, y, z, theta, n);
+    _sqrtTail(x, 0, n);
+    _spherePost(key, lo, hi, x, y, n);
+}
+
+#if PF_CPU_X86
+TARGET("sse4.2") static void _sqrtSse42(float* v, int n)
+{
+    int i;
+
+    for (i = 0; i + 4 <= n; i += 4)
+        _mm_storeu_ps(v + i, _mm_sqrt_ps(_mm_loadu_ps(v + i)));
+    _sqrtTail(v, i, n);
+}
+
+// SSE has no gather, so each coordinate is loaded lane by lane
+TARGET("sse4.2") static void _rangesSse42(const tagParticle_t* tp, int n, float bx, float by, float bz, float* ranges)
+{
+    int i;
+    __m128 dx, dy, dz;
+
+    for (i = 0; i + 4 <= n; i += 4)
+    {
+        dx = _mm_sub_ps(_mm_setr_ps(tp[i].x, tp[i + 1].x, tp[i + 2].x, tp[i + 3].x), _mm_set1_ps(bx));
+        dy = _mm_sub_ps(_mm_setr_ps(tp[i].y, tp[i + 1].y, tp[i + 2].y, tp[i + 3].y), _mm_set1_ps(by));
+        dz = _mm_sub_ps(_mm_setr_ps(tp[i].z, tp[i + 1].z, tp[i + 2].z, tp[i + 3].z), _mm_set1_ps(bz));
+        dx = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+        _mm_storeu_ps(ranges + i, _mm_sqrt_ps(dx));
+    }
+    _rangesScalar(tp + i, n - i, bx, by, bz, ranges + i);
+}
+
+TARGET("sse4.2") static void _sphereSse42(uint32_t key, float lo, float hi, float* x, float* y, float* z, float* theta, int n)
+{
+    _spherePre(key, lo, hi, x, y, z, theta, n);
+    _sqrtSse42(x, n);
+    _spherePost(key, lo, hi, x, y, n);
+}
+
+TARGET("avx2") static void _sqrtAvx2(float* v, int n)
+{
+    int i;
+
+    for (i = 0; i + 8 <= n; i += 8)
+        _mm256_storeu_ps(v + i, _mm256_sqrt_ps(_mm256_loadu_ps(v + i)));
+    _sqrtTail(v, i, n);
+}
+
+// Particles are five floats apart, a stride the vectorizer will not
+// interleave, so the wider sets gather each coordinate instead
+TARGET("avx2") static void _rangesAvx2(const tagParticle_t* tp, int n, float bx, float by, float bz, float* ranges)
+{
+    int i;
+    const float* base;
+    __m256i idx;
+    __m256 dx, dy, dz;
+
+    idx = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(STRIDE));
+    for (i = 0; i + 8 <= n; i += 8)
+    {
+        base = &tp[i].x;
+        dx = _mm256_sub_ps(_mm256_i32gather_ps(base, idx, 4), _mm256_set1_ps(bx));
+        dy = _mm256_sub_ps(_mm256_i32gather_ps(base + 1, idx, 4), _mm256_set1_ps(by));
+        dz = _mm256_sub_ps(_mm256_i32gather_ps(base + 2, idx, 4), _mm256_set1_ps(bz));
+        dx = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)), _mm256_mul_ps(dz, dz));
+        _mm256_storeu_ps(ranges + i, _mm256_sqrt_ps(dx));
+    }
+    _rangesScalar(tp + i, n - i, bx, by, bz, ranges + i);
+}
+
+TARGET("avx2") static void _sphereAvx2(uint32_t key, float lo, float hi, float* x, float* y, float* z, float* theta, int n)
+{
+    _spherePre(key, lo, hi, x, y, z, theta, n);
+    _sqrtAvx2(x, n);
+    _spherePost(key, lo, hi, x, y, n);
+}
+
+TARGET("avx512f") static void _sqrtAvx512(float* v, int n)
+{
+    int i;
+
+    for (i = 0; i + 16 <= n; i += 16)
+        _mm512_storeu_ps(v + i, _mm512_sqrt_ps(_mm512_loadu_ps(v + i)));
+    _sqrtTail(v, i, n);
+}
+
+TARGET("avx512f") static void _rangesAvx512(const tagParticle_t* tp, int n, float bx, float by, float bz, float* ranges)
+{
+    int i;
+    const float* base;
+    __m512i idx;
+    __m512 dx, dy, dz;
+
+    idx = _mm512_mullo_epi32(_mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15), _mm512_set1_epi32(STRIDE));
+    for (i = 0; i + 16 <= n; i += 16)
+    {
+        base = &tp[i].x;
+        dx = _mm512_sub_ps(_mm512_i32gather_ps(idx, base, 4), _mm512_set1_ps(bx));
+        dy = _mm512_sub_ps(_mm512_i32gather_ps(idx, base + 1, 4), _mm512_set1_ps(by));
+        dz = _mm512_sub_ps(_mm512_i32gather_ps(idx, base + 2, 4), _mm512_set1_ps(bz));
+        dx = _mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(dx, dx), _mm512_mul_ps(dy, dy)), _mm512_mul_ps(dz, dz));
+        _mm512_storeu_ps(ranges + i, _mm512_sqrt_ps(dx));
+    }
+    _rangesScalar(tp + i, n - i, bx, by, bz, ranges + i);
+}
+
+TARGET("avx512f") static void _sphereAvx512(uint32_t key, float lo, float hi, float* x, float* y, float* z, float* theta, int n)
+{
+    _spherePre(key, lo, hi, x, y, z, theta, n);
+    _sqrtAvx512(x, n);
+    _spherePost(key, lo, hi, x, y, n);
+}
+#endif
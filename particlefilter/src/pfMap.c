@@ -0,0 +1,132 @@
+/*
+ * pfMap.c
+ * Created by slam3d contributors on 10/19/26.
+ *
+ * Copyright (c) 2026, Wireless Sensing and Embedded Systems Lab, Carnegie
+ * Mellon University
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-3-Clause license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "pfMap.h"
+
+#define BRICKS(n, shift)    (((n) + (1 << (shift)) - 1) >> (shift))
+
+static void _shifts(int nz, uint8_t shift[3]);
+static void _setCell(pfMap_t* map, int32_t ix, int32_t iy, int32_t iz, uint8_t occupied);
+static void _cellRange(const pfMap_t* map, int axis, float a, float b, int32_t* lo, int32_t* hi);
+
+// Bytes of bits for an nx by ny by nz grid, nz = 1 for a 2D map
+size_t particleFilterMap_size(int nx, int ny, int nz)
+{
+    uint8_t shift[3];
+
+    _shifts(nz, shift);
+    return (size_t)BRICKS(nx, shift[0]) * BRICKS(ny, shift[1]) * BRICKS(nz, shift[2]) * sizeof(uint64_t);
+}
+
+// bits holds particleFilterMap_size() bytes, 8-byte aligned, and outlives
+// the map. (x, y, z) is the low corner of the grid; every cell starts free
+void particleFilterMap_init(pfMap_t* map, void* bits, float x, float y, float z, float cellSize, int nx, int ny, int nz)
+{
+    if (nz < 1)
+        nz = 1;
+    _shifts(nz, map->shift);
+    map->bits = (uint64_t*)bits;
+    map->origin[0] = x;
+    map->origin[1] = y;
+    map->origin[2] = z;
+    map->cellSize = cellSize;
+    map->invCellSize = 1.0f / cellSize;
+    map->cells[0] = nx;
+    map->cells[1] = ny;
+    map->cells[2] = nz;
+    map->bricks[0] = BRICKS(nx, map->shift[0]);
+    map->bricks[1] = BRICKS(ny, map->shift[1]);
+    memset(bits, 0, particleFilterMap_size(nx, ny, nz));
+}
+
+// One byte per cell, x fastest, then y, then z, as occupancy grids are
+// usually exported. Nonzero cells are occupied
+void particleFilterMap_load(pfMap_t* map, const uint8_t* cells)
+{
+    int32_t ix, iy, iz;
+
+    for (iz = 0; iz < map->cells[2]; ++iz)
+        for (iy = 0; iy < map->cells[1]; ++iy)
+            for (ix = 0; ix < map->cells[0]; ++ix)
+                _setCell(map, ix, iy, iz, *cells++ != 0);
+}
+
+// Marks every cell the box touches, for drawing walls and obstacles from a
+// floor plan
+void particleFilterMap_fill(pfMap_t* map, float x0, float y0, float z0, float x1, float y1, float z1, uint8_t occupied)
+{
+    int32_t ix, iy, iz, lo[3], hi[3];
+
+    _cellRange(map, 0, x0, x1, &lo[0], &hi[0]);
+    _cellRange(map, 1, y0, y1, &lo[1], &hi[1]);
+    if (map->cells[2] == 1)
+    {
+        lo[2] = 0;
+        hi[2] = 0;
+    }
+    else
+        _cellRange(map, 2, z0, z1, &lo[2], &hi[2]);
+    for (iz = lo[2]; iz <= hi[2]; ++iz)
+        for (iy = lo[1]; iy <= hi[1]; ++iy)
+            for (ix = lo[0]; ix <= hi[0]; ++ix)
+                _setCell(map, ix, iy, iz, occupied);
+}
+
+// Not copied, must outlive the filter. NULL, the default, leaves
+// propagation unconstrained
+void particleFilterLoc_setMap(particleFilterLoc_t* pf, const pfMap_t* map)
+{
+    pf->map = map;
+}
+
+static void _shifts(int nz, uint8_t shift[3])
+{
+    if (nz > 1)
+    {
+        shift[0] = 2;
+        shift[1] = 2;
+        shift[2] = 2;
+    }
+    else
+    {
+        shift[0] = 3;
+        shift[1] = 3;
+        shift[2] = 0;
+    }
+}
+
+static void _setCell(pfMap_t* map, int32_t ix, int32_t iy, int32_t iz, uint8_t occupied)
+{
+    uint64_t mask;
+
+    mask = (uint64_t)1 << pfMap_bit(map, ix, iy, iz);
+    if (occupied)
+        map->bits[pfMap_word(map, ix, iy, iz)] |= mask;
+    else
+        map->bits[pfMap_word(map, ix, iy, iz)] &= ~mask;
+}
+
+// Cells from a to b along one axis, clamped to the grid; empty (lo > hi)
+// when the span misses it
+static void _cellRange(const pfMap_t* map, int axis, float a, float b, int32_t* lo, int32_t* hi)
+{
+    float fa, fb;
+
+    fa = (fminf(a, b) - map->origin[axis]) * map->invCellSize;
+    fb = (fmaxf(a, b) - map->origin[axis]) * map->invCellSize;
+    *lo = fa > 0.0f ? (fa < map->cells[axis] ? (int32_t)fa : map->cells[axis]) : 0;
+    *hi = fb < map->cells[axis] ? (fb >= 0.0f ? (int32_t)fb : -1) : map->cells[axis] - 1;
+}
@@ -14,23 +14,34 @@
 #include <math.h>
 #undef _USE_MATH_DEFINES
 
+#include "pfBcn.h"
+#include "pfCpu.h"
+#include "pfMap.h"
 #include "pfMeasurement.h"
 #include "pfRandom.h"
+#include "pfRssi.h"
+#include "pfWeight.h"
 
 #define VIO_STD_XYZ         (1e-3f)
 #define VIO_STD_THETA       (1e-6f)
 #define MIN_WEIGHT(range)   ((range < 3.0f) ? 0.1f : 0.5f)
+#define MAP_WEIGHT          (0.1f)
 
+// With a map, particles stepping into an occupied cell are down-weighted
+// like an out-of-bounds range, so walls prune them at the next resample
 void pfMeasurement_applyVioLoc(particleFilterLoc_t* pf, float dt, float dx, float dy, float dz, float ddist)
 {
     int i;
     tagParticle_t* tp;
-    float c, s, pDx, pDy, stdXyz, stdTheta;
-    float rx, ry, rz, rtheta;
+    const pfMap_t* map;
+    float c, s, pDx, pDy, stdXyz, stdTheta, mapWeight;
+    float rx, ry, rz, rtheta, x0, y0, z0;
     
+    map = pf->map;
+    mapWeight = PF_WEIGHT_FACTOR(MAP_WEIGHT);
     stdXyz = sqrtf(ddist) * VIO_STD_XYZ;
     stdTheta = sqrtf(dt) * VIO_STD_THETA;
-    for (i = 0; i < PF_N_TAG_LOC; ++i)
+    for (i = 0; i < pf->numParticles; ++i)
     {
         tp = &pf->pTag[i];
         c = cosf(tp->theta);
@@ -38,13 +49,18 @@ void pfMeasurement_applyVioLoc(particleFilterLoc_t* pf, float dt, float dx, floa
         pDx = dx * c - dy * s;
         pDy = dx * s + dy * c;
         
-        pfRandom_normal2(&rx, &ry);
-        pfRandom_normal2(&rz, &rtheta);
+        pfRandom_normal2(&pf->seed, &rx, &ry);
+        pfRandom_normal2(&pf->seed, &rz, &rtheta);
         
+        x0 = tp->x;
+        y0 = tp->y;
+        z0 = tp->z;
         tp->x += pDx + stdXyz * rx;
         tp->y += pDy + stdXyz * ry;
         tp->z += dz + stdXyz * rz;
         tp->theta = fmodf(tp->theta + stdTheta * rtheta, 2 * (float)M_PI);
+        if (map != NULL && pfMap_crosses(map, x0, y0, z0, tp->x, tp->y, tp->z))
+            tp->w = PF_WEIGHT_MUL(tp->w, mapWeight);
     }
 }
 
@@ -65,8 +81,8 @@ void pfMeasurement_applyTagVioSlam(particleFilterSlam_t* pf, float dt, float dx,
         pDx = dx * c - dy * s;
         pDy = dx * s + dy * c;
 
-        pfRandom_normal2(&rx, &ry);
-        pfRandom_normal2(&rz, &rtheta);
+        pfRandom_normal2(&pf->seed, &rx, &ry);
+        pfRandom_normal2(&pf->seed, &rz, &rtheta);
 
         tp->x += pDx + stdXyz * rx;
         tp->y += pDy + stdXyz * ry;
@@ -75,10 +91,11 @@ void pfMeasurement_applyTagVioSlam(particleFilterSlam_t* pf, float dt, float dx,
     }
 }
 
-void pfMeasurement_applyBcnVioSlam(bcn_t* bcn, float dt, float dx, float dy, float dz, float ddist)
+void pfMeasurement_applyBcnVioSlam(particleFilterSlam_t* pf, bcn_t* bcn, float dt, float dx, float dy, float dz, float ddist)
 {
     int i, j;
-    bcnParticle_t* bp;
+    bcnParticle_t bp;
+    const float* origin;
     float c, s, pDx, pDy, stdXyz, stdTheta;
     float rx, ry, rz, rtheta;
 
@@ -86,21 +103,23 @@ void pfMeasurement_applyBcnVioSlam(bcn_t* bcn, float dt, float dx, float dy, flo
     stdTheta = sqrtf(dt) * VIO_STD_THETA;
     for (i = 0; i < PF_N_TAG_SLAM; ++i)
     {
+        origin = pfBcn_origin(bcn, i);
         for (j = 0; j < PF_N_BCN; ++j)
         {
-            bp = &bcn->pBcn[i][j];
-            c = cosf(bp->theta);
-            s = sinf(bp->theta);
+            pfBcn_load(&bp, &bcn->pBcn[i][j], origin);
+            c = cosf(bp.theta);
+            s = sinf(bp.theta);
             pDx = dx * c - dy * s;
             pDy = dx * s + dy * c;
 
-            pfRandom_normal2(&rx, &ry);
-            pfRandom_normal2(&rz, &rtheta);
+            pfRandom_normal2(&pf->seed, &rx, &ry);
+            pfRandom_normal2(&pf->seed, &rz, &rtheta);
 
-            bp->x += pDx + stdXyz * rx;
-            bp->y += pDy + stdXyz * ry;
-            bp->z += dz + stdXyz * rz;
-            bp->theta = fmodf(bp->theta + stdTheta * rtheta, 2 * (float)M_PI);
+            bp.x += pDx + stdXyz * rx;
+            bp.y += pDy + stdXyz * ry;
+            bp.z += dz + stdXyz * rz;
+            bp.theta = fmodf(bp.theta + stdTheta * rtheta, 2 * (float)M_PI);
+            pfBcn_store(&bcn->pBcn[i][j], &bp, origin);
         }
     }
 }
@@ -109,44 +128,106 @@ void pfMeasurement_applyRangeLoc(particleFilterLoc_t* pf, float bx, float by, fl
 {
     int i;
     tagParticle_t* tp;
-    float minWeight, dx, dy, dz, pRange;
+    float minWeight;
+    float* pRange = pf->rangeBuf;
 
-    minWeight = MIN_WEIGHT(range);
-    for (i = 0; i < PF_N_TAG_LOC; ++i)
+    minWeight = PF_WEIGHT_FACTOR(MIN_WEIGHT(range));
+    pfCpu_kernels()->ranges(pf->pTag, pf->numParticles, bx, by, bz, pRange);
+    PF_WEIGHT_PASS_BEGIN(pf, pass);
+    for (i = 0; i < pf->numParticles; ++i)
     {
         tp = &pf->pTag[i];
-        dx = tp->x - bx;
-        dy = tp->y - by;
-        dz = tp->z - bz;
-        pRange = sqrtf(dx * dx + dy * dy + dz * dz);
-        if (fabsf(pRange - range) > 3 * stdRange)
-            tp->w *= minWeight;
+        PF_WEIGHT_PASS_FOLD(pass, tp->w);
+        if (fabsf(pRange[i] - range) > 3 * stdRange)
+            tp->w = PF_WEIGHT_MUL(tp->w, minWeight);
+        PF_WEIGHT_PASS_MAX(pass, tp->w);
     }
+    PF_WEIGHT_PASS_END(pf, pass);
 }
 
 void pfMeasurement_applyRangeSlam(particleFilterSlam_t* pf, bcn_t* bcn, float range, float stdRange)
 {
     int i, j;
     tagParticle_t* tp;
-    bcnParticle_t* bp;
-    float minWeight, dx, dy, dz, pRange, bcnSum;
+    bcnStore_t* sp;
+    const float* origin;
+    pfBcnScale_t minWeight;
+    float dx, dy, dz, bx, by, bz, pRange, bcnSum;
     
-    minWeight = MIN_WEIGHT(range);
+    minWeight = pfBcn_scale(MIN_WEIGHT(range));
+    PF_WEIGHT_PASS_BEGIN(pf, pass);
     for (i = 0; i < PF_N_TAG_SLAM; ++i)
     {
         tp = &pf->pTag[i];
+        PF_WEIGHT_PASS_FOLD(pass, tp->w);
+        origin = pfBcn_origin(bcn, i);
         bcnSum = 0.0f;
         for (j = 0; j < PF_N_BCN; ++j)
         {
-            bp = &bcn->pBcn[i][j];
-            dx = tp->x - bp->x;
-            dy = tp->y - bp->y;
-            dz = tp->z - bp->z;
+            sp = &bcn->pBcn[i][j];
+            pfBcn_loadXyz(&bx, &by, &bz, sp, origin);
+            dx = tp->x - bx;
+            dy = tp->y - by;
+            dz = tp->z - bz;
             pRange = sqrtf(dx * dx + dy * dy + dz * dz);
             if (fabsf(pRange - range) > 3 * stdRange)
-                bp->w *= minWeight;
-            bcnSum += bp->w;
+                pfBcn_scaleWeight(sp, minWeight);
+            bcnSum += pfBcn_weight(sp);
+        }
+        tp->w = PF_WEIGHT_MUL(tp->w, PF_WEIGHT_FACTOR(bcnSum));
+        PF_WEIGHT_PASS_MAX(pass, tp->w);
+    }
+    PF_WEIGHT_PASS_END(pf, pass);
+}
+
+void pfMeasurement_applyRssiLoc(particleFilterLoc_t* pf, float bx, float by, float bz, const pfRssiModel_t* model, int rssi)
+{
+    int i, row;
+    tagParticle_t* tp;
+    float* pRange = pf->rangeBuf;
+
+    row = pfRssi_row(rssi);
+    pfCpu_kernels()->ranges(pf->pTag, pf->numParticles, bx, by, bz, pRange);
+    PF_WEIGHT_PASS_BEGIN(pf, pass);
+    for (i = 0; i < pf->numParticles; ++i)
+    {
+        tp = &pf->pTag[i];
+        PF_WEIGHT_PASS_FOLD(pass, tp->w);
+        tp->w = PF_WEIGHT_MUL(tp->w, pfRssi_likelihood(model, row, pfRssi_bin(pRange[i])));
+        PF_WEIGHT_PASS_MAX(pass, tp->w);
+    }
+    PF_WEIGHT_PASS_END(pf, pass);
+}
+
+void pfMeasurement_applyRssiSlam(particleFilterSlam_t* pf, bcn_t* bcn, const pfRssiModel_t* model, int rssi)
+{
+    int i, j, row;
+    tagParticle_t* tp;
+    bcnStore_t* sp;
+    const float* origin;
+    float dx, dy, dz, bx, by, bz, pRange, bcnSum;
+
+    row = pfRssi_row(rssi);
+    PF_WEIGHT_PASS_BEGIN(pf, pass);
+    for (i = 0; i < PF_N_TAG_SLAM; ++i)
+    {
+        tp = &pf->pTag[i];
+        PF_WEIGHT_PASS_FOLD(pass, tp->w);
+        origin = pfBcn_origin(bcn, i);
+        bcnSum = 0.0f;
+        for (j = 0; j < PF_N_BCN; ++j)
+        {
+            sp = &bcn->pBcn[i][j];
+            pfBcn_loadXyz(&bx, &by, &bz, sp, origin);
+            dx = tp->x - bx;
+            dy = tp->y - by;
+            dz = tp->z - bz;
+            pRange = sqrtf(dx * dx + dy * dy + dz * dz);
+            pfBcn_scaleWeight(sp, pfRssi_scale(model, row, pfRssi_bin(pRange)));
+            bcnSum += pfBcn_weight(sp);
         }
-        tp->w *= bcnSum;
+        tp->w = PF_WEIGHT_MUL(tp->w, PF_WEIGHT_FACTOR(bcnSum));
+        PF_WEIGHT_PASS_MAX(pass, tp->w);
     }
+    PF_WEIGHT_PASS_END(pf, pass);
 }
@@ -13,10 +13,12 @@
 #define _USE_MATH_DEFINES
 #include <math.h>
 #undef _USE_MATH_DEFINES
+#include <stdint.h>
 #include <stdlib.h>
 #include <time.h>
 
 #include "particleFilter.h"
+#include "pfCpu.h"
 #include "pfRandom.h"
 
 #if defined(_WIN32)
@@ -51,29 +53,34 @@ int rand_r_func(unsigned *seed)
 unsigned int PF_SEED = 0;
 int PF_SEED_SET = 0;
 
-static float _uniformNonzero(void);
+static float _uniformNonzero(unsigned int* seed);
 
-void pfRandom_init(void)
+void pfRandom_init(unsigned int* seed)
 {
-    if (!PF_SEED_SET)
-        PF_SEED = (unsigned int)time(NULL);
+    // Every filter owns its generator state so filters on different threads
+    // never share one. Unseeded filters mix in their own address so two
+    // filters created in the same second do not draw the same stream
+    if (PF_SEED_SET)
+        *seed = PF_SEED;
+    else
+        *seed = (unsigned int)time(NULL) ^ (unsigned int)((size_t)seed * 2654435761u);
 }
 
-float pfRandom_uniform(void)
+float pfRandom_uniform(unsigned int* seed)
 {
-    return (float)rand_r_func(&PF_SEED) / RAND_R_MAX_ACTUAL;
+    return (float)rand_r_func(seed) / RAND_R_MAX_ACTUAL;
 }
 
-void pfRandom_normal2(float* x, float* y)
+void pfRandom_normal2(unsigned int* seed, float* x, float* y)
 {
-    float f = sqrtf(-2 * logf(_uniformNonzero()));
-    float g = _uniformNonzero() * 2 * (float)M_PI;
+    float f = sqrtf(-2 * logf(_uniformNonzero(seed)));
+    float g = _uniformNonzero(seed) * 2 * (float)M_PI;
     
     *x = f * cosf(g);
     *y = f * sinf(g);
 }
 
-void pfRandom_sphere(float* x, float* y, float* z, float range, float stdRange)
+void pfRandom_sphere(unsigned int* seed, float* x, float* y, float* z, float range, float stdRange)
 {
     int i;
     float rad, radTmp, elev, azim, c;
@@ -81,15 +88,15 @@ void pfRandom_sphere(float* x, float* y, float* z, float range, float stdRange)
     rad = 0.0f;
     for (i = 0; i < 10; ++i)
     {
-        radTmp = range + 3 * stdRange * (pfRandom_uniform() * 2 - 1);
+        radTmp = range + 3 * stdRange * (pfRandom_uniform(seed) * 2 - 1);
         if (radTmp < 0.0f)
             continue;
         rad = radTmp;
         break;
     }
     
-    elev = asinf(pfRandom_uniform() * 2 - 1);
-    azim = pfRandom_uniform() * 2 * (float)M_PI;
+    elev = asinf(pfRandom_uniform(seed) * 2 - 1);
+    azim = pfRandom_uniform(seed) * 2 * (float)M_PI;
     
     c = rad * cosf(elev);
     *x = c * cosf(azim);
@@ -97,7 +104,33 @@ void pfRandom_sphere(float* x, float* y, float* z, float range, float stdRange)
     *z = rad * sinf(elev);
 }
 
-static float _uniformNonzero(void)
+// Draws a key for pfRandom_hash() from the filter's generator, so seeded
+// runs still repeat
+uint32_t pfRandom_key(unsigned int* seed)
 {
-    return (float)(rand_r_func(&PF_SEED) + 1) / ((float)RAND_R_MAX_ACTUAL + 1);
+    return (uint32_t)rand_r_func(seed) ^ ((uint32_t)rand_r_func(seed) << 16);
+}
+
+// Same distribution as n calls to pfRandom_sphere() plus a uniform heading,
+// written as one branch-free loop that pfKernels.c vectorizes:
+//  - draws are counter-based (pfRandom_hash()) instead of the rand_r()
+//    recurrence
+//  - the radius is drawn over the non-negative part of the shell directly
+//    rather than by rejection
+//  - z uniform in [-1, 1] replaces asinf() for the elevation, and the
+//    azimuth's sine and cosine come from polynomials for its half angle
+void pfRandom_sphereBulk(unsigned int* seed, float* x, float* y, float* z, float* theta, int n, float range, float stdRange)
+{
+    float lo, hi;
+
+    lo = range - 3 * stdRange;
+    lo = lo > 0.0f ? lo : 0.0f;
+    hi = range + 3 * stdRange;
+    hi = hi > lo ? hi : lo;
+    pfCpu_kernels()->sphere(pfRandom_key(seed), lo, hi, x, y, z, theta, n);
+}
+
+static float _uniformNonzero(unsigned int* seed)
+{
+    return (float)(rand_r_func(seed) + 1) / ((float)RAND_R_MAX_ACTUAL + 1);
 }
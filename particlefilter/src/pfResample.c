@@ -15,48 +15,66 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "pfBcn.h"
 #include "pfInit.h"
 #include "pfRandom.h"
 #include "pfResample.h"
+#include "pfStats.h"
+#include "pfWeight.h"
 
 #define RESAMPLE_THRESH     (0.5f)
 #define RADIUS_SPAWN_THRESH (4.0f)
 #define WEIGHT_SPAWN_THRESH (0.4f)
 #define PCT_SPAWN           (0.05f)
 #define HXYZ                (0.1f)
+#define METROPOLIS_STEPS    (128)
+#define SCAN_BLOCK          (256)
+#define MAX_PARTICLES       (PF_N_TAG_LOC > PF_N_BCN ? PF_N_TAG_LOC : PF_N_BCN)
 
-static void _resampleBcn(bcn_t* bcn, const particleFilterSlam_t* pf, float range, float stdRange, uint8_t force);
+static void _resampleBcn(bcn_t* bcn, particleFilterSlam_t* pf, float range, float stdRange, uint8_t force);
+static void _prefixSum(const float* weights, float* weightCdf, int n);
+static int _firstChild(float cdf, float rStart, float rStep, int n);
+static void _metropolis(uint32_t key, const float* weights, int* ancestors, int n);
 
 void pfResample_resampleLoc(particleFilterLoc_t* pf, float bx, float by, float bz, float range, float stdRange)
 {
-    int numSpawn, i, j;
+    int numSpawn, i;
     tagParticle_t* tp;
-    float invN, w, s, ss, csum, ssum, ess, htheta, m, rStart, rStep;
-    float weightCdf[PF_N_TAG_LOC];
+    float invN, w, s, ss, csum, ssum, ess, htheta, m;
+    float* weights = pf->weightBuf;
+    float* weightCdf = pf->cdfBuf;
+    int* ancestors = pf->ancestorBuf;
 
+    PF_STATS_BEGIN(span);
     s = 0.0f;
     ss = 0.0f;
     csum = 0.0f;
     ssum = 0.0f;
-    for (i = 0; i < PF_N_TAG_LOC; ++i)
+    for (i = 0; i < pf->numParticles; ++i)
     {
         tp = &pf->pTag[i];
-        w = tp->w;
+        w = PF_WEIGHT_VALUE(pf, tp->w);
         s += w;
         ss += w * w;
         csum += w * cosf(tp->theta);
         ssum += w * sinf(tp->theta);
+        weights[i] = w;
         weightCdf[i] = s;
     }
     ess = s * s / ss;
 
-    invN = 1.0f / PF_N_TAG_LOC;
+    invN = 1.0f / pf->numParticles;
+    PF_STATS_END(&pf->stats, ess, span);
+    PF_STATS_WEIGHTS(&pf->stats, ess * invN, PF_WEIGHT_MEAN(pf, s * invN));
     numSpawn = 0;
-    if (s * invN < WEIGHT_SPAWN_THRESH && range < RADIUS_SPAWN_THRESH)
-        numSpawn = (int)lroundf(PF_N_TAG_LOC * PCT_SPAWN);
+    if (PF_WEIGHT_MEAN(pf, s * invN) < WEIGHT_SPAWN_THRESH && range < RADIUS_SPAWN_THRESH)
+        numSpawn = (int)lroundf(pf->numParticles * PCT_SPAWN);
 
     if (ess * invN < RESAMPLE_THRESH || numSpawn > 0)
     {
+        PF_STATS_ADD(&pf->stats, numResampleTriggered, 1);
+        PF_STATS_ADD(&pf->stats, numSpawnEvents, numSpawn > 0);
+        PF_STATS_ADD(&pf->stats, numSpawnedParticles, numSpawn);
         csum /= s;
         ssum /= s;
         htheta = csum * csum + ssum * ssum;
@@ -64,32 +82,63 @@ void pfResample_resampleLoc(particleFilterLoc_t* pf, float bx, float by, float b
         htheta = htheta < 1 - 1e-10f ? htheta : 1 - 1e-10f;
         htheta = sqrtf(-logf(htheta) / ess);
 
-        rStep = invN * s;
-        rStart = pfRandom_uniform() * rStep;
+        pfResample_ancestors(pf->resampler, &pf->seed, weights, weightCdf, ancestors, pf->numParticles, s);
+        for (i = 0; i < pf->numParticles; ++i)
+            pfInit_spawnTagParticleFromOther(&pf->seed, &pf->pTagBuf[i], &pf->pTag[ancestors[i]], HXYZ, htheta);
 
-        for (i = 0, j = 0; i < PF_N_TAG_LOC; ++j)
-            for (; i < PF_N_TAG_LOC && (rStart + rStep * i) < weightCdf[j]; ++i)
-                pfInit_spawnTagParticleFromOther(&pf->pTagBuf[i], &pf->pTag[j], HXYZ, htheta);
-
-        memcpy(pf->pTag, pf->pTagBuf, sizeof(pf->pTagBuf));
+        memcpy(pf->pTag, pf->pTagBuf, pf->numParticles * sizeof(tagParticle_t));
         for (i = 0; i < numSpawn; ++i)
-            pfInit_spawnTagParticleFromRange(&pf->pTag[i], bx, by, bz, range, stdRange);
+            pfInit_spawnTagParticleFromRange(&pf->seed, &pf->pTag[i], bx, by, bz, range, stdRange);
+        PF_WEIGHT_RESET(pf);
     }
     else
     {
-        m = PF_N_TAG_LOC / s;
-        for (i = 0; i < PF_N_TAG_LOC; ++i)
-            pf->pTag[i].w *= m;
+        PF_STATS_ADD(&pf->stats, numResampleSkipped, 1);
+        m = pf->numParticles / s;
+        PF_WEIGHT_NORMALIZE(pf, pf->numParticles, m);
     }
 }
 
-void pfResample_resampleSlam(particleFilterSlam_t* pf, bcn_t* bcn, float range, float stdRange, bcn_t** allBcns, int numBcns)
+// Draws numParticles particles from those in use, one from each of as many
+// equal strata of the weight CDF. Shrinking keeps a spread-out subset and
+// growing repeats the heavier ones; either way the weights start over, so
+// the estimate is unchanged up to the sampling
+void pfResample_resizeLoc(particleFilterLoc_t* pf, int numParticles)
 {
     int i, j;
+    float s, r, step;
+    float* weightCdf = pf->cdfBuf;
+
+    s = 0.0f;
+    for (i = 0; i < pf->numParticles; ++i)
+    {
+        s += PF_WEIGHT_VALUE(pf, pf->pTag[i].w);
+        weightCdf[i] = s;
+    }
+    step = s / numParticles;
+    r = pfRandom_uniform(&pf->seed) * step;
+    for (i = 0, j = 0; i < numParticles; ++i, r += step)
+    {
+        while (j < pf->numParticles - 1 && weightCdf[j] < r)
+            ++j;
+        pf->pTagBuf[i] = pf->pTag[j];
+        pf->pTagBuf[i].w = PF_WEIGHT_ONE;
+    }
+    memcpy(pf->pTag, pf->pTagBuf, numParticles * sizeof(tagParticle_t));
+    pf->numParticles = numParticles;
+    PF_WEIGHT_RESET(pf);
+}
+
+void pfResample_resampleSlam(particleFilterSlam_t* pf, bcn_t* bcn, float range, float stdRange, bcn_t** allBcns, int numBcns)
+{
+    int i;
     tagParticle_t* tp;
-    float invN, w, s, ss, csum, ssum, ess, htheta, m, rStart, rStep;
+    float invN, w, s, ss, csum, ssum, ess, htheta, m;
+    float weights[PF_N_TAG_SLAM];
     float weightCdf[PF_N_TAG_SLAM];
+    int ancestors[PF_N_TAG_SLAM];
     
+    PF_STATS_BEGIN(span);
     s = 0.0f;
     ss = 0.0f;
     csum = 0.0f;
@@ -97,18 +146,22 @@ void pfResample_resampleSlam(particleFilterSlam_t* pf, bcn_t* bcn, float range,
     for (i = 0; i < PF_N_TAG_SLAM; ++i)
     {
         tp = &pf->pTag[i];
-        w = tp->w;
+        w = PF_WEIGHT_VALUE(pf, tp->w);
         s += w;
         ss += w * w;
         csum += w * cosf(tp->theta);
         ssum += w * sinf(tp->theta);
+        weights[i] = w;
         weightCdf[i] = s;
     }
     ess = s * s / ss;
     
     invN = 1.0f / PF_N_TAG_SLAM;
+    PF_STATS_END(&pf->stats, ess, span);
+    PF_STATS_WEIGHTS(&pf->stats, ess * invN, PF_WEIGHT_MEAN(pf, s * invN));
     if (ess * invN < RESAMPLE_THRESH)
     {
+        PF_STATS_ADD(&pf->stats, numResampleTriggered, 1);
         csum /= s;
         ssum /= s;
         htheta = csum * csum + ssum * ssum;
@@ -116,14 +169,12 @@ void pfResample_resampleSlam(particleFilterSlam_t* pf, bcn_t* bcn, float range,
         htheta = htheta < 1 - 1e-10f ? htheta : 1 - 1e-10f;
         htheta = sqrtf(-logf(htheta) / ess);
         
-        rStep = invN * s;
-        rStart = pfRandom_uniform() * rStep;
-        
-        for (i = 0, j = 0; i < PF_N_TAG_SLAM; ++j)
-            for (; i < PF_N_TAG_SLAM && (rStart + rStep * i) < weightCdf[j]; ++i)
-                pfInit_spawnTagParticleFromOther(&pf->pTagBuf[i], &pf->pTag[j], HXYZ, htheta);
+        pfResample_ancestors(pf->resampler, &pf->seed, weights, weightCdf, ancestors, PF_N_TAG_SLAM, s);
+        for (i = 0; i < PF_N_TAG_SLAM; ++i)
+            pfInit_spawnTagParticleFromOther(&pf->seed, &pf->pTagBuf[i], &pf->pTag[ancestors[i]], HXYZ, htheta);
         
         memcpy(pf->pTag, pf->pTagBuf, sizeof(pf->pTagBuf));
+        PF_WEIGHT_RESET(pf);
         
         for (i = 0; i < numBcns; ++i)
             if (allBcns[i]->initialized)
@@ -131,35 +182,42 @@ void pfResample_resampleSlam(particleFilterSlam_t* pf, bcn_t* bcn, float range,
     }
     else
     {
+        PF_STATS_ADD(&pf->stats, numResampleSkipped, 1);
         m = PF_N_TAG_SLAM / s;
-        for (i = 0; i < PF_N_TAG_SLAM; ++i)
-            pf->pTag[i].w *= m;
+        PF_WEIGHT_NORMALIZE(pf, PF_N_TAG_SLAM, m);
         _resampleBcn(bcn, pf, range, stdRange, 0);
     }
 }
 
-static void _resampleBcn(bcn_t* bcn, const particleFilterSlam_t* pf, float range, float stdRange, uint8_t force)
+static void _resampleBcn(bcn_t* bcn, particleFilterSlam_t* pf, float range, float stdRange, uint8_t force)
 {
     int numSpawn, i, j, k;
     const tagParticle_t* tp;
-    bcnParticle_t* bp;
-    float invN, w, s, ss, csum, ssum, ess, htheta, m, rStart, rStep;
+    bcnParticle_t bp, parent;
+    const float* origin;
+    float newOrigin[3];
+    pfBcnScale_t scale;
+    float invN, w, s, ss, csum, ssum, ess, htheta;
+    float weights[PF_N_BCN];
     float weightCdf[PF_N_BCN];
+    int ancestors[PF_N_BCN];
     
     for (k = 0; k < PF_N_TAG_SLAM; ++k)
     {
+        origin = pfBcn_origin(bcn, k);
         s = 0.0f;
         ss = 0.0f;
         csum = 0.0f;
         ssum = 0.0f;
         for (i = 0; i < PF_N_BCN; ++i)
         {
-            bp = &bcn->pBcn[k][i];
-            w = bp->w;
+            pfBcn_load(&bp, &bcn->pBcn[k][i], origin);
+            w = bp.w;
             s += w;
             ss += w * w;
-            csum += w * cosf(bp->theta);
-            ssum += w * sinf(bp->theta);
+            csum += w * cosf(bp.theta);
+            ssum += w * sinf(bp.theta);
+            weights[i] = w;
             weightCdf[i] = s;
         }
         ess = s * s / ss;
@@ -171,6 +229,8 @@ static void _resampleBcn(bcn_t* bcn, const particleFilterSlam_t* pf, float range
         
         if (ess * invN < RESAMPLE_THRESH || numSpawn > 0 || force)
         {
+            PF_STATS_ADD(&pf->stats, numSpawnEvents, numSpawn > 0);
+            PF_STATS_ADD(&pf->stats, numSpawnedParticles, numSpawn);
             csum /= s;
             ssum /= s;
             htheta = csum * csum + ssum * ssum;
@@ -178,24 +238,157 @@ static void _resampleBcn(bcn_t* bcn, const particleFilterSlam_t* pf, float range
             htheta = htheta < 1 - 1e-10f ? htheta : 1 - 1e-10f;
             htheta = sqrtf(-logf(htheta) / ess);
 
-            rStep = invN * s;
-            rStart = pfRandom_uniform() * rStep;
-            
-            for (i = 0, j = 0; i < PF_N_BCN; ++j)
-                for (; i < PF_N_BCN && (rStart + rStep * i) < weightCdf[j]; ++i)
-                    pfInit_spawnBcnParticleFromOther(&bcn->pBcnBuf[i], &bcn->pBcn[k][j], HXYZ, htheta);
+            pfResample_ancestors(pf->resampler, &pf->seed, weights, weightCdf, ancestors, PF_N_BCN, s);
+
+            // The row is re-centred on its tag particle, which is also where
+            // the spawned particles are drawn around
+            tp = &pf->pTag[k];
+            newOrigin[0] = tp->x;
+            newOrigin[1] = tp->y;
+            newOrigin[2] = tp->z;
+            for (i = 0, j = -1; i < PF_N_BCN; ++i)
+            {
+                if (ancestors[i] != j)
+                {
+                    j = ancestors[i];
+                    pfBcn_load(&parent, &bcn->pBcn[k][j], origin);
+                }
+                pfInit_spawnBcnParticleFromOther(&pf->seed, &bp, &parent, HXYZ, htheta);
+                pfBcn_store(&bcn->pBcnBuf[i], &bp, newOrigin);
+            }
             
             memcpy(bcn->pBcn[k], bcn->pBcnBuf, sizeof(bcn->pBcnBuf));
+            pfBcn_setOrigin(bcn, k, newOrigin);
             
-            tp = &pf->pTag[k];
             for (i = 0; i < numSpawn; ++i)
-                pfInit_spawnBcnParticleFromRange(&bcn->pBcn[k][i], tp, range, stdRange);
+            {
+                pfInit_spawnBcnParticleFromRange(&pf->seed, &bp, tp, range, stdRange);
+                pfBcn_store(&bcn->pBcn[k][i], &bp, newOrigin);
+            }
         }
         else
         {
-            m = PF_N_BCN / s;
+            scale = pfBcn_scale(PF_N_BCN / s);
             for (i = 0; i < PF_N_BCN; ++i)
-                bcn->pBcn[k][i].w *= m;
+                pfBcn_scaleWeight(&bcn->pBcn[k][i], scale);
+        }
+    }
+}
+
+// Picks the particle each of the n children is drawn from, given the
+// weights, their sum s and, for systematic resampling, their running sum in
+// weightCdf. Systematic resampling walks the CDF once. The parallel form
+// rebuilds the CDF with a blocked prefix sum and gives every parent the run
+// of children its interval covers, so both passes split into independent
+// pieces. Metropolis runs a short chain per child on weight ratios and
+// needs neither the sum nor the CDF
+void pfResample_ancestors(uint8_t resampler, unsigned int* seed, const float* weights, float* weightCdf, int* ancestors, int n, float s)
+{
+    int i, j, first, last;
+    float rStart, rStep;
+
+    if (resampler == PF_RESAMPLE_METROPOLIS)
+    {
+        _metropolis(pfRandom_key(seed), weights, ancestors, n);
+        return;
+    }
+
+    rStep = (1.0f / n) * s;
+    rStart = pfRandom_uniform(seed) * rStep;
+    if (resampler == PF_RESAMPLE_PARALLEL_SYSTEMATIC && rStep > 0.0f)
+    {
+        _prefixSum(weights, weightCdf, n);
+#if defined(_OPENMP)
+#pragma omp parallel for private(i, first, last)
+#endif
+        for (j = 0; j < n; ++j)
+        {
+            first = j > 0 ? _firstChild(weightCdf[j - 1], rStart, rStep, n) : 0;
+            last = j < n - 1 ? _firstChild(weightCdf[j], rStart, rStep, n) : n;
+            for (i = first; i < last; ++i)
+                ancestors[i] = j;
+        }
+        return;
+    }
+
+    for (i = 0, j = 0; i < n && j < n; ++j)
+        for (; i < n && (rStart + rStep * i) < weightCdf[j]; ++i)
+            ancestors[i] = j;
+    // Rounding in the CDF can leave the last children without a parent
+    for (; i < n; ++i)
+        ancestors[i] = n - 1;
+}
+
+static void _prefixSum(const float* weights, float* weightCdf, int n)
+{
+    int b, i, end, numBlocks;
+    float s, t;
+    float blockSum[(MAX_PARTICLES + SCAN_BLOCK - 1) / SCAN_BLOCK];
+
+    numBlocks = (n + SCAN_BLOCK - 1) / SCAN_BLOCK;
+#if defined(_OPENMP)
+#pragma omp parallel for private(i, end, s)
+#endif
+    for (b = 0; b < numBlocks; ++b)
+    {
+        end = (b + 1) * SCAN_BLOCK < n ? (b + 1) * SCAN_BLOCK : n;
+        s = 0.0f;
+        for (i = b * SCAN_BLOCK; i < end; ++i)
+            s += weights[i];
+        blockSum[b] = s;
+    }
+    for (b = 0, s = 0.0f; b < numBlocks; ++b)
+    {
+        t = blockSum[b];
+        blockSum[b] = s;
+        s += t;
+    }
+#if defined(_OPENMP)
+#pragma omp parallel for private(i, end, s)
+#endif
+    for (b = 0; b < numBlocks; ++b)
+    {
+        end = (b + 1) * SCAN_BLOCK < n ? (b + 1) * SCAN_BLOCK : n;
+        s = blockSum[b];
+        for (i = b * SCAN_BLOCK; i < end; ++i)
+        {
+            s += weights[i];
+            weightCdf[i] = s;
+        }
+    }
+}
+
+// The first child whose systematic draw lands at or past cdf
+static int _firstChild(float cdf, float rStart, float rStep, int n)
+{
+    float c;
+
+    c = ceilf((cdf - rStart) / rStep);
+    return c < 0.0f ? 0 : (c > (float)n ? n : (int)c);
+}
+
+// Murray, Lee and Jacob, "Parallel resampling in the particle filter" (2016).
+// Unbiased only in the limit of a long chain: with the largest weight ten
+// times the mean, heavy particles get 13% too few children after 32 steps, 2%
+// after 64 and none measurable after METROPOLIS_STEPS
+static void _metropolis(uint32_t key, const float* weights, int* ancestors, int n)
+{
+    int i, b, j, k;
+    uint32_t ctr;
+
+#if defined(_OPENMP)
+#pragma omp parallel for private(b, j, k, ctr)
+#endif
+    for (i = 0; i < n; ++i)
+    {
+        k = i;
+        ctr = key + (uint32_t)i * (2u * METROPOLIS_STEPS);
+        for (b = 0; b < METROPOLIS_STEPS; ++b, ctr += 2u)
+        {
+            j = (int)(((uint64_t)pfRandom_hash(ctr) * (uint32_t)n) >> 32);
+            if (pfRandom_hashUniform(ctr + 1u) * weights[k] < weights[j])
+                k = j;
         }
+        ancestors[i] = k;
     }
 }
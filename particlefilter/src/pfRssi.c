@@ -0,0 +1,61 @@
+/*
+ * pfRssi.c
+ * Created by slam3d contributors on 10/19/26.
+ *
+ * Copyright (c) 2026, Wireless Sensing and Embedded Systems Lab, Carnegie
+ * Mellon University
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-3-Clause license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <math.h>
+
+#include "pfRssi.h"
+
+#define MIN_DIST            (0.05f)
+#define MIN_WEIGHT          (0.1f)
+
+// Each row is scaled to peak at 1 (in the log domain, so far-off rows do not
+// underflow) and floored at MIN_WEIGHT, like the range model's out-of-bounds
+// weight, so one bad reading cannot zero a particle
+void particleFilterRssiModel_init(pfRssiModel_t* model, float txPower, float exponent, float stdRssi)
+{
+    int i, j, rssi;
+    float d, z, m, maxRange;
+    float* lik;
+
+    model->txPower = txPower;
+    model->exponent = exponent;
+    model->stdRssi = stdRssi;
+    maxRange = PF_RSSI_BINS * PF_RSSI_BIN_SIZE;
+    for (i = 0; i <= PF_RSSI_MAX - PF_RSSI_MIN; ++i)
+    {
+        rssi = PF_RSSI_MIN + i;
+        lik = model->lik[i];
+        m = INFINITY;
+        for (j = 0; j < PF_RSSI_BINS; ++j)
+        {
+            d = fmaxf((j + 0.5f) * PF_RSSI_BIN_SIZE, MIN_DIST);
+            z = (rssi - (txPower - 10.0f * exponent * log10f(d))) / stdRssi;
+            lik[j] = 0.5f * z * z;
+            m = fminf(m, lik[j]);
+        }
+        for (j = 0; j < PF_RSSI_BINS; ++j)
+        {
+            lik[j] = fmaxf(expf(m - lik[j]), MIN_WEIGHT);
+#if defined(PF_COMPACT_BCN) && PF_COMPACT_BCN
+            model->logLik[i][j] = (int16_t)pfBcn_scale(lik[j]);
+#endif
+#if defined(PF_LOG_WEIGHTS) && PF_LOG_WEIGHTS
+            model->lnLik[i][j] = logf(lik[j]);
+#endif
+        }
+
+        // The inverted model, for spawning particles around the beacon. The
+        // spread is the shadowing carried through to first order
+        model->range[i] = fminf(powf(10.0f, (txPower - rssi) / (10.0f * exponent)), maxRange);
+        model->stdRange[i] = model->range[i] * logf(10.0f) * stdRssi / (10.0f * exponent);
+    }
+}
@@ -0,0 +1,85 @@
+/*
+ * pfStats.c
+ * Created by slam3d contributors on 10/19/26.
+ *
+ * Copyright (c) 2026, Wireless Sensing and Embedded Systems Lab, Carnegie
+ * Mellon University
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-3-Clause license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#if !defined(_WIN32) && !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 199309L
+#endif
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define PF_STATS_HAVE_TSC
+#elif (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h>
+#define PF_STATS_HAVE_TSC
+#endif
+
+#include "pfStats.h"
+#include "pfTrace.h"
+
+void pfStats_reset(pfStats_t* stats)
+{
+    memset(stats, 0, sizeof(pfStats_t));
+}
+
+void pfStats_begin(pfStatsSpan_t* span)
+{
+#if defined(PF_STATS_HAVE_TSC)
+    span->cycles = (uint64_t)__rdtsc();
+#else
+    span->cycles = 0;
+#endif
+    span->ns = pfTrace_now();
+}
+
+void pfStats_end(pfStatsTimer_t* timer, const pfStatsSpan_t* span)
+{
+    uint64_t ns;
+
+    ns = pfTrace_now() - span->ns;
+#if defined(PF_STATS_HAVE_TSC)
+    timer->cycles += (uint64_t)__rdtsc() - span->cycles;
+#endif
+    timer->ns += ns;
+    if (ns > timer->maxNs)
+        timer->maxNs = ns;
+    ++timer->count;
+}
+
+void pfStats_recordWeights(pfStats_t* stats, float essN, float sN)
+{
+    int bin, exp;
+
+    // ESS / N is in [0, 1], linear bins
+    bin = (int)(essN * PF_STATS_HIST_BINS);
+    bin = bin > 0 ? bin : 0;
+    bin = bin < PF_STATS_HIST_BINS - 1 ? bin : PF_STATS_HIST_BINS - 1;
+    ++stats->essHist[bin];
+
+    // Weight sum / N is 1 after normalization and decays with every gate
+    // failure, bin k holds [2^-(k + 1), 2^-k)
+    bin = 0;
+    if (sN > 0.0f && sN < 1.0f)
+    {
+        frexpf(sN, &exp);
+        bin = -exp;
+    }
+    else if (sN <= 0.0f)
+    {
+        bin = PF_STATS_HIST_BINS - 1;
+    }
+    bin = bin < PF_STATS_HIST_BINS - 1 ? bin : PF_STATS_HIST_BINS - 1;
+    ++stats->weightSumHist[bin];
+}
@@ -0,0 +1,236 @@
+/*
+ * pfTrace.c
+ * Created by slam3d contributors on 10/19/26.
+ *
+ * Copyright (c) 2026, Wireless Sensing and Embedded Systems Lab, Carnegie
+ * Mellon University
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-3-Clause license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#if !defined(_WIN32) && !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 199309L
+#endif
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+#endif
+
+#include "pfTrace.h"
+
+// Each thread records into its own ring, so a span costs two clock reads
+// and a copy and never a lock. Rings are pushed onto a list the first time
+// their thread records, and stay there after it exits so its spans are
+// still dumped
+#if defined(_MSC_VER)
+#define PF_TRACE_TLS                    __declspec(thread)
+#define PF_TRACE_LOAD(p)                InterlockedCompareExchangePointer((PVOID volatile*)(p), NULL, NULL)   // a full barrier, unlike a volatile read under /volatile:iso or on ARM
+#define PF_TRACE_CAS(p, old, new)       (InterlockedCompareExchangePointer((PVOID volatile*)(p), (new), (old)) == (old))
+#else
+#define PF_TRACE_TLS                    __thread
+#define PF_TRACE_LOAD(p)                __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define PF_TRACE_CAS(p, old, new)       __sync_bool_compare_and_swap((p), (old), (new))
+#endif
+
+typedef struct
+{
+    const char* name;
+    uint64_t beginNs;
+    uint64_t durNs;
+    char arg[PF_TRACE_ARG_LEN];
+
+} _span_t;
+
+typedef struct _ring_s
+{
+    struct _ring_s* next;
+    _span_t* spans;             // allocated by the first span recorded
+    uint64_t count;             // ever recorded, the ring holds the last len
+    uint32_t len;
+    uint32_t tid;
+    uint8_t failed;
+    char arg[PF_TRACE_ARG_LEN];
+    char name[PF_TRACE_NAME_LEN];
+
+} _ring_t;
+
+static _ring_t* _threadRing(void);
+static void _writeString(FILE* file, const char* s);
+
+static volatile int _enabled;
+static volatile uint32_t _len = PF_TRACE_DEFAULT_LEN;
+static _ring_t* volatile _rings;
+static PF_TRACE_TLS _ring_t* _ring;
+
+// Starts recording, keeping the last spansPerThread spans of each thread
+// (PF_TRACE_DEFAULT_LEN if 0). A thread's ring is sized at its first span
+void pfTrace_start(uint32_t spansPerThread)
+{
+    _len = spansPerThread > 0 ? spansPerThread : PF_TRACE_DEFAULT_LEN;
+    _enabled = 1;
+}
+
+void pfTrace_stop(void)
+{
+    _enabled = 0;
+}
+
+// Monotonic ns, the clock spans and pfStats timers are read from
+uint64_t pfTrace_now(void)
+{
+#if defined(_WIN32)
+    static LARGE_INTEGER freq;
+    LARGE_INTEGER now;
+
+    if (freq.QuadPart == 0)
+        QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&now);
+    return (uint64_t)((double)now.QuadPart * 1e9 / (double)freq.QuadPart);
+#else
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+// A span from beginNs, read with pfTrace_now(), to now. name must outlive
+// pfTrace_dump(), a string literal in practice
+void pfTrace_record(const char* name, uint64_t beginNs)
+{
+    _ring_t* ring;
+    _span_t* span;
+    uint64_t endNs;
+
+    if (!_enabled)
+        return;
+    endNs = pfTrace_now();
+    if ((ring = _threadRing()) == NULL || ring->failed)
+        return;
+    if (ring->spans == NULL)
+    {
+        ring->len = _len;
+        if ((ring->spans = (_span_t*)malloc(ring->len * sizeof(_span_t))) == NULL)
+        {
+            ring->failed = 1;
+            return;
+        }
+    }
+    span = &ring->spans[ring->count % ring->len];
+    span->name = name;
+    span->beginNs = beginNs;
+    span->durNs = endNs - beginNs;
+    memcpy(span->arg, ring->arg, PF_TRACE_ARG_LEN);
+    ++ring->count;
+}
+
+// Tags every span the calling thread records from now on, e.g. with the
+// client a worker is updating. NULL or "" clears it. Ignored while not
+// recording, so callers need not check
+void pfTrace_setArg(const char* arg)
+{
+    _ring_t* ring;
+
+    if (!_enabled || (ring = _threadRing()) == NULL)
+        return;
+    if (arg == NULL)
+        arg = "";
+    strncpy(ring->arg, arg, PF_TRACE_ARG_LEN - 1);
+}
+
+void pfTrace_setThreadName(const char* name)
+{
+    _ring_t* ring;
+
+    if ((ring = _threadRing()) == NULL)
+        return;
+    strncpy(ring->name, name, PF_TRACE_NAME_LEN - 1);
+}
+
+// Writes every thread's spans as {"traceEvents": [...]}. No thread may be
+// recording, so stop first and let the threads finish their spans. Returns
+// 0 if path cannot be written
+uint8_t pfTrace_dump(const char* path)
+{
+    FILE* file;
+    _ring_t* ring;
+    _span_t* span;
+    uint64_t i, first, dropped;
+    const char* sep;
+
+    if ((file = fopen(path, "w")) == NULL)
+        return 0;
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+    sep = "\n";
+    dropped = 0;
+    for (ring = PF_TRACE_LOAD(&_rings); ring != NULL; ring = ring->next)
+    {
+        if (ring->name[0] != '\0')
+        {
+            fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":", sep, ring->tid);
+            _writeString(file, ring->name);
+            fprintf(file, "}}");
+            sep = ",\n";
+        }
+        first = ring->count > ring->len ? ring->count - ring->len : 0;
+        dropped += first;
+        for (i = first; i < ring->count; ++i)
+        {
+            span = &ring->spans[i % ring->len];
+            fprintf(file, "%s{\"name\":", sep);
+            _writeString(file, span->name);
+            fprintf(file, ",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f", ring->tid, span->beginNs / 1e3, span->durNs / 1e3);
+            if (span->arg[0] != '\0')
+            {
+                fprintf(file, ",\"args\":{\"tag\":");
+                _writeString(file, span->arg);
+                fprintf(file, "}");
+            }
+            fprintf(file, "}");
+            sep = ",\n";
+        }
+    }
+    fprintf(file, "\n],\"otherData\":{\"droppedSpans\":%llu}}\n", (unsigned long long)dropped);
+    return fclose(file) == 0;
+}
+
+static _ring_t* _threadRing(void)
+{
+    _ring_t* ring;
+
+    if (_ring != NULL)
+        return _ring;
+    if ((ring = (_ring_t*)calloc(1, sizeof(_ring_t))) == NULL)
+        return NULL;
+    do
+    {
+        ring->next = PF_TRACE_LOAD(&_rings);
+        ring->tid = ring->next != NULL ? ring->next->tid + 1 : 1;
+    } while (!PF_TRACE_CAS(&_rings, ring->next, ring));
+    _ring = ring;
+    return ring;
+}
+
+// JSON string, quoted and escaped
+static void _writeString(FILE* file, const char* s)
+{
+    fputc('"', file);
+    for (; *s != '\0'; ++s)
+    {
+        if (*s == '"' || *s == '\\')
+            fprintf(file, "\\%c", *s);
+        else if ((unsigned char)*s < 0x20)
+            fprintf(file, "\\u%04x", (unsigned char)*s);
+        else
+            fputc(*s, file);
+    }
+    fputc('"', file);
+}
@@ -10,16 +10,21 @@
  * LICENSE file in the root directory of this source tree.
  */
 
+#include <math.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <float.h>
 #include <time.h>
 
 #include "particleFilter.h"
+#include "pfCpu.h"
+#include "pfResample.h"
 
-// Only one test for now, so keep it simple
+// Unit tests of what the regression below cannot see, then the regression
+// itself on recorded data
 
 #define NUM_BCNS            (4)
 #define UWB_STD             (0.1f)
@@ -34,13 +39,32 @@
 #define EXPECTED_FILE       argv[3 + noFail]
 #define LINE_LEN            (1024)
 #define SEED                (123456789)
+#define UNIT_BCNS           (4)
+#define UNIT_SLAM_BCNS      (2)     // every step moves all of their particles, keep it quick
+#define UNIT_DRAWS          (20)
+#define UNIT_METROPOLIS_N   (200)
+#define UNIT_METROPOLIS_R   (2000)
+#define UNIT_KERNEL_N       (1003)  // not a multiple of any vector width, so the tails run too
+#define CHECK(cond)         do { if (!(cond)) { printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); ++_failures; } } while (0)
 
 static uint8_t _getVio(FILE* vioFile, double* t, float* x, float* y, float* z, uint8_t skipToWaypoint);
 static uint8_t _getUwb(FILE* uwbFile, double* t, uint8_t* b, float* r, uint8_t skipToWaypoint);
 static void _getDeployment(FILE* deployFile, float deployment[NUM_BCNS][3]);
 static void _writeTagLoc(FILE* outFile, double t, float x, float y, float z, float theta);
+static void _testCheckpoint(void);
+static void _testResample(void);
+static void _testKernels(void);
+static float _unitWeights(float* weights, float* weightCdf, int n, float sharpness);
+static void _feedLoc(particleFilterLoc_t* pf, int step);
+static void _feedSlam(particleFilterSlam_t* pf, bcn_t** bcns, int step);
+static float _unitRange(int step, int b);
+static uint8_t _sameLoc(const particleFilterLoc_t* a, const particleFilterLoc_t* b, float tol);
+static uint8_t _sameSlam(const particleFilterSlam_t* a, bcn_t** aBcns, const particleFilterSlam_t* b, bcn_t** bBcns);
 
 static particleFilterLoc_t _particleFilter;
+static int _failures;
+static unsigned int _unitLcg = 1;
+static const float _unitBcns[UNIT_BCNS][3] = { { 0.0f, 0.0f, 0.0f }, { 6.0f, 0.0f, 0.5f }, { 0.0f, 6.0f, 1.0f }, { 6.0f, 6.0f, 2.0f } };
 
 int main(int argc, char** argv) {
   if (argc < 4) {
@@ -60,6 +84,16 @@ int main(int argc, char** argv) {
   strcat(uwbFilePath, UWB_FILE);
   strcat(deployFilePath, DEPLOY_FILE);
 
+  printf("Starting unit tests\n");
+  _testCheckpoint();
+  _testResample();
+  _testKernels();
+  if (_failures > 0) {
+    printf("Unit tests failed, %d checks\n", _failures);
+    if (!noFail)
+      return 1;
+  }
+
   printf("Starting test\n");
 
   particleFilterSeed_set(SEED);
@@ -212,3 +246,266 @@ static void _writeTagLoc(FILE* outFile, double t, float x, float y, float z, flo
   }
   fprintf(outFile, "%lf,%f,%f,%f,%f\n", t, y, z, x, theta);
 }
+
+// Snapshots restore to the same estimate, and the restored filter goes on
+// exactly as the original would have
+static void _testCheckpoint(void) {
+  particleFilterLoc_t *loc, *locCopy;
+  particleFilterSlam_t *slam, *slamCopy;
+  bcn_t *bcns[UNIT_SLAM_BCNS], *bcnCopies[UNIT_SLAM_BCNS];
+  uint8_t* buf;
+  size_t len, bufLen;
+  int i, b;
+
+  particleFilterSeed_set(SEED);
+  bufLen = particleFilterLoc_checkpointSize();
+  bufLen = particleFilterSlam_checkpointBcnSize() > bufLen ? particleFilterSlam_checkpointBcnSize() : bufLen;
+  buf = (uint8_t*)malloc(bufLen);
+  loc = particleFilterLoc_new();
+  locCopy = particleFilterLoc_new();
+  slam = particleFilterSlam_new();
+  slamCopy = particleFilterSlam_new();
+  for (b = 0; b < UNIT_SLAM_BCNS; ++b) {
+    bcns[b] = particleFilterSlam_newBcn();
+    bcnCopies[b] = particleFilterSlam_newBcn();
+  }
+  assert(buf != NULL && loc != NULL && locCopy != NULL && slam != NULL && slamCopy != NULL);
+
+  // Localization
+  for (i = 0; i < 40; ++i)
+    _feedLoc(loc, i);
+  CHECK(particleFilterLoc_checkpoint(loc, buf, particleFilterLoc_checkpointSize() - 1) == 0);
+  len = particleFilterLoc_checkpoint(loc, buf, bufLen);
+  CHECK(len == particleFilterLoc_checkpointSize());
+  CHECK(particleFilterLoc_checkpointValid(buf, len));
+  CHECK(!particleFilterLoc_checkpointValid(buf, len - 1));
+  CHECK(!particleFilterSlam_restore(slamCopy, buf, len));
+  CHECK(particleFilterLoc_restore(locCopy, buf, len));
+  CHECK(_sameLoc(loc, locCopy, 0.0f));
+  for (i = 40; i < 60; ++i) {
+    _feedLoc(loc, i);
+    _feedLoc(locCopy, i);
+  }
+  CHECK(_sameLoc(loc, locCopy, 0.0f));
+
+  // Fewer particles are saved repeated and restore as a full filter
+  CHECK(particleFilterLoc_setNumParticles(loc, PF_N_TAG_LOC / 4) == PF_N_TAG_LOC / 4);
+  _feedLoc(loc, 60);
+  len = particleFilterLoc_checkpoint(loc, buf, bufLen);
+  CHECK(particleFilterLoc_restore(locCopy, buf, len));
+  CHECK(locCopy->numParticles == PF_N_TAG_LOC);
+  CHECK(_sameLoc(loc, locCopy, 1e-2f));
+
+  // Anything else is turned away without touching the filter
+  buf[0] ^= 1;
+  CHECK(!particleFilterLoc_checkpointValid(buf, len));
+  CHECK(!particleFilterLoc_restore(locCopy, buf, len));
+  buf[0] ^= 1;
+  memset(buf, 0, len);
+  CHECK(!particleFilterLoc_checkpointValid(buf, len));
+  CHECK(!particleFilterLoc_restore(locCopy, buf, len));
+  CHECK(locCopy->numParticles == PF_N_TAG_LOC && _sameLoc(loc, locCopy, 1e-2f));
+
+  // SLAM, the tag and each beacon snapshotted separately
+  for (i = 0; i < 8; ++i)
+    _feedSlam(slam, bcns, i);
+  len = particleFilterSlam_checkpoint(slam, buf, bufLen);
+  CHECK(len == particleFilterSlam_checkpointSize());
+  CHECK(!particleFilterLoc_checkpointValid(buf, len));
+  CHECK(particleFilterSlam_restore(slamCopy, buf, len));
+  for (b = 0; b < UNIT_SLAM_BCNS; ++b) {
+    CHECK(particleFilterSlam_checkpointBcn(bcns[b], buf, particleFilterSlam_checkpointBcnSize() - 1) == 0);
+    len = particleFilterSlam_checkpointBcn(bcns[b], buf, bufLen);
+    CHECK(len == particleFilterSlam_checkpointBcnSize());
+    CHECK(particleFilterSlam_restoreBcn(bcnCopies[b], buf, len));
+  }
+  CHECK(!particleFilterSlam_restore(slamCopy, buf, len));
+  CHECK(!particleFilterSlam_restoreBcn(bcnCopies[0], buf, len - 1));
+  CHECK(_sameSlam(slam, bcns, slamCopy, bcnCopies));
+  for (i = 8; i < 12; ++i) {
+    _feedSlam(slam, bcns, i);
+    _feedSlam(slamCopy, bcnCopies, i);
+  }
+  CHECK(_sameSlam(slam, bcns, slamCopy, bcnCopies));
+
+  for (b = 0; b < UNIT_SLAM_BCNS; ++b) {
+    particleFilterSlam_deleteBcn(bcns[b]);
+    particleFilterSlam_deleteBcn(bcnCopies[b]);
+  }
+  particleFilterSlam_delete(slam);
+  particleFilterSlam_delete(slamCopy);
+  particleFilterLoc_delete(loc);
+  particleFilterLoc_delete(locCopy);
+  free(buf);
+}
+
+// The parallel systematic draw picks the same ancestors as the serial one,
+// up to where rounding in the two running sums puts a boundary: a child may
+// move between parents only across weight that float sums of N terms cannot
+// resolve. Metropolis gives every particle its expected number of children
+// N * w / s once averaged over many draws
+static void _testResample(void) {
+  static float weights[PF_N_TAG_LOC], weightCdf[PF_N_TAG_LOC], parallelCdf[PF_N_TAG_LOC];
+  static int ancestors[PF_N_TAG_LOC], parallelAncestors[PF_N_TAG_LOC], children[PF_N_TAG_LOC], parallelChildren[PF_N_TAG_LOC];
+  static double meanChildren[UNIT_METROPOLIS_N];
+  const int sizes[] = { 777, PF_N_TAG_LOC };
+  unsigned int seed, parallelSeed;
+  int i, k, r, n, a, b;
+  float s, expected, slack, dev, gap, maxGap;
+
+  for (k = 0; k < (int)(sizeof(sizes) / sizeof(sizes[0])); ++k) {
+    n = sizes[k];
+    s = _unitWeights(weights, weightCdf, n, 9.0f);
+    maxGap = 0.0f;
+    for (r = 0; r < UNIT_DRAWS; ++r) {
+      seed = parallelSeed = SEED + r;
+      pfResample_ancestors(PF_RESAMPLE_SYSTEMATIC, &seed, weights, weightCdf, ancestors, n, s);
+      pfResample_ancestors(PF_RESAMPLE_PARALLEL_SYSTEMATIC, &parallelSeed, weights, parallelCdf, parallelAncestors, n, s);
+      CHECK(seed == parallelSeed);
+      memset(children, 0, n * sizeof(int));
+      memset(parallelChildren, 0, n * sizeof(int));
+      for (i = 0; i < n; ++i) {
+        a = ancestors[i];
+        b = parallelAncestors[i];
+        gap = fabsf(weightCdf[a] - weightCdf[b]) - (weights[a] > weights[b] ? weights[a] : weights[b]);
+        maxGap = gap > maxGap ? gap : maxGap;
+        ++children[a];
+        ++parallelChildren[b];
+      }
+      // Systematic resampling rounds N * w / s up or down, never further.
+      // The only slack is for float rounding: each CDF entry and each
+      // sample point is off by a few ulp of s, a few N * FLT_EPSILON
+      // children, which matters only when N * w / s is that close to an
+      // integer
+      slack = 4.0f * n * FLT_EPSILON;
+      for (i = 0; i < n; ++i) {
+        expected = n * weights[i] / s;
+        CHECK(children[i] >= floorf(expected - slack) && children[i] <= ceilf(expected + slack));
+        CHECK(parallelChildren[i] >= floorf(expected - slack) && parallelChildren[i] <= ceilf(expected + slack));
+      }
+    }
+    CHECK(maxGap <= 1e-4f * s);
+  }
+
+  // A few heavy particles, the largest weight about 40 times the mean. A
+  // chain of 64 steps is already off by 0.05 children per particle and 10%
+  // on the heavy ones
+  n = UNIT_METROPOLIS_N;
+  s = _unitWeights(weights, weightCdf, n, 40.0f);
+  seed = SEED;
+  memset(meanChildren, 0, sizeof(meanChildren));
+  for (r = 0; r < UNIT_METROPOLIS_R; ++r) {
+    pfResample_ancestors(PF_RESAMPLE_METROPOLIS, &seed, weights, weightCdf, ancestors, n, s);
+    for (i = 0; i < n; ++i)
+      meanChildren[ancestors[i]] += 1.0 / UNIT_METROPOLIS_R;
+  }
+  dev = 0.0f;
+  for (i = 0; i < n; ++i) {
+    expected = n * weights[i] / s;
+    dev += fabsf((float)meanChildren[i] - expected) / n;
+    if (expected >= 2.0f)
+      CHECK(fabsf((float)meanChildren[i] - expected) < 0.06f * expected);
+  }
+  CHECK(dev < 0.02f);
+}
+
+// Every instruction set the CPU has, capped one at a time, gives the same
+// bits as the scalar kernels
+static void _testKernels(void) {
+  static tagParticle_t particles[UNIT_KERNEL_N];
+  static float ranges[UNIT_KERNEL_N], scalarRanges[UNIT_KERNEL_N];
+  static float sphere[4][UNIT_KERNEL_N], scalarSphere[4][UNIT_KERNEL_N];
+  pfCpuLevel_t best, level;
+  int i, j;
+
+  for (i = 0; i < UNIT_KERNEL_N; ++i) {
+    for (j = 0; j < 5; ++j) {
+      _unitLcg = _unitLcg * 1664525u + 1013904223u;
+      ((float*)&particles[i])[j] = ((_unitLcg >> 8) / 16777216.0f - 0.5f) * 40.0f;
+    }
+  }
+
+  best = particleFilterCpu_get();
+  CHECK(particleFilterCpu_set(PF_CPU_SCALAR) == PF_CPU_SCALAR);
+  pfCpu_kernels()->ranges(particles, UNIT_KERNEL_N, 1.5f, -2.0f, 0.75f, scalarRanges);
+  pfCpu_kernels()->sphere(SEED, 0.5f, 3.0f, scalarSphere[0], scalarSphere[1], scalarSphere[2], scalarSphere[3], UNIT_KERNEL_N);
+  for (level = PF_CPU_SSE42; level <= best; level = (pfCpuLevel_t)(level + 1)) {
+    printf("Checking %s kernels\n", particleFilterCpu_name(level));
+    CHECK(particleFilterCpu_set(level) == level);
+    pfCpu_kernels()->ranges(particles, UNIT_KERNEL_N, 1.5f, -2.0f, 0.75f, ranges);
+    pfCpu_kernels()->sphere(SEED, 0.5f, 3.0f, sphere[0], sphere[1], sphere[2], sphere[3], UNIT_KERNEL_N);
+    CHECK(memcmp(ranges, scalarRanges, sizeof(ranges)) == 0);
+    CHECK(memcmp(sphere, scalarSphere, sizeof(sphere)) == 0);
+  }
+  particleFilterCpu_set(best);
+}
+
+// Weights u^sharpness for u uniform, so a few heavy particles among many
+// light ones, with their running sum. Returns the sum
+static float _unitWeights(float* weights, float* weightCdf, int n, float sharpness) {
+  int i;
+  float s;
+
+  s = 0.0f;
+  for (i = 0; i < n; ++i) {
+    _unitLcg = _unitLcg * 1664525u + 1013904223u;
+    weights[i] = powf((_unitLcg >> 8) / 16777216.0f, sharpness) + 1e-6f;
+    s += weights[i];
+    weightCdf[i] = s;
+  }
+  return s;
+}
+
+// A tag circling among UNIT_BCNS beacons, ranging to one of them per step
+static void _feedLoc(particleFilterLoc_t* pf, int step) {
+  int b;
+
+  b = step % UNIT_BCNS;
+  particleFilterLoc_depositVio(pf, step * 0.1, 3.0f + 2.0f * cosf(step * 0.05f), 3.0f + 2.0f * sinf(step * 0.05f), 1.0f, 0.0f);
+  particleFilterLoc_depositRange(pf, _unitBcns[b][0], _unitBcns[b][1], _unitBcns[b][2], _unitRange(step, b), UWB_STD);
+}
+
+static void _feedSlam(particleFilterSlam_t* pf, bcn_t** bcns, int step) {
+  int b;
+
+  // Beacons are first ranged a few steps apart, from different places
+  b = (step / 4) % UNIT_SLAM_BCNS;
+  particleFilterSlam_depositTagVio(pf, step * 0.1, 3.0f + 2.0f * cosf(step * 0.05f), 3.0f + 2.0f * sinf(step * 0.05f), 1.0f, 0.0f);
+  particleFilterSlam_depositRange(pf, bcns[b], _unitRange(step, b), UWB_STD, bcns, UNIT_SLAM_BCNS);
+}
+
+static float _unitRange(int step, int b) {
+  float dx, dy, dz;
+
+  dx = 3.0f + 2.0f * cosf(step * 0.05f) - _unitBcns[b][0];
+  dy = 3.0f + 2.0f * sinf(step * 0.05f) - _unitBcns[b][1];
+  dz = 1.0f - _unitBcns[b][2];
+  return sqrtf(dx * dx + dy * dy + dz * dz);
+}
+
+static uint8_t _sameLoc(const particleFilterLoc_t* a, const particleFilterLoc_t* b, float tol) {
+  double at, bt;
+  float ax, ay, az, atheta, bx, by, bz, btheta;
+
+  if (!particleFilterLoc_getTagLoc(a, &at, &ax, &ay, &az, &atheta) || !particleFilterLoc_getTagLoc(b, &bt, &bx, &by, &bz, &btheta))
+    return 0;
+  return at == bt && fabsf(ax - bx) <= tol && fabsf(ay - by) <= tol && fabsf(az - bz) <= tol && fabsf(atheta - btheta) <= tol;
+}
+
+static uint8_t _sameSlam(const particleFilterSlam_t* a, bcn_t** aBcns, const particleFilterSlam_t* b, bcn_t** bBcns) {
+  double at, bt;
+  float ax, ay, az, atheta, bx, by, bz, btheta;
+  int i;
+
+  if (!particleFilterSlam_getTagLoc(a, &at, &ax, &ay, &az, &atheta) || !particleFilterSlam_getTagLoc(b, &bt, &bx, &by, &bz, &btheta))
+    return 0;
+  if (at != bt || ax != bx || ay != by || az != bz || atheta != btheta)
+    return 0;
+  for (i = 0; i < UNIT_SLAM_BCNS; ++i) {
+    if (!particleFilterSlam_getBcnLoc(a, aBcns[i], &at, &ax, &ay, &az, &atheta) || !particleFilterSlam_getBcnLoc(b, bBcns[i], &bt, &bx, &by, &bz, &btheta))
+      return 0;
+    if (at != bt || ax != bx || ay != by || az != bz || atheta != btheta)
+      return 0;
+  }
+  return 1;
+}
@@ -0,0 +1,102 @@
+/*
+ * test_mqttlocalize.c
+ * Created by slam3d contributors on 10/19/26.
+ *
+ * Copyright (c) 2026, Wireless Sensing and Embedded Systems Lab, Carnegie
+ * Mellon University
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-3-Clause license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "mlJson.h"
+
+// Unit tests for the parts of mqttlocalize that build without Paho or cJSON
+
+#define CHECK(cond) do { if (!(cond)) { printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); ++_failures; } } while (0)
+
+static int8_t _parse(const char* json, mlVio_t* vio);
+static void _testJson(void);
+
+static int _failures;
+
+int main(int argc, char** argv) {
+  printf("Starting mqttlocalize tests\n");
+  _testJson();
+  if (_failures == 0) {
+    printf("Test passed\n");
+    return 0;
+  }
+  printf("Test failed, %d checks\n", _failures);
+  return 1;
+}
+
+static int8_t _parse(const char* json, mlVio_t* vio) {
+  return mlJson_parseVio(json, strlen(json), vio);
+}
+
+static void _testJson(void) {
+  mlVio_t vio;
+  char buf[256];
+  size_t len;
+
+  // A whole ARENA update, ISO 8601 timestamp
+  CHECK(_parse("{\"object_id\":\"camera_a\",\"action\":\"update\",\"type\":\"object\",\"timestamp\":\"2021-07-01T18:20:21.123Z\","
+    "\"data\":{\"position\":{\"x\":0.788,\"y\":1.105,\"z\":-0.235},\"rotation\":{\"x\":0.024,\"y\":0.701,\"z\":0.712,\"w\":0.026}}}", &vio) == ML_JSON_OK);
+  CHECK(vio.px == 0.788 && vio.py == 1.105 && vio.pz == -0.235);
+  CHECK(vio.hasRotation == 0xf && vio.rw == 0.026);
+  CHECK(vio.hasTimestamp && fabs(vio.timestamp - 1625163621.123) < 1e-6);
+
+  // Numeric timestamps in seconds or milliseconds
+  CHECK(_parse("{\"timestamp\":1625163621.5,\"data\":{\"position\":{\"x\":1,\"y\":2,\"z\":3}}}", &vio) == ML_JSON_OK);
+  CHECK(vio.hasTimestamp && vio.timestamp == 1625163621.5);
+  CHECK(_parse("{\"timestamp\":1625163621500,\"data\":{\"position\":{\"x\":1,\"y\":2,\"z\":3}}}", &vio) == ML_JSON_OK);
+  CHECK(vio.hasTimestamp && vio.timestamp == 1625163621.5);
+  CHECK(vio.hasRotation == 0);
+
+  // Timestamps that are not understood are left out, not fatal
+  CHECK(_parse("{\"timestamp\":\"2021-07-01 18:20:21\",\"data\":{\"position\":{\"x\":1,\"y\":2,\"z\":3}}}", &vio) == ML_JSON_OK);
+  CHECK(!vio.hasTimestamp);
+  CHECK(_parse("{\"timestamp\":\"2021-07-01T18:20:21+01:00\",\"data\":{\"position\":{\"x\":1,\"y\":2,\"z\":3}}}", &vio) == ML_JSON_OK);
+  CHECK(!vio.hasTimestamp);
+
+  // No position, or not all of it, or not as numbers
+  CHECK(_parse("{\"object_id\":\"camera_a\",\"action\":\"delete\"}", &vio) == ML_JSON_MISSING);
+  CHECK(_parse("{\"data\":{\"rotation\":{\"x\":0,\"y\":0,\"z\":0,\"w\":1}}}", &vio) == ML_JSON_MISSING);
+  CHECK(_parse("{\"data\":{\"position\":{\"x\":1,\"y\":2}}}", &vio) == ML_JSON_MISSING);
+  CHECK(_parse("{\"data\":{\"position\":{\"x\":\"1\",\"y\":2,\"z\":3}}}", &vio) == ML_JSON_MISSING);
+  CHECK(_parse("{\"position\":{\"x\":1,\"y\":2,\"z\":3}}", &vio) == ML_JSON_MISSING);
+
+  // Escaped keys on the way to the position need cJSON, elsewhere they do not
+  CHECK(_parse("{\"d\\u0061ta\":{\"position\":{\"x\":1,\"y\":2,\"z\":3}}}", &vio) == ML_JSON_ESCAPED);
+  CHECK(_parse("{\"data\":{\"position\":{\"\\u0078\":1,\"y\":2,\"z\":3}}}", &vio) == ML_JSON_ESCAPED);
+  CHECK(_parse("{\"o\\\"id\":\"a\\\"b\"}", &vio) == ML_JSON_ESCAPED);
+  CHECK(_parse("{\"o\\\"id\":\"a\\\"b\",\"data\":{\"position\":{\"x\":1,\"y\":2,\"z\":3}}}", &vio) == ML_JSON_OK);
+  CHECK(_parse("{\"data\":{\"position\":{\"x\":1,\"y\":2,\"z\":3},\"extra\":{\"k\\ney\":1}}}", &vio) == ML_JSON_OK);
+  CHECK(_parse("{\"other\":{\"k\\\"ey\":1}}", &vio) == ML_JSON_MISSING);
+
+  // Malformed
+  CHECK(_parse("", &vio) == ML_JSON_MALFORMED);
+  CHECK(_parse("[1,2,3]", &vio) == ML_JSON_MALFORMED);
+  CHECK(_parse("{\"data\":{\"position\":{\"x\":1,\"y\":2,\"z\":3}}", &vio) == ML_JSON_MALFORMED);
+  CHECK(_parse("{\"data\":{\"position\":{\"x\":1,\"y\":2,\"z\":3}}}x", &vio) == ML_JSON_MALFORMED);
+  CHECK(_parse("{\"data\":{\"position\":{\"x\":1.2.3,\"y\":2,\"z\":3}}}", &vio) == ML_JSON_MALFORMED);
+  CHECK(_parse("{\"data\":{\"position\":{\"x\":1,\"y\":2,\"z\":3,}}}", &vio) == ML_JSON_MALFORMED);
+  CHECK(_parse("{\"data\" {\"position\":{\"x\":1,\"y\":2,\"z\":3}}}", &vio) == ML_JSON_MALFORMED);
+  CHECK(_parse("{\"flag\":tru,\"data\":{\"position\":{\"x\":1,\"y\":2,\"z\":3}}}", &vio) == ML_JSON_MALFORMED);
+  CHECK(_parse("{\"str\":\"unterminated}", &vio) == ML_JSON_MALFORMED);
+  CHECK(_parse("{\"a\":[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[1]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]}", &vio) == ML_JSON_MALFORMED);
+
+  // Payloads are not NUL-terminated; nothing past len is read
+  strcpy(buf, "{\"data\":{\"position\":{\"x\":1,\"y\":2,\"z\":3}}}");
+  len = strlen(buf);
+  memcpy(buf + len, "999", 4);
+  CHECK(mlJson_parseVio(buf, len, &vio) == ML_JSON_OK && vio.pz == 3.0);
+  CHECK(mlJson_parseVio(buf, len - 1, &vio) == ML_JSON_MALFORMED);
+}